@@ -42,6 +42,14 @@ public:
         return node_to_value(*node);
     }
 
+    const V* find_largest_not_above(K key) const
+    {
+        auto* node = static_cast<TreeNode*>(BaseTree::find_largest_not_above(this->m_root, key));
+        if (!node)
+            return nullptr;
+        return node_to_value(*node);
+    }
+
     void insert(V& value)
     {
         auto& node = value.*member;
@@ -104,7 +112,7 @@ public:
     using ConstIterator = BaseIterator<const V>;
     ConstIterator begin() const { return ConstIterator(static_cast<TreeNode*>(this->m_minimum)); }
     ConstIterator end() const { return {}; }
-    ConstIterator begin_from(K key) const { return ConstIterator(static_cast<TreeNode*>(BaseTree::find(this->m_rootF, key))); }
+    ConstIterator begin_from(K key) const { return ConstIterator(static_cast<TreeNode*>(BaseTree::find(this->m_root, key))); }
 
     bool remove(K key)
     {
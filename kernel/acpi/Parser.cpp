@@ -31,29 +31,14 @@ UNMAP_AFTER_INIT NonnullRefPtr<ACPISysFSComponent> ACPISysFSComponent::create(St
     return adopt_ref(*new (nothrow) ACPISysFSComponent(name, paddr, table_size));
 }
 
-KResultOr<size_t> ACPISysFSComponent::read_bytes(off_t offset, size_t count, UserOrKernelBuffer& buffer, FileDescription*) const
-{
-    auto blob = try_to_generate_buffer();
-    if (!blob)
-        return KResult(EFAULT);
-
-    if ((size_t)offset >= blob->size())
-        return KSuccess;
-
-    ssize_t nread = min(static_cast<off_t>(blob->size() - offset), static_cast<off_t>(count));
-    if (!buffer.write(blob->data() + offset, nread))
-        return KResult(EFAULT);
-    return nread;
-}
-
-OwnPtr<KBuffer> ACPISysFSComponent::try_to_generate_buffer() const
+KResult ACPISysFSComponent::generate(SysFSContentWriter& writer) const
 {
     auto acpi_blob = Memory::map_typed<u8>((m_paddr), m_length);
-    return KBuffer::try_create_with_bytes(Span<u8> { acpi_blob.ptr(), m_length });
+    return writer.append(ReadonlyBytes { acpi_blob.ptr(), m_length });
 }
 
 UNMAP_AFTER_INIT ACPISysFSComponent::ACPISysFSComponent(String name, PhysicalAddress paddr, size_t table_size)
-    : SysFSComponent(name)
+    : SysFSGeneratedComponent(name)
     , m_paddr(paddr)
     , m_length(table_size)
 {
@@ -25,14 +25,15 @@ private:
     ACPISysFSDirectory();
 };
 
-class ACPISysFSComponent : public SysFSComponent {
+class ACPISysFSComponent : public SysFSGeneratedComponent {
 public:
     static NonnullRefPtr<ACPISysFSComponent> create(String name, PhysicalAddress, size_t table_size);
 
-    virtual KResultOr<size_t> read_bytes(off_t, size_t, UserOrKernelBuffer&, FileDescription*) const override;
+    virtual size_t size() const override { return m_length; }
 
 protected:
-    OwnPtr<KBuffer> try_to_generate_buffer() const;
+    virtual KResult generate(SysFSContentWriter&) const override;
+    virtual bool content_is_immutable() const override { return true; }
     ACPISysFSComponent(String name, PhysicalAddress, size_t table_size);
 
     PhysicalAddress m_paddr;
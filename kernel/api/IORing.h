@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+enum class IORingOpcode : u8 {
+    Nop = 0,
+    Read,
+    Write,
+    Fsync,
+    Open,
+    Stat,
+};
+
+constexpr i64 IORING_CURRENT_OFFSET = -1;
+
+struct IORingSubmission {
+    IORingOpcode opcode { IORingOpcode::Nop };
+    u8 reserved[3] {};
+    int fd { -1 };
+    i64 offset { IORING_CURRENT_OFFSET };
+    u64 buffer { 0 };
+    u64 length { 0 };
+    u64 path { 0 };
+    u32 path_length { 0 };
+    int options { 0 };
+    u32 mode { 0 };
+    u32 reserved2 { 0 };
+    u64 user_data { 0 };
+};
+
+struct IORingCompletion {
+    u64 user_data { 0 };
+    i64 result { 0 };
+};
+
+struct IORingHeader {
+    u32 submission_head;
+    u32 submission_tail;
+    u32 submission_mask;
+    u32 submission_entries;
+    u32 completion_head;
+    u32 completion_tail;
+    u32 completion_mask;
+    u32 completion_entries;
+    u32 completion_overflow;
+    u32 submissions_offset;
+    u32 completions_offset;
+    u32 mapping_size;
+};
+
+constexpr u32 IORING_MAX_ENTRIES = 4096;
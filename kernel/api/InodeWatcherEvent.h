@@ -24,6 +24,7 @@ struct [[gnu::packed]] InodeWatcherEvent {
         Deleted = 1 << 2,
         ChildCreated = 1 << 3,
         ChildDeleted = 1 << 4,
+        QueueOverflow = 1 << 5,
     };
 
     int watch_descriptor { 0 };
@@ -36,3 +37,29 @@ struct [[gnu::packed]] InodeWatcherEvent {
 BASE_ENUM_BITWISE_OPERATORS(InodeWatcherEvent::Type);
 
 constexpr unsigned MAXIMUM_EVENT_SIZE = sizeof(InodeWatcherEvent) + NAME_MAX + 1;
+
+struct InodeWatcherRingEntry {
+    int watch_descriptor { 0 };
+    InodeWatcherEvent::Type type { InodeWatcherEvent::Type::Invalid };
+    u32 name_length { 0 };
+    char name[NAME_MAX + 1];
+};
+
+// A mapped ring consumer advances claimed before copying an entry out and head once
+// the copy is done. The kernel only reuses slots behind head, and only coalesces
+// repeated events into entries at or past claimed.
+//
+// The header occupies the first page and is mapped read-write at offset 0. The entries
+// start at entries_offset and can only be mapped read-only.
+struct InodeWatcherRingHeader {
+    u32 head;
+    u32 claimed;
+    u32 tail;
+    u32 capacity;
+    u32 overflow_count;
+    u32 entries_offset;
+    u32 mapping_size;
+};
+
+constexpr u32 INODE_WATCHER_DEFAULT_QUEUE_SIZE = 64;
+constexpr u32 INODE_WATCHER_MAX_QUEUE_SIZE = 65536;
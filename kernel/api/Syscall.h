@@ -187,7 +187,14 @@ enum class NeedsBigProcessLock {
     S(emuctl, NeedsBigProcessLock::Yes)                     \
     S(statvfs, NeedsBigProcessLock::Yes)                    \
     S(fstatvfs, NeedsBigProcessLock::Yes)                   \
-    S(kill_thread, NeedsBigProcessLock::Yes)
+    S(kill_thread, NeedsBigProcessLock::Yes)                \
+    S(sendfile, NeedsBigProcessLock::Yes)                   \
+    S(copy_file_range, NeedsBigProcessLock::Yes)            \
+    S(splice, NeedsBigProcessLock::Yes)                     \
+    S(io_ring_setup, NeedsBigProcessLock::Yes)              \
+    S(io_ring_enter, NeedsBigProcessLock::Yes)              \
+    S(vmsplice, NeedsBigProcessLock::Yes)                   \
+    S(inode_watcher_set_queue_size, NeedsBigProcessLock::Yes)
 
 namespace Syscall {
 
@@ -475,6 +482,37 @@ struct SC_statvfs_params {
     struct statvfs* buf;
 };
 
+struct SC_sendfile_params {
+    int out_fd;
+    int in_fd;
+    off_t* offset;
+    size_t count;
+};
+
+struct SC_copy_file_range_params {
+    int fd_in;
+    off_t* off_in;
+    int fd_out;
+    off_t* off_out;
+    size_t length;
+    unsigned flags;
+};
+
+struct SC_splice_params {
+    int fd_in;
+    off_t* off_in;
+    int fd_out;
+    off_t* off_out;
+    size_t length;
+    unsigned flags;
+};
+
+struct SC_io_ring_setup_params {
+    u32 entries;
+    u32 flags;
+    size_t* mapping_size;
+};
+
 void initialize();
 int sync();
 
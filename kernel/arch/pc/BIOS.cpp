@@ -25,25 +25,10 @@ UNMAP_AFTER_INIT NonnullRefPtr<DMIEntryPointExposedBlob> DMIEntryPointExposedBlo
 }
 
 UNMAP_AFTER_INIT BIOSSysFSComponent::BIOSSysFSComponent(String name)
-    : SysFSComponent(name)
+    : SysFSGeneratedComponent(name)
 {
 }
 
-KResultOr<size_t> BIOSSysFSComponent::read_bytes(off_t offset, size_t count, UserOrKernelBuffer& buffer, FileDescription*) const
-{
-    auto blob = try_to_generate_buffer();
-    if (!blob)
-        return KResult(EFAULT);
-
-    if ((size_t)offset >= blob->size())
-        return KSuccess;
-
-    ssize_t nread = min(static_cast<off_t>(blob->size() - offset), static_cast<off_t>(count));
-    if (!buffer.write(blob->data() + offset, nread))
-        return KResult(EFAULT);
-    return nread;
-}
-
 UNMAP_AFTER_INIT DMIEntryPointExposedBlob::DMIEntryPointExposedBlob(PhysicalAddress dmi_entry_point, size_t blob_size)
     : BIOSSysFSComponent("smbios_entry_point")
     , m_dmi_entry_point(dmi_entry_point)
@@ -51,10 +36,10 @@ UNMAP_AFTER_INIT DMIEntryPointExposedBlob::DMIEntryPointExposedBlob(PhysicalAddr
 {
 }
 
-OwnPtr<KBuffer> DMIEntryPointExposedBlob::try_to_generate_buffer() const
+KResult DMIEntryPointExposedBlob::generate(SysFSContentWriter& writer) const
 {
     auto dmi_blob = Memory::map_typed<u8>((m_dmi_entry_point), m_dmi_entry_point_length);
-    return KBuffer::try_create_with_bytes(Span<u8> { dmi_blob.ptr(), m_dmi_entry_point_length });
+    return writer.append(ReadonlyBytes { dmi_blob.ptr(), m_dmi_entry_point_length });
 }
 
 UNMAP_AFTER_INIT NonnullRefPtr<SMBIOSExposedTable> SMBIOSExposedTable::create(PhysicalAddress smbios_structure_table, size_t smbios_structure_table_length)
@@ -69,10 +54,10 @@ UNMAP_AFTER_INIT SMBIOSExposedTable::SMBIOSExposedTable(PhysicalAddress smbios_s
 {
 }
 
-OwnPtr<KBuffer> SMBIOSExposedTable::try_to_generate_buffer() const
+KResult SMBIOSExposedTable::generate(SysFSContentWriter& writer) const
 {
     auto dmi_blob = Memory::map_typed<u8>((m_smbios_structure_table), m_smbios_structure_table_length);
-    return KBuffer::try_create_with_bytes(Span<u8> { dmi_blob.ptr(), m_smbios_structure_table_length });
+    return writer.append(ReadonlyBytes { dmi_blob.ptr(), m_smbios_structure_table_length });
 }
 
 UNMAP_AFTER_INIT void BIOSSysFSDirectory::set_dmi_64_bit_entry_initialization_values()
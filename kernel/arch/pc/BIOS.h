@@ -58,12 +58,9 @@ namespace Kernel {
 Memory::MappedROM map_bios();
 Memory::MappedROM map_ebda();
 
-class BIOSSysFSComponent : public SysFSComponent {
-public:
-    virtual KResultOr<size_t> read_bytes(off_t, size_t, UserOrKernelBuffer&, FileDescription*) const override;
-
+class BIOSSysFSComponent : public SysFSGeneratedComponent {
 protected:
-    virtual OwnPtr<KBuffer> try_to_generate_buffer() const = 0;
+    virtual bool content_is_immutable() const override { return true; }
     explicit BIOSSysFSComponent(String name);
 };
 
@@ -74,7 +71,7 @@ public:
 
 private:
     DMIEntryPointExposedBlob(PhysicalAddress dmi_entry_point, size_t blob_size);
-    virtual OwnPtr<KBuffer> try_to_generate_buffer() const override;
+    virtual KResult generate(SysFSContentWriter&) const override;
     PhysicalAddress m_dmi_entry_point;
     size_t m_dmi_entry_point_length;
 };
@@ -86,7 +83,7 @@ public:
 
 private:
     SMBIOSExposedTable(PhysicalAddress dmi_entry_point, size_t blob_size);
-    virtual OwnPtr<KBuffer> try_to_generate_buffer() const override;
+    virtual KResult generate(SysFSContentWriter&) const override;
 
     PhysicalAddress m_smbios_structure_table;
     size_t m_smbios_structure_table_length;
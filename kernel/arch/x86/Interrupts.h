@@ -42,6 +42,10 @@ GenericInterruptHandler& get_interrupt_handler(u8 interrupt_number);
 void register_generic_interrupt_handler(u8 number, GenericInterruptHandler&);
 void unregister_generic_interrupt_handler(u8 number, GenericInterruptHandler&);
 
+// Interrupts are counted separately on each of the first max_processors_with_interrupt_counts processors.
+static constexpr u32 max_processors_with_interrupt_counts = 32;
+u64 get_interrupt_count_on_processor(u8 interrupt_number, u32 cpu);
+
 void idt_init();
 
 }
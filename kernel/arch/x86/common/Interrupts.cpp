@@ -19,6 +19,7 @@
 #include <kernel/Thread.h>
 #include <kernel/ThreadTracer.h>
 #include <libc/mallocdefs.h>
+#include <kernel/arch/x86/Interrupts.h>
 #include <kernel/arch/x86/ISRStubs.h>
 #include <kernel/arch/x86/Processor.h>
 #include <kernel/arch/x86/RegisterState.h>
@@ -38,6 +39,8 @@ READONLY_AFTER_INIT static DescriptorTablePointer s_idtr;
 READONLY_AFTER_INIT static IDTEntry s_idt[256];
 
 static GenericInterruptHandler* s_interrupt_handler[GENERIC_INTERRUPT_HANDLERS_COUNT];
+// Each processor only ever bumps its own row, so the counters need neither atomics nor shared cache lines.
+static u64 s_interrupt_counts[max_processors_with_interrupt_counts][GENERIC_INTERRUPT_HANDLERS_COUNT];
 
 static EntropySource s_entropy_source_interrupts { EntropySource::Static::Interrupts };
 
@@ -466,6 +469,8 @@ void handle_interrupt(TrapFrame* trap)
     auto* handler = s_interrupt_handler[irq];
     VERIFY(handler);
     handler->increment_invoking_counter();
+    if (u32 cpu = Processor::id(); cpu < max_processors_with_interrupt_counts)
+        ++s_interrupt_counts[cpu][irq];
     handler->handle_interrupt(regs);
     handler->eoi();
 }
@@ -480,6 +485,14 @@ static void unimp_trap()
     PANIC("Unhandled IRQ");
 }
 
+u64 get_interrupt_count_on_processor(u8 interrupt_number, u32 cpu)
+{
+    VERIFY(interrupt_number < GENERIC_INTERRUPT_HANDLERS_COUNT);
+    if (cpu >= max_processors_with_interrupt_counts)
+        return 0;
+    return s_interrupt_counts[cpu][interrupt_number];
+}
+
 GenericInterruptHandler& get_interrupt_handler(u8 interrupt_number)
 {
     auto*& handler_slot = s_interrupt_handler[interrupt_number];
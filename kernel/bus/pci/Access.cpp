@@ -407,37 +407,14 @@ NonnullRefPtr<PCIDeviceAttributeSysFSComponent> PCIDeviceAttributeSysFSComponent
 }
 
 PCIDeviceAttributeSysFSComponent::PCIDeviceAttributeSysFSComponent(String name, const PCIDeviceSysFSDirectory& device, size_t offset, size_t field_bytes_width)
-    : SysFSComponent(name)
+    : SysFSGeneratedComponent(name)
     , m_device(device)
     , m_offset(offset)
     , m_field_bytes_width(field_bytes_width)
 {
 }
 
-KResultOr<size_t> PCIDeviceAttributeSysFSComponent::read_bytes(off_t offset, size_t count, UserOrKernelBuffer& buffer, FileDescription*) const
-{
-    auto blob = try_to_generate_buffer();
-    if (!blob)
-        return KResult(EFAULT);
-
-    if ((size_t)offset >= blob->size())
-        return KSuccess;
-
-    ssize_t nread = min(static_cast<off_t>(blob->size() - offset), static_cast<off_t>(count));
-    if (!buffer.write(blob->data() + offset, nread))
-        return KResult(EFAULT);
-    return nread;
-}
-
-size_t PCIDeviceAttributeSysFSComponent::size() const
-{
-    auto buffer = try_to_generate_buffer();
-    if (!buffer)
-        return 0;
-    return buffer->size();
-}
-
-OwnPtr<KBuffer> PCIDeviceAttributeSysFSComponent::try_to_generate_buffer() const
+KResult PCIDeviceAttributeSysFSComponent::generate(SysFSContentWriter& writer) const
 {
     String value;
     switch (m_field_bytes_width) {
@@ -454,7 +431,7 @@ OwnPtr<KBuffer> PCIDeviceAttributeSysFSComponent::try_to_generate_buffer() const
         VERIFY_NOT_REACHED();
     }
 
-    return KBuffer::try_create_with_bytes(value.substring_view(0).bytes());
+    return writer.append(value.view());
 }
 }
 }
@@ -34,16 +34,14 @@ private:
     Address m_address;
 };
 
-class PCIDeviceAttributeSysFSComponent : public SysFSComponent {
+class PCIDeviceAttributeSysFSComponent : public SysFSGeneratedComponent {
 public:
     static NonnullRefPtr<PCIDeviceAttributeSysFSComponent> create(String name, const PCIDeviceSysFSDirectory& device, size_t offset, size_t field_bytes_width);
 
-    virtual KResultOr<size_t> read_bytes(off_t, size_t, UserOrKernelBuffer&, FileDescription*) const override;
     virtual ~PCIDeviceAttributeSysFSComponent() {};
-    virtual size_t size() const override;
 
 protected:
-    virtual OwnPtr<KBuffer> try_to_generate_buffer() const;
+    virtual KResult generate(SysFSContentWriter&) const override;
     PCIDeviceAttributeSysFSComponent(String name, const PCIDeviceSysFSDirectory& device, size_t offset, size_t field_bytes_width);
     NonnullRefPtr<PCIDeviceSysFSDirectory> m_device;
     size_t m_offset;
@@ -250,6 +250,7 @@ class WindowedMMIOAccess;
 class IOAccess;
 class MMIOSegment;
 class DeviceController;
+class MessageSignalledInterrupts;
 class Device;
 
 }
@@ -19,6 +19,7 @@ enum VendorID {
 };
 
 enum DeviceID {
+    VirtIOBlock = 0x1001,
     VirtIOConsole = 0x1003,
     VirtIOEntropy = 0x1005,
     VirtIOGPU = 0x1050,
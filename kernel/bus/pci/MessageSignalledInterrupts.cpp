@@ -0,0 +1,187 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/bus/pci/MessageSignalledInterrupts.h>
+#include <kernel/CommandLine.h>
+#include <kernel/memory/MemoryManager.h>
+
+namespace Kernel {
+namespace PCI {
+
+static constexpr u32 control_register = 0x2;
+
+static constexpr u16 msi_control_enable = 1 << 0;
+static constexpr u16 msi_control_multiple_message_enable_mask = 0x7 << 4;
+static constexpr u16 msi_control_64bit = 1 << 7;
+static constexpr u16 msi_control_per_vector_masking = 1 << 8;
+static constexpr u32 msi_address_low_register = 0x4;
+static constexpr u32 msi_address_high_register = 0x8;
+
+static constexpr u16 msix_control_table_size_mask = 0x7ff;
+static constexpr u16 msix_control_function_mask = 1 << 14;
+static constexpr u16 msix_control_enable = 1 << 15;
+static constexpr u32 msix_table_register = 0x4;
+static constexpr u32 msix_table_bir_mask = 0x7;
+static constexpr u32 msix_vector_control_masked = 1 << 0;
+
+OwnPtr<MessageSignalledInterrupts> MessageSignalledInterrupts::try_create(Address address, size_t requested_count, StringView purpose)
+{
+    VERIFY(requested_count > 0);
+    if (kernel_command_line().lookup("pci_msi"sv).value_or("on"sv) == "off"sv)
+        return {};
+
+    Optional<Capability> msi;
+    Optional<Capability> msix;
+    for (auto& capability : get_physical_id(address).capabilities()) {
+        if (capability.id() == PCI_CAPABILITY_MSI)
+            msi = capability;
+        else if (capability.id() == PCI_CAPABILITY_MSIX)
+            msix = capability;
+    }
+
+    if (msix.has_value()) {
+        auto interrupts = adopt_own_if_nonnull(new (nothrow) MessageSignalledInterrupts(address, msix.value(), true));
+        if (interrupts && interrupts->allocate_vectors(requested_count, purpose))
+            return interrupts;
+    }
+    if (msi.has_value()) {
+        auto interrupts = adopt_own_if_nonnull(new (nothrow) MessageSignalledInterrupts(address, msi.value(), false));
+        if (interrupts && interrupts->allocate_vectors(1, purpose))
+            return interrupts;
+    }
+    return {};
+}
+
+MessageSignalledInterrupts::MessageSignalledInterrupts(Address address, Capability const& capability, bool extended)
+    : m_address(address)
+    , m_capability(capability)
+    , m_extended(extended)
+{
+}
+
+MessageSignalledInterrupts::~MessageSignalledInterrupts()
+{
+    disable();
+}
+
+bool MessageSignalledInterrupts::map_table(size_t entry_count)
+{
+    u32 table = m_capability.read32(msix_table_register);
+    u8 bar_index = table & msix_table_bir_mask;
+    u32 bar = get_BAR(m_address, bar_index);
+    if (bar & 1)
+        return false;
+    u64 bar_base = bar & 0xfffffff0;
+    if ((bar & 0x6) == 0x4)
+        bar_base |= (u64)get_BAR(m_address, bar_index + 1) << 32;
+
+    u64 table_address = bar_base + (table & ~msix_table_bir_mask);
+    u64 offset_in_page = table_address - Memory::page_round_down(table_address);
+    enable_memory_space(m_address);
+    m_table_region = MM.allocate_kernel_region(PhysicalAddress(table_address - offset_in_page), Memory::page_round_up(offset_in_page + entry_count * sizeof(TableEntry)), "MSI-X Table", Memory::Region::Access::ReadWrite, Memory::Region::Cacheable::No);
+    if (!m_table_region)
+        return false;
+    m_table = reinterpret_cast<volatile TableEntry*>(m_table_region->vaddr().offset(offset_in_page).as_ptr());
+    return true;
+}
+
+bool MessageSignalledInterrupts::allocate_vectors(size_t count, StringView purpose)
+{
+    if (m_extended) {
+        size_t table_size = (m_capability.read16(control_register) & msix_control_table_size_mask) + 1;
+        count = min(count, table_size);
+        if (!map_table(count))
+            return false;
+    }
+
+    // Running out of vectors part way through still leaves the function with the ones it got.
+    for (size_t index = 0; index < count; ++index) {
+        auto handler = MSIHandler::try_create(*this, index, String::formatted("{} #{}", purpose, index));
+        if (!handler)
+            break;
+        if (m_extended)
+            m_table[index].vector_control = m_table[index].vector_control | msix_vector_control_masked;
+        write_message(*handler);
+        m_handlers.append(handler.release_nonnull());
+    }
+    return !m_handlers.is_empty();
+}
+
+void MessageSignalledInterrupts::write_message(MSIHandler const& handler)
+{
+    ScopedSpinLock lock(m_lock);
+    u64 address = handler.message_address();
+    u32 data = handler.message_data();
+
+    // A message must never go out half rewritten, so the vector is masked while it changes.
+    if (m_extended) {
+        auto& entry = m_table[handler.index()];
+        u32 vector_control = entry.vector_control;
+        entry.vector_control = vector_control | msix_vector_control_masked;
+        entry.address_low = address & 0xffffffff;
+        entry.address_high = address >> 32;
+        entry.data = data;
+        entry.vector_control = vector_control;
+        return;
+    }
+
+    u16 control = m_capability.read16(control_register);
+    bool is_64bit = control & msi_control_64bit;
+    u32 data_register = is_64bit ? 0xc : 0x8;
+    u32 mask_register = is_64bit ? 0x10 : 0xc;
+    bool per_vector_masking = control & msi_control_per_vector_masking;
+    if (per_vector_masking)
+        m_capability.write32(mask_register, 1);
+    else
+        m_capability.write16(control_register, control & ~msi_control_enable);
+    m_capability.write32(msi_address_low_register, address & 0xffffffff);
+    if (is_64bit)
+        m_capability.write32(msi_address_high_register, address >> 32);
+    m_capability.write16(data_register, data);
+    if (per_vector_masking)
+        m_capability.write32(mask_register, 0);
+    else
+        m_capability.write16(control_register, control);
+}
+
+void MessageSignalledInterrupts::enable()
+{
+    ScopedSpinLock lock(m_lock);
+    if (m_enabled)
+        return;
+    disable_interrupt_line(m_address);
+    u16 control = m_capability.read16(control_register);
+    if (m_extended) {
+        m_capability.write16(control_register, control | msix_control_enable | msix_control_function_mask);
+        for (size_t index = 0; index < m_handlers.size(); ++index)
+            m_table[index].vector_control = m_table[index].vector_control & ~msix_vector_control_masked;
+        m_capability.write16(control_register, (control | msix_control_enable) & ~msix_control_function_mask);
+    } else {
+        m_capability.write16(control_register, (control & ~msi_control_multiple_message_enable_mask) | msi_control_enable);
+    }
+    m_enabled = true;
+}
+
+void MessageSignalledInterrupts::disable()
+{
+    ScopedSpinLock lock(m_lock);
+    if (!m_enabled)
+        return;
+    u16 control = m_capability.read16(control_register);
+    if (m_extended) {
+        for (size_t index = 0; index < m_handlers.size(); ++index)
+            m_table[index].vector_control = m_table[index].vector_control | msix_vector_control_masked;
+        m_capability.write16(control_register, control & ~msix_control_enable);
+    } else {
+        m_capability.write16(control_register, control & ~msi_control_enable);
+    }
+    enable_interrupt_line(m_address);
+    m_enabled = false;
+}
+
+}
+}
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/NonnullOwnPtr.h>
+#include <base/OwnPtr.h>
+#include <base/Vector.h>
+#include <kernel/bus/pci/Definitions.h>
+#include <kernel/interrupts/MSIHandler.h>
+#include <kernel/locking/SpinLock.h>
+#include <kernel/memory/Region.h>
+
+namespace Kernel {
+
+// The dedicated interrupt vectors of one PCI function, programmed through its MSI-X table when it
+// has one and through its MSI capability otherwise. Every vector has its own handler and target
+// processor. Plain MSI only ever provides a single vector, since all messages of a multi-message
+// MSI block have to go to the same processor.
+class PCI::MessageSignalledInterrupts {
+    BASE_MAKE_NONCOPYABLE(MessageSignalledInterrupts);
+    BASE_MAKE_NONMOVABLE(MessageSignalledInterrupts);
+
+public:
+    // May hand out fewer vectors than requested; returns null if the function can't use MSI at all.
+    static OwnPtr<MessageSignalledInterrupts> try_create(Address, size_t requested_count, StringView purpose);
+    ~MessageSignalledInterrupts();
+
+    bool is_extended() const { return m_extended; }
+    size_t count() const { return m_handlers.size(); }
+    MSIHandler& handler(size_t index) { return *m_handlers[index]; }
+
+    // Switches the function from its pin over to the vectors and back. Handlers have to be set by then.
+    void enable();
+    void disable();
+
+private:
+    friend class Kernel::MSIHandler;
+
+    struct [[gnu::packed]] TableEntry {
+        u32 address_low;
+        u32 address_high;
+        u32 data;
+        u32 vector_control;
+    };
+
+    MessageSignalledInterrupts(Address, Capability const&, bool extended);
+
+    bool map_table(size_t entry_count);
+    bool allocate_vectors(size_t count, StringView purpose);
+    void write_message(MSIHandler const&);
+
+    Address m_address;
+    Capability m_capability;
+    bool m_extended { false };
+    bool m_enabled { false };
+    OwnPtr<Memory::Region> m_table_region;
+    volatile TableEntry* m_table { nullptr };
+    SpinLock<u8> m_lock;
+    Vector<NonnullOwnPtr<MSIHandler>> m_handlers;
+};
+
+}
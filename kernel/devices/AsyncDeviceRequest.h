@@ -72,6 +72,17 @@ public:
         start();
     }
 
+    void do_start()
+    {
+        {
+            ScopedSpinLock lock(m_lock);
+            if (is_completed_result(m_result))
+                return;
+            m_result = Started;
+        }
+        start();
+    }
+
     void complete(RequestResult result);
 
     void set_private(void* priv)
@@ -5,10 +5,34 @@
 */
 
 // includes
+#include <base/QuickSort.h>
 #include <kernel/devices/BlockDevice.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/memory/ScopedQuickMap.h>
+#include <kernel/StdLib.h>
+#include <kernel/time/TimeManagement.h>
 
 namespace Kernel {
 
+static constexpr u32 max_merged_block_count = 256;
+static constexpr i64 read_deadline_ms = 500;
+static constexpr i64 write_deadline_ms = 5000;
+
+static size_t latency_histogram_bucket(u64 latency_us)
+{
+    if (latency_us == 0)
+        return 0;
+    size_t bits = 64 - __builtin_clzll(latency_us);
+    return min(bits, BlockDevice::latency_histogram_buckets - 1);
+}
+
+static void update_maximum(Atomic<u64>& maximum, u64 value)
+{
+    auto current = maximum.load(Base::MemoryOrder::memory_order_relaxed);
+    while (value > current && !maximum.compare_exchange_strong(current, value, Base::MemoryOrder::memory_order_relaxed))
+        ;
+}
+
 AsyncBlockDeviceRequest::AsyncBlockDeviceRequest(Device& block_device, RequestType request_type, u64 block_index, u32 block_count, const UserOrKernelBuffer& buffer, size_t buffer_size)
     : AsyncDeviceRequest(block_device)
     , m_block_device(static_cast<BlockDevice&>(block_device))
@@ -20,18 +44,451 @@ AsyncBlockDeviceRequest::AsyncBlockDeviceRequest(Device& block_device, RequestTy
 {
 }
 
+AsyncBlockDeviceRequest::AsyncBlockDeviceRequest(Device& block_device, RequestType request_type, u64 block_index, u32 block_count, Vector<BlockIOSegment>&& segments)
+    : AsyncDeviceRequest(block_device)
+    , m_block_device(static_cast<BlockDevice&>(block_device))
+    , m_request_type(request_type)
+    , m_block_index(block_index)
+    , m_block_count(block_count)
+    , m_buffer(UserOrKernelBuffer::for_kernel_buffer(nullptr))
+    , m_buffer_size(block_count * m_block_device.block_size())
+    , m_segments(move(segments))
+{
+}
+
+RefPtr<Memory::PhysicalPage> AsyncBlockDeviceRequest::kernel_page_containing(VirtualAddress vaddr)
+{
+    auto* region = MM.kernel_region_from_vaddr(vaddr);
+    if (!region)
+        return {};
+    auto page = region->physical_page_slot(region->page_index_from_address(vaddr));
+    // Lazily committed pages are still shared placeholders, so a device must not write to them.
+    if (!page || page->is_shared_zero_page() || page->is_lazy_committed_page())
+        return {};
+    return page;
+}
+
+bool AsyncBlockDeviceRequest::write_data(size_t offset, u8 const* data, size_t size)
+{
+    if (!has_segments()) {
+        auto destination = m_buffer.offset(offset);
+        return write_to_buffer(destination, data, size);
+    }
+    return for_each_segment_range(offset, size, [&](BlockIOSegment const& segment, size_t offset_in_page, size_t chunk) {
+        Memory::ScopedQuickMap mapping(*segment.page);
+        memcpy(mapping.data() + offset_in_page, data, chunk);
+        data += chunk;
+        return true;
+    });
+}
+
+bool AsyncBlockDeviceRequest::read_data(size_t offset, u8* data, size_t size)
+{
+    if (!has_segments())
+        return read_from_buffer(m_buffer.offset(offset), data, size);
+    return for_each_segment_range(offset, size, [&](BlockIOSegment const& segment, size_t offset_in_page, size_t chunk) {
+        Memory::ScopedQuickMap mapping(*segment.page);
+        memcpy(data, mapping.data() + offset_in_page, chunk);
+        data += chunk;
+        return true;
+    });
+}
+
+bool AsyncBlockDeviceRequest::append_segments(Vector<BlockIOSegment>& segments) const
+{
+    if (has_segments()) {
+        segments.extend(m_segments);
+        return true;
+    }
+    if (!m_buffer.is_kernel_buffer())
+        return false;
+    return BlockDevice::append_kernel_segments(segments, VirtualAddress(m_buffer.user_or_kernel_ptr()), m_block_count * m_block_device.block_size());
+}
+
 void AsyncBlockDeviceRequest::start()
 {
+    // Merged requests are carried out by their carrier and only wait for it to complete them.
+    if (m_is_merged)
+        return;
     m_block_device.start_request(*this);
 }
 
+void AsyncBlockDeviceRequest::complete_merged_requests()
+{
+    auto result = get_request_result();
+    if (!m_bounce_buffer) {
+        for (auto& request : m_merged_requests)
+            request->complete(result);
+        m_merged_requests.clear();
+        return;
+    }
+    auto* data = m_bounce_buffer->data();
+    for (auto& request : m_merged_requests) {
+        auto request_result = result;
+        size_t offset = (request->block_index() - m_block_index) * m_block_device.block_size();
+        size_t size = request->block_count() * m_block_device.block_size();
+        if (result == Success && m_request_type == Read && !request->write_to_buffer(request->buffer(), data + offset, size))
+            request_result = MemoryFault;
+        request->complete(request_result);
+    }
+    m_merged_requests.clear();
+}
+
 BlockDevice::~BlockDevice()
 {
 }
 
+size_t BlockDevice::queue_depth() const
+{
+    if (bypasses_request_queue())
+        return max_queue_depth();
+    ScopedSpinLock lock(m_queue_lock);
+    return m_queue_depth.value_or(max_queue_depth());
+}
+
+KResult BlockDevice::set_queue_depth(size_t depth)
+{
+    if (bypasses_request_queue())
+        return ENOTSUP;
+    if (depth == 0 || depth > max_queue_depth())
+        return EINVAL;
+    {
+        ScopedSpinLock lock(m_queue_lock);
+        m_queue_depth = depth;
+    }
+    dispatch_pending_requests();
+    return KSuccess;
+}
+
+BlockDevice::IOScheduler BlockDevice::io_scheduler() const
+{
+    if (bypasses_request_queue())
+        return IOScheduler::None;
+    ScopedSpinLock lock(m_queue_lock);
+    if (m_io_scheduler.has_value())
+        return m_io_scheduler.value();
+    return is_rotational() ? IOScheduler::Elevator : IOScheduler::None;
+}
+
+KResult BlockDevice::set_io_scheduler(IOScheduler scheduler)
+{
+    if (bypasses_request_queue()) {
+        if (scheduler != IOScheduler::None)
+            return ENOTSUP;
+        return KSuccess;
+    }
+    ScopedSpinLock lock(m_queue_lock);
+    m_io_scheduler = scheduler;
+    return KSuccess;
+}
+
+BlockDevice::RequestQueueStatistics BlockDevice::queue_statistics() const
+{
+    RequestQueueStatistics statistics;
+    if (bypasses_request_queue()) {
+        statistics.submitted = m_bypass_submitted.load(Base::MemoryOrder::memory_order_relaxed);
+        statistics.completed = m_bypass_completed.load(Base::MemoryOrder::memory_order_relaxed);
+        statistics.in_flight = m_bypass_in_flight.load(Base::MemoryOrder::memory_order_relaxed);
+        statistics.max_in_flight = m_bypass_max_in_flight.load(Base::MemoryOrder::memory_order_relaxed);
+        statistics.total_latency_us = m_bypass_total_latency_us.load(Base::MemoryOrder::memory_order_relaxed);
+        statistics.max_latency_us = m_bypass_max_latency_us.load(Base::MemoryOrder::memory_order_relaxed);
+    } else {
+        ScopedSpinLock lock(m_queue_lock);
+        statistics = m_statistics;
+    }
+    for (size_t type = 0; type < AsyncBlockDeviceRequest::request_type_count; ++type) {
+        auto& source = m_type_statistics[type];
+        auto& destination = statistics.by_type[type];
+        destination.completed = source.completed.load(Base::MemoryOrder::memory_order_relaxed);
+        destination.bytes = source.bytes.load(Base::MemoryOrder::memory_order_relaxed);
+        destination.merged = source.merged.load(Base::MemoryOrder::memory_order_relaxed);
+        destination.total_queue_time_us = source.total_queue_time_us.load(Base::MemoryOrder::memory_order_relaxed);
+        destination.total_service_time_us = source.total_service_time_us.load(Base::MemoryOrder::memory_order_relaxed);
+        destination.max_latency_us = source.max_latency_us.load(Base::MemoryOrder::memory_order_relaxed);
+        for (size_t bucket = 0; bucket < latency_histogram_buckets; ++bucket)
+            destination.latency_histogram[bucket] = source.latency_histogram[bucket].load(Base::MemoryOrder::memory_order_relaxed);
+    }
+    return statistics;
+}
+
+void BlockDevice::queue_request(NonnullRefPtr<AsyncDeviceRequest> request)
+{
+    auto& block_request = static_cast<AsyncBlockDeviceRequest&>(*request);
+    block_request.m_submitted_at = TimeManagement::the().monotonic_time();
+    if (bypasses_request_queue()) {
+        m_bypass_submitted.fetch_add(1, Base::MemoryOrder::memory_order_relaxed);
+        update_maximum(m_bypass_max_in_flight, m_bypass_in_flight.fetch_add(1, Base::MemoryOrder::memory_order_relaxed) + 1);
+        block_request.m_dispatched_at = block_request.m_submitted_at;
+        block_request.do_start();
+        return;
+    }
+    {
+        ScopedSpinLock lock(m_queue_lock);
+        m_pending_requests.append(block_request);
+        ++m_statistics.submitted;
+    }
+    dispatch_pending_requests();
+}
+
+Optional<size_t> BlockDevice::pick_in_sweep_order(Optional<AsyncBlockDeviceRequest::RequestType> type) const
+{
+    Optional<size_t> ahead;
+    Optional<size_t> lowest;
+    for (size_t i = 0; i < m_pending_requests.size(); ++i) {
+        auto& request = m_pending_requests[i];
+        if (type.has_value() && request->request_type() != type.value())
+            continue;
+        if (!lowest.has_value() || request->block_index() < m_pending_requests[lowest.value()]->block_index())
+            lowest = i;
+        if (request->block_index() >= m_sweep_position && (!ahead.has_value() || request->block_index() < m_pending_requests[ahead.value()]->block_index()))
+            ahead = i;
+    }
+    // C-LOOK: keep sweeping upwards, then jump back to the lowest pending block.
+    return ahead.has_value() ? ahead : lowest;
+}
+
+size_t BlockDevice::pick_next_request_index() const
+{
+    VERIFY(m_queue_lock.is_locked());
+    VERIFY(!m_pending_requests.is_empty());
+
+    auto scheduler = m_io_scheduler.value_or(is_rotational() ? IOScheduler::Elevator : IOScheduler::None);
+    switch (scheduler) {
+    case IOScheduler::None:
+        return 0;
+    case IOScheduler::Elevator:
+        return pick_in_sweep_order({}).value();
+    case IOScheduler::Deadline: {
+        auto now = TimeManagement::the().monotonic_time();
+        Optional<size_t> most_overdue;
+        i64 most_overdue_ms = 0;
+        for (size_t i = 0; i < m_pending_requests.size(); ++i) {
+            auto& request = m_pending_requests[i];
+            i64 deadline_ms = request->request_type() == AsyncBlockDeviceRequest::Read ? read_deadline_ms : write_deadline_ms;
+            i64 overdue_ms = (now - request->submitted_at()).to_milliseconds() - deadline_ms;
+            if (overdue_ms >= 0 && (!most_overdue.has_value() || overdue_ms > most_overdue_ms)) {
+                most_overdue = i;
+                most_overdue_ms = overdue_ms;
+            }
+        }
+        if (most_overdue.has_value())
+            return most_overdue.value();
+        if (auto read = pick_in_sweep_order(AsyncBlockDeviceRequest::Read); read.has_value())
+            return read.value();
+        return pick_in_sweep_order({}).value();
+    }
+    }
+    VERIFY_NOT_REACHED();
+}
+
+Vector<NonnullRefPtr<AsyncBlockDeviceRequest>> BlockDevice::take_mergeable_requests(AsyncBlockDeviceRequest const& request)
+{
+    VERIFY(m_queue_lock.is_locked());
+    Vector<NonnullRefPtr<AsyncBlockDeviceRequest>> merged;
+    if (request.request_type() == AsyncBlockDeviceRequest::Flush)
+        return merged;
+    u64 start = request.block_index();
+    u64 end = request.end_block_index();
+
+    bool found_adjacent = true;
+    while (found_adjacent) {
+        found_adjacent = false;
+        for (size_t i = 0; i < m_pending_requests.size(); ++i) {
+            auto& candidate = m_pending_requests[i];
+            if (candidate->request_type() != request.request_type())
+                continue;
+            if (end - start + candidate->block_count() > max_merged_block_count)
+                continue;
+            if (candidate->block_index() == end)
+                end = candidate->end_block_index();
+            else if (candidate->end_block_index() == start)
+                start = candidate->block_index();
+            else
+                continue;
+            merged.append(m_pending_requests.take(i));
+            found_adjacent = true;
+            break;
+        }
+    }
+    return merged;
+}
+
+RefPtr<AsyncBlockDeviceRequest> BlockDevice::try_create_carrier(Vector<NonnullRefPtr<AsyncBlockDeviceRequest>>& requests)
+{
+    quick_sort(requests, [](auto& a, auto& b) { return a->block_index() < b->block_index(); });
+    auto& first = requests.first();
+    u64 block_index = first->block_index();
+    u32 block_count = requests.last()->end_block_index() - block_index;
+    size_t size = block_count * block_size();
+
+    // Requests whose pages are known are chained together as they are; only user buffers need copying.
+    Vector<BlockIOSegment> segments;
+    bool can_chain_segments = true;
+    for (auto& request : requests) {
+        if (!request->append_segments(segments)) {
+            can_chain_segments = false;
+            break;
+        }
+    }
+    if (can_chain_segments) {
+        auto carrier = adopt_ref_if_nonnull(new (nothrow) AsyncBlockDeviceRequest(*this, first->request_type(), block_index, block_count, move(segments)));
+        if (carrier)
+            carrier->m_merged_requests = move(requests);
+        return carrier;
+    }
+
+    auto bounce_buffer = KBuffer::try_create_with_size(size, Memory::Region::Access::ReadWrite, "BlockDevice: Merged request");
+    if (!bounce_buffer)
+        return {};
+
+    if (first->request_type() == AsyncBlockDeviceRequest::Write) {
+        for (auto& request : requests) {
+            size_t offset = (request->block_index() - block_index) * block_size();
+            if (!request->read_from_buffer(request->buffer(), bounce_buffer->data() + offset, request->block_count() * block_size()))
+                return {};
+        }
+    }
+
+    auto carrier = adopt_ref_if_nonnull(new (nothrow) AsyncBlockDeviceRequest(*this, first->request_type(), block_index, block_count, UserOrKernelBuffer::for_kernel_buffer(bounce_buffer->data()), size));
+    if (!carrier)
+        return {};
+    carrier->m_bounce_buffer = move(bounce_buffer);
+    carrier->m_merged_requests = move(requests);
+    return carrier;
+}
+
+void BlockDevice::dispatch_pending_requests()
+{
+    for (;;) {
+        ScopedSpinLock lock(m_queue_lock);
+        if (m_in_flight_requests.size() >= m_queue_depth.value_or(max_queue_depth()) || m_pending_requests.is_empty())
+            return;
+
+        auto request = m_pending_requests.take(pick_next_request_index());
+        auto merged = take_mergeable_requests(*request);
+        auto now = TimeManagement::the().monotonic_time();
+        request->m_dispatched_at = now;
+        m_sweep_position = request->end_block_index();
+        ++m_statistics.in_flight;
+        m_statistics.max_in_flight = max(m_statistics.max_in_flight, m_statistics.in_flight);
+
+        if (merged.is_empty()) {
+            m_in_flight_requests.append(request);
+            request->do_start(move(lock));
+            continue;
+        }
+
+        lock.unlock();
+        merged.append(request);
+        auto carrier = try_create_carrier(merged);
+        if (!carrier) {
+            // Put the neighbours back and carry out the chosen request on its own.
+            lock.lock();
+            for (auto& other : merged) {
+                if (other.ptr() != request.ptr())
+                    m_pending_requests.prepend(move(other));
+            }
+            m_in_flight_requests.append(request);
+            request->do_start(move(lock));
+            continue;
+        }
+
+        carrier->m_dispatched_at = now;
+        m_type_statistics[carrier->request_type()].merged.fetch_add(carrier->m_merged_requests.size() - 1, Base::MemoryOrder::memory_order_relaxed);
+        for (auto& merged_request : carrier->m_merged_requests) {
+            merged_request->m_is_merged = true;
+            merged_request->m_dispatched_at = now;
+            ScopedSpinLock start_lock(m_queue_lock);
+            merged_request->do_start(move(start_lock));
+        }
+
+        lock.lock();
+        m_statistics.merged += carrier->m_merged_requests.size() - 1;
+        m_in_flight_requests.append(*carrier);
+        carrier->do_start(move(lock));
+    }
+}
+
+void BlockDevice::record_completion(AsyncBlockDeviceRequest const& request)
+{
+    VERIFY(m_queue_lock.is_locked());
+    u64 latency_us = (TimeManagement::the().monotonic_time() - request.submitted_at()).to_microseconds();
+    ++m_statistics.completed;
+    m_statistics.total_latency_us += latency_us;
+    m_statistics.max_latency_us = max(m_statistics.max_latency_us, latency_us);
+}
+
+void BlockDevice::record_type_statistics(AsyncBlockDeviceRequest const& request)
+{
+    auto now = TimeManagement::the().monotonic_time();
+    u64 latency_us = (now - request.submitted_at()).to_microseconds();
+    auto& statistics = m_type_statistics[request.request_type()];
+    statistics.completed.fetch_add(1, Base::MemoryOrder::memory_order_relaxed);
+    statistics.bytes.fetch_add((u64)request.block_count() * block_size(), Base::MemoryOrder::memory_order_relaxed);
+    statistics.total_queue_time_us.fetch_add((request.dispatched_at() - request.submitted_at()).to_microseconds(), Base::MemoryOrder::memory_order_relaxed);
+    statistics.total_service_time_us.fetch_add((now - request.dispatched_at()).to_microseconds(), Base::MemoryOrder::memory_order_relaxed);
+    statistics.latency_histogram[latency_histogram_bucket(latency_us)].fetch_add(1, Base::MemoryOrder::memory_order_relaxed);
+    update_maximum(statistics.max_latency_us, latency_us);
+}
+
+void BlockDevice::process_next_queued_request(Badge<AsyncDeviceRequest>, const AsyncDeviceRequest& completed_request)
+{
+    auto& request = static_cast<AsyncBlockDeviceRequest const&>(completed_request);
+    if (bypasses_request_queue()) {
+        u64 latency_us = (TimeManagement::the().monotonic_time() - request.submitted_at()).to_microseconds();
+        m_bypass_total_latency_us.fetch_add(latency_us, Base::MemoryOrder::memory_order_relaxed);
+        update_maximum(m_bypass_max_latency_us, latency_us);
+        m_bypass_completed.fetch_add(1, Base::MemoryOrder::memory_order_relaxed);
+        m_bypass_in_flight.fetch_sub(1, Base::MemoryOrder::memory_order_relaxed);
+        record_type_statistics(request);
+        evaluate_block_conditions();
+        return;
+    }
+    if (request.m_is_merged) {
+        {
+            ScopedSpinLock lock(m_queue_lock);
+            record_completion(request);
+        }
+        record_type_statistics(request);
+        evaluate_block_conditions();
+        return;
+    }
+
+    RefPtr<AsyncBlockDeviceRequest> finished_request;
+    {
+        ScopedSpinLock lock(m_queue_lock);
+        for (size_t i = 0; i < m_in_flight_requests.size(); ++i) {
+            if (m_in_flight_requests[i].ptr() == &request) {
+                finished_request = m_in_flight_requests.take(i);
+                break;
+            }
+        }
+        VERIFY(finished_request);
+        --m_statistics.in_flight;
+        if (!request.is_carrier())
+            record_completion(request);
+    }
+    if (!request.is_carrier())
+        record_type_statistics(request);
+
+    if (finished_request->is_carrier())
+        finished_request->complete_merged_requests();
+
+    dispatch_pending_requests();
+    evaluate_block_conditions();
+}
+
+KResult BlockDevice::flush()
+{
+    if (!supports_flush())
+        return KSuccess;
+    auto request = make_request<AsyncBlockDeviceRequest>(AsyncBlockDeviceRequest::Flush, 0, 0, UserOrKernelBuffer::for_kernel_buffer(nullptr), 0);
+    return wait_for_request(*request);
+}
+
 bool BlockDevice::read_block(u64 index, UserOrKernelBuffer& buffer)
 {
-    auto read_request = make_request<AsyncBlockDeviceRequest>(AsyncBlockDeviceRequest::Read, index, 1, buffer, 512);
+    auto read_request = make_request<AsyncBlockDeviceRequest>(AsyncBlockDeviceRequest::Read, index, 1, buffer, block_size());
     switch (read_request->wait().request_result()) {
     case AsyncDeviceRequest::Success:
         return true;
@@ -52,7 +509,7 @@ bool BlockDevice::read_block(u64 index, UserOrKernelBuffer& buffer)
 
 bool BlockDevice::write_block(u64 index, const UserOrKernelBuffer& buffer)
 {
-    auto write_request = make_request<AsyncBlockDeviceRequest>(AsyncBlockDeviceRequest::Write, index, 1, buffer, 512);
+    auto write_request = make_request<AsyncBlockDeviceRequest>(AsyncBlockDeviceRequest::Write, index, 1, buffer, block_size());
     switch (write_request->wait().request_result()) {
     case AsyncDeviceRequest::Success:
         return true;
@@ -71,4 +528,50 @@ bool BlockDevice::write_block(u64 index, const UserOrKernelBuffer& buffer)
     return false;
 }
 
+bool BlockDevice::append_kernel_segments(Vector<BlockIOSegment>& segments, VirtualAddress vaddr, size_t size)
+{
+    while (size) {
+        auto page = AsyncBlockDeviceRequest::kernel_page_containing(vaddr);
+        if (!page)
+            return false;
+        size_t offset_in_page = vaddr.get() % PAGE_SIZE;
+        size_t chunk = min(size, PAGE_SIZE - offset_in_page);
+        segments.append({ page.release_nonnull(), offset_in_page, chunk });
+        vaddr = vaddr.offset(chunk);
+        size -= chunk;
+    }
+    return true;
+}
+
+KResult BlockDevice::wait_for_request(AsyncBlockDeviceRequest& request)
+{
+    auto result = request.wait();
+    if (result.wait_result().was_interrupted())
+        return EINTR;
+    switch (result.request_result()) {
+    case AsyncDeviceRequest::Success:
+        return KSuccess;
+    case AsyncDeviceRequest::MemoryFault:
+        return EFAULT;
+    case AsyncDeviceRequest::Failure:
+    case AsyncDeviceRequest::Cancelled:
+        return EIO;
+    default:
+        VERIFY_NOT_REACHED();
+    }
+}
+
+KResult BlockDevice::transfer_segments(AsyncBlockDeviceRequest::RequestType type, u64 block_index, Vector<BlockIOSegment>&& segments)
+{
+    size_t size = 0;
+    for (auto& segment : segments) {
+        VERIFY(segment.offset + segment.length <= PAGE_SIZE);
+        size += segment.length;
+    }
+    if (size == 0 || size % block_size() != 0)
+        return EINVAL;
+    auto request = make_request<AsyncBlockDeviceRequest>(type, block_index, size / block_size(), move(segments));
+    return wait_for_request(*request);
+}
+
 }
@@ -7,28 +7,89 @@
 #pragma once
 
 // includes
+#include <base/Array.h>
+#include <base/Atomic.h>
+#include <base/Optional.h>
+#include <base/Time.h>
+#include <base/Vector.h>
 #include <kernel/devices/Device.h>
+#include <kernel/KBuffer.h>
+#include <kernel/memory/PhysicalPage.h>
 
 namespace Kernel {
 
 class BlockDevice;
 
+// A piece of a request's data that lies within a single physical page.
+struct BlockIOSegment {
+    NonnullRefPtr<Memory::PhysicalPage> page;
+    size_t offset { 0 };
+    size_t length { 0 };
+};
+
 class AsyncBlockDeviceRequest final : public AsyncDeviceRequest {
+    friend class BlockDevice;
+
 public:
     enum RequestType {
         Read,
-        Write
+        Write,
+        Flush,
     };
+    static constexpr size_t request_type_count = 3;
     AsyncBlockDeviceRequest(Device& block_device, RequestType request_type,
         u64 block_index, u32 block_count, const UserOrKernelBuffer& buffer, size_t buffer_size);
+    AsyncBlockDeviceRequest(Device& block_device, RequestType request_type,
+        u64 block_index, u32 block_count, Vector<BlockIOSegment>&& segments);
 
     RequestType request_type() const { return m_request_type; }
     u64 block_index() const { return m_block_index; }
     u32 block_count() const { return m_block_count; }
+    u64 end_block_index() const { return m_block_index + m_block_count; }
     UserOrKernelBuffer& buffer() { return m_buffer; }
     const UserOrKernelBuffer& buffer() const { return m_buffer; }
     size_t buffer_size() const { return m_buffer_size; }
 
+    // Segmented requests have no virtual buffer; their pages are handed to the device as they are.
+    bool has_segments() const { return !m_segments.is_empty(); }
+    Vector<BlockIOSegment> const& segments() const { return m_segments; }
+
+    // Copy between the request's data and a driver's bounce buffer, whatever form the data takes.
+    [[nodiscard]] bool write_data(size_t offset, u8 const* data, size_t size);
+    [[nodiscard]] bool read_data(size_t offset, u8* data, size_t size);
+
+    // Calls callback(PhysicalAddress, size_t) for every physically contiguous piece of the given
+    // range, so that drivers can DMA into it directly. Returns false if the data has no stable
+    // physical address (a user buffer), in which case the driver has to bounce.
+    template<typename Callback>
+    bool for_each_physical_range(size_t offset, size_t size, Callback callback) const
+    {
+        if (has_segments()) {
+            return for_each_segment_range(offset, size, [&](BlockIOSegment const& segment, size_t offset_in_page, size_t chunk) {
+                return callback(segment.page->paddr().offset(offset_in_page), chunk);
+            });
+        }
+        if (!m_buffer.is_kernel_buffer())
+            return false;
+        auto vaddr = VirtualAddress(m_buffer.user_or_kernel_ptr()).offset(offset);
+        while (size) {
+            auto page = kernel_page_containing(vaddr);
+            if (!page)
+                return false;
+            size_t chunk = min(size, PAGE_SIZE - vaddr.get() % PAGE_SIZE);
+            if (!callback(page->paddr().offset(vaddr.get() % PAGE_SIZE), chunk))
+                return false;
+            vaddr = vaddr.offset(chunk);
+            size -= chunk;
+        }
+        return true;
+    }
+
+    static RefPtr<Memory::PhysicalPage> kernel_page_containing(VirtualAddress);
+
+    Time const& submitted_at() const { return m_submitted_at; }
+    Time const& dispatched_at() const { return m_dispatched_at; }
+
     virtual void start() override;
     virtual StringView name() const override
     {
@@ -37,22 +98,85 @@ public:
             return "BlockDeviceRequest (read)"sv;
         case Write:
             return "BlockDeviceRequest (write)"sv;
+        case Flush:
+            return "BlockDeviceRequest (flush)"sv;
         default:
             VERIFY_NOT_REACHED();
         }
     }
 
 private:
+    bool is_carrier() const { return !m_merged_requests.is_empty(); }
+
+    template<typename Callback>
+    bool for_each_segment_range(size_t offset, size_t size, Callback callback) const
+    {
+        for (auto& segment : m_segments) {
+            if (!size)
+                break;
+            if (offset >= segment.length) {
+                offset -= segment.length;
+                continue;
+            }
+            size_t chunk = min(size, segment.length - offset);
+            if (!callback(segment, segment.offset + offset, chunk))
+                return false;
+            offset = 0;
+            size -= chunk;
+        }
+        return size == 0;
+    }
+
+    void complete_merged_requests();
+    bool append_segments(Vector<BlockIOSegment>&) const;
+
     BlockDevice& m_block_device;
     const RequestType m_request_type;
     const u64 m_block_index;
     const u32 m_block_count;
     UserOrKernelBuffer m_buffer;
     const size_t m_buffer_size;
+    Vector<BlockIOSegment> m_segments;
+
+    Time m_submitted_at;
+    Time m_dispatched_at;
+    bool m_is_merged { false };
+    OwnPtr<KBuffer> m_bounce_buffer;
+    Vector<NonnullRefPtr<AsyncBlockDeviceRequest>> m_merged_requests;
 };
 
 class BlockDevice : public Device {
 public:
+    enum class IOScheduler {
+        None,
+        Deadline,
+        Elevator,
+    };
+
+    // Bucket i counts requests that took [2^(i-1), 2^i) microseconds; the last bucket also takes everything slower.
+    static constexpr size_t latency_histogram_buckets = 24;
+
+    struct RequestTypeStatistics {
+        u64 completed { 0 };
+        u64 bytes { 0 };
+        u64 merged { 0 };
+        u64 total_queue_time_us { 0 };
+        u64 total_service_time_us { 0 };
+        u64 max_latency_us { 0 };
+        Array<u64, latency_histogram_buckets> latency_histogram {};
+    };
+
+    struct RequestQueueStatistics {
+        u64 submitted { 0 };
+        u64 completed { 0 };
+        u64 merged { 0 };
+        u32 in_flight { 0 };
+        u32 max_in_flight { 0 };
+        u64 total_latency_us { 0 };
+        u64 max_latency_us { 0 };
+        Array<RequestTypeStatistics, AsyncBlockDeviceRequest::request_type_count> by_type {};
+    };
+
     virtual ~BlockDevice() override;
 
     size_t block_size() const { return m_block_size; }
@@ -61,8 +185,42 @@ public:
     bool read_block(u64 index, UserOrKernelBuffer&);
     bool write_block(u64 index, const UserOrKernelBuffer&);
 
+    // Carries out one request over a list of page segments, whose lengths have to add up to whole blocks.
+    KResult transfer_segments(AsyncBlockDeviceRequest::RequestType, u64 block_index, Vector<BlockIOSegment>&&);
+    static bool append_kernel_segments(Vector<BlockIOSegment>&, VirtualAddress, size_t size);
+
     virtual void start_request(AsyncBlockDeviceRequest&) = 0;
 
+    virtual size_t max_queue_depth() const { return 1; }
+    virtual bool is_rotational() const { return false; }
+
+    // Drivers that accept Flush requests (to empty a volatile write cache) opt in here.
+    virtual bool supports_flush() const { return false; }
+    KResult flush();
+
+    // Drivers with deep per-CPU hardware queues skip the shared request queue (and with it
+    // merging and scheduling), so that submitting never takes a lock other processors use.
+    virtual bool bypasses_request_queue() const { return false; }
+
+    // Drivers that can reap completions without waiting for an interrupt opt in here.
+    virtual bool supports_polling() const { return false; }
+    virtual bool is_polling_enabled() const { return false; }
+    virtual KResult set_polling_enabled(bool) { return ENOTSUP; }
+
+    // Devices that emulate media (such as RAM disks) may add a configurable delay to every request.
+    virtual Optional<u32> injected_latency_us() const { return {}; }
+    virtual KResult set_injected_latency_us(u32) { return ENOTSUP; }
+
+    size_t queue_depth() const;
+    KResult set_queue_depth(size_t);
+
+    IOScheduler io_scheduler() const;
+    KResult set_io_scheduler(IOScheduler);
+
+    RequestQueueStatistics queue_statistics() const;
+
+    virtual void process_next_queued_request(Badge<AsyncDeviceRequest>, const AsyncDeviceRequest&) override;
+
 protected:
     BlockDevice(unsigned major, unsigned minor, size_t block_size = PAGE_SIZE)
         : Device(major, minor)
@@ -70,10 +228,50 @@ protected:
     {
     }
 
+    virtual void queue_request(NonnullRefPtr<AsyncDeviceRequest>) override;
+
+    static KResult wait_for_request(AsyncBlockDeviceRequest&);
+
 private:
     virtual bool is_block_device() const final { return true; }
 
+    void dispatch_pending_requests();
+    size_t pick_next_request_index() const;
+    Optional<size_t> pick_in_sweep_order(Optional<AsyncBlockDeviceRequest::RequestType>) const;
+    Vector<NonnullRefPtr<AsyncBlockDeviceRequest>> take_mergeable_requests(AsyncBlockDeviceRequest const&);
+    RefPtr<AsyncBlockDeviceRequest> try_create_carrier(Vector<NonnullRefPtr<AsyncBlockDeviceRequest>>&);
+    void record_completion(AsyncBlockDeviceRequest const&);
+    void record_type_statistics(AsyncBlockDeviceRequest const&);
+
+    // Per-type counters are updated without m_queue_lock, so that requests bypassing the queue can keep them too.
+    struct AtomicRequestTypeStatistics {
+        Atomic<u64> completed { 0 };
+        Atomic<u64> bytes { 0 };
+        Atomic<u64> merged { 0 };
+        Atomic<u64> total_queue_time_us { 0 };
+        Atomic<u64> total_service_time_us { 0 };
+        Atomic<u64> max_latency_us { 0 };
+        Array<Atomic<u64>, latency_histogram_buckets> latency_histogram;
+    };
+
     size_t m_block_size { 0 };
+
+    mutable SpinLock<u8> m_queue_lock;
+    Vector<NonnullRefPtr<AsyncBlockDeviceRequest>> m_pending_requests;
+    Vector<NonnullRefPtr<AsyncBlockDeviceRequest>> m_in_flight_requests;
+    // Until the sysfs knob sets it, the queue runs as deep as the driver allows.
+    Optional<size_t> m_queue_depth;
+    Optional<IOScheduler> m_io_scheduler;
+    u64 m_sweep_position { 0 };
+    RequestQueueStatistics m_statistics;
+
+    Atomic<u64> m_bypass_submitted { 0 };
+    Atomic<u64> m_bypass_completed { 0 };
+    Atomic<u64> m_bypass_in_flight { 0 };
+    Atomic<u64> m_bypass_max_in_flight { 0 };
+    Atomic<u64> m_bypass_total_latency_us { 0 };
+    Atomic<u64> m_bypass_max_latency_us { 0 };
+    Array<AtomicRequestTypeStatistics, AsyncBlockDeviceRequest::request_type_count> m_type_statistics;
 };
 
 }
@@ -61,6 +61,15 @@ String Device::absolute_path(const FileDescription&) const
     return absolute_path();
 }
 
+void Device::queue_request(NonnullRefPtr<AsyncDeviceRequest> request)
+{
+    ScopedSpinLock lock(m_requests_lock);
+    bool was_empty = m_requests.is_empty();
+    m_requests.append(request);
+    if (was_empty)
+        request->do_start(move(lock));
+}
+
 void Device::process_next_queued_request(Badge<AsyncDeviceRequest>, const AsyncDeviceRequest& completed_request)
 {
     ScopedSpinLock lock(m_requests_lock);
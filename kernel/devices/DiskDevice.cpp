@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <kernel/devices/DiskDevice.h>
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/KBuffer.h>
+#include <kernel/Process.h>
+
+namespace Kernel {
+
+static constexpr size_t max_request_size = 1 * MiB;
+
+DiskDevice::~DiskDevice()
+{
+}
+
+unsigned DiskDevice::allocate_minor_number()
+{
+    static Atomic<unsigned> s_next_minor { 0 };
+    return s_next_minor.fetch_add(1);
+}
+
+u32 DiskDevice::max_blocks_per_request() const
+{
+    return max(max_request_size / block_size(), (size_t)1);
+}
+
+KResult DiskDevice::transfer_blocks(AsyncBlockDeviceRequest::RequestType type, u64 block_index, u32 block_count, UserOrKernelBuffer& buffer)
+{
+    auto request = make_request<AsyncBlockDeviceRequest>(type, block_index, block_count, buffer, block_count * block_size());
+    return wait_for_request(*request);
+}
+
+bool DiskDevice::pin_user_pages(Vector<BlockIOSegment>& segments, VirtualAddress vaddr, size_t size, AsyncBlockDeviceRequest::RequestType type)
+{
+    auto& space = Process::current()->address_space();
+    while (size) {
+        auto* region = space.find_region_containing({ vaddr.page_base(), PAGE_SIZE });
+        if (!region || !region->vmobject().is_anonymous())
+            return false;
+        if (type == AsyncBlockDeviceRequest::Read ? !region->is_writable() : !region->is_readable())
+            return false;
+        size_t page_index = region->page_index_from_address(vaddr);
+        RefPtr<Memory::PhysicalPage> page = region->physical_page_slot(page_index);
+        if (!page || page->is_shared_zero_page() || page->is_lazy_committed_page())
+            return false;
+        // A read must not land in a page that is still shared copy-on-write with another address space.
+        if (type == AsyncBlockDeviceRequest::Read && region->should_cow(page_index))
+            return false;
+        size_t offset_in_page = vaddr.get() % PAGE_SIZE;
+        size_t chunk = min(size, PAGE_SIZE - offset_in_page);
+        segments.append({ page.release_nonnull(), offset_in_page, chunk });
+        vaddr = vaddr.offset(chunk);
+        size -= chunk;
+    }
+    return true;
+}
+
+KResult DiskDevice::transfer_whole_blocks(FileDescription& description, AsyncBlockDeviceRequest::RequestType type, u64 block_index, u32 block_count, UserOrKernelBuffer& buffer)
+{
+    // O_DIRECT transfers on block-aligned user buffers go straight to the caller's pages. Pages that
+    // are not resident yet (or are shared) make the request fall back to the buffered path.
+    if (description.is_direct() && !buffer.is_kernel_buffer() && (FlatPtr)buffer.user_or_kernel_ptr() % block_size() == 0) {
+        Vector<BlockIOSegment> segments;
+        if (pin_user_pages(segments, VirtualAddress(buffer.user_or_kernel_ptr()), block_count * block_size(), type))
+            return transfer_segments(type, block_index, move(segments));
+    }
+    return transfer_blocks(type, block_index, block_count, buffer);
+}
+
+KResultOr<size_t> DiskDevice::read(FileDescription& description, u64 offset, UserOrKernelBuffer& buffer, size_t length)
+{
+    u64 capacity = max_addressable_block() * block_size();
+    if (offset >= capacity)
+        return 0;
+    length = min((u64)length, capacity - offset);
+
+    OwnPtr<KBuffer> bounce_buffer;
+    size_t nread = 0;
+    auto partial_or = [&](KResult error) -> KResultOr<size_t> {
+        if (nread)
+            return nread;
+        return error;
+    };
+    while (nread < length) {
+        u64 position = offset + nread;
+        u64 block_index = position / block_size();
+        size_t offset_in_block = position % block_size();
+        size_t remaining = length - nread;
+        auto destination = buffer.offset(nread);
+
+        // Whole blocks go straight into the caller's buffer.
+        if (offset_in_block == 0 && remaining >= block_size()) {
+            u32 block_count = min(remaining / block_size(), (size_t)max_blocks_per_request());
+            if (auto result = transfer_whole_blocks(description, AsyncBlockDeviceRequest::Read, block_index, block_count, destination); result.is_error())
+                return partial_or(result);
+            nread += block_count * block_size();
+            continue;
+        }
+
+        if (!bounce_buffer) {
+            bounce_buffer = KBuffer::try_create_with_size(block_size(), Memory::Region::Access::ReadWrite, "DiskDevice: Bounce buffer");
+            if (!bounce_buffer)
+                return partial_or(ENOMEM);
+        }
+        auto bounce = UserOrKernelBuffer::for_kernel_buffer(bounce_buffer->data());
+        if (auto result = transfer_blocks(AsyncBlockDeviceRequest::Read, block_index, 1, bounce); result.is_error())
+            return partial_or(result);
+        size_t chunk = min(remaining, block_size() - offset_in_block);
+        if (!destination.write(bounce_buffer->data() + offset_in_block, chunk))
+            return partial_or(EFAULT);
+        nread += chunk;
+    }
+    return nread;
+}
+
+KResultOr<size_t> DiskDevice::write(FileDescription& description, u64 offset, const UserOrKernelBuffer& buffer, size_t length)
+{
+    if (is_read_only())
+        return EROFS;
+    u64 capacity = max_addressable_block() * block_size();
+    if (offset >= capacity)
+        return ENOSPC;
+    length = min((u64)length, capacity - offset);
+
+    OwnPtr<KBuffer> bounce_buffer;
+    size_t nwritten = 0;
+    auto partial_or = [&](KResult error) -> KResultOr<size_t> {
+        if (nwritten)
+            return nwritten;
+        return error;
+    };
+    while (nwritten < length) {
+        u64 position = offset + nwritten;
+        u64 block_index = position / block_size();
+        size_t offset_in_block = position % block_size();
+        size_t remaining = length - nwritten;
+        auto source = buffer.offset(nwritten);
+
+        if (offset_in_block == 0 && remaining >= block_size()) {
+            u32 block_count = min(remaining / block_size(), (size_t)max_blocks_per_request());
+            if (auto result = transfer_whole_blocks(description, AsyncBlockDeviceRequest::Write, block_index, block_count, source); result.is_error())
+                return partial_or(result);
+            nwritten += block_count * block_size();
+            continue;
+        }
+
+        // A partial block has to be read, patched and written back.
+        if (!bounce_buffer) {
+            bounce_buffer = KBuffer::try_create_with_size(block_size(), Memory::Region::Access::ReadWrite, "DiskDevice: Bounce buffer");
+            if (!bounce_buffer)
+                return partial_or(ENOMEM);
+        }
+        auto bounce = UserOrKernelBuffer::for_kernel_buffer(bounce_buffer->data());
+        if (auto result = transfer_blocks(AsyncBlockDeviceRequest::Read, block_index, 1, bounce); result.is_error())
+            return partial_or(result);
+        size_t chunk = min(remaining, block_size() - offset_in_block);
+        if (!source.read(bounce_buffer->data() + offset_in_block, chunk))
+            return partial_or(EFAULT);
+        if (auto result = transfer_blocks(AsyncBlockDeviceRequest::Write, block_index, 1, bounce); result.is_error())
+            return partial_or(result);
+        nwritten += chunk;
+    }
+    return nwritten;
+}
+
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <kernel/devices/BlockDevice.h>
+
+namespace Kernel {
+
+class DiskDevice : public BlockDevice {
+public:
+    virtual ~DiskDevice() override;
+
+    virtual u64 max_addressable_block() const = 0;
+    virtual bool is_read_only() const { return false; }
+
+    KResult transfer_blocks(AsyncBlockDeviceRequest::RequestType, u64 block_index, u32 block_count, UserOrKernelBuffer&);
+
+    // ^File
+    virtual bool can_read(const FileDescription&, size_t) const override { return true; }
+    virtual bool can_write(const FileDescription&, size_t) const override { return true; }
+    virtual KResultOr<size_t> read(FileDescription&, u64, UserOrKernelBuffer&, size_t) override;
+    virtual KResultOr<size_t> write(FileDescription&, u64, const UserOrKernelBuffer&, size_t) override;
+
+    // ^Device
+    virtual mode_t required_mode() const override { return 0600; }
+    virtual bool is_disk_device() const override final { return true; }
+
+protected:
+    // Disk drivers share one major number, so minors are handed out here.
+    static unsigned allocate_minor_number();
+
+    DiskDevice(unsigned major, unsigned minor, size_t block_size)
+        : BlockDevice(major, minor, block_size)
+    {
+    }
+
+private:
+    u32 max_blocks_per_request() const;
+    KResult transfer_whole_blocks(FileDescription&, AsyncBlockDeviceRequest::RequestType, u64 block_index, u32 block_count, UserOrKernelBuffer&);
+    static bool pin_user_pages(Vector<BlockIOSegment>&, VirtualAddress, size_t size, AsyncBlockDeviceRequest::RequestType);
+};
+
+}
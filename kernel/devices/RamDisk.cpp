@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Singleton.h>
+#include <kernel/CommandLine.h>
+#include <kernel/devices/RamDisk.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/Sections.h>
+#include <kernel/StdLib.h>
+#include <kernel/time/TimeManagement.h>
+#include <kernel/TimerQueue.h>
+#include <kernel/WorkQueue.h>
+
+namespace Kernel {
+
+static constexpr u32 max_latency_us = 1'000'000;
+
+static Singleton<Vector<NonnullRefPtr<RamDisk>>> s_ram_disks;
+static Atomic<unsigned> s_next_index;
+
+static Optional<u64> parse_size(StringView value)
+{
+    u64 multiplier = 1;
+    if (value.ends_with('K'))
+        multiplier = KiB;
+    else if (value.ends_with('M'))
+        multiplier = MiB;
+    else if (value.ends_with('G'))
+        multiplier = GiB;
+    if (multiplier != 1)
+        value = value.substring_view(0, value.length() - 1);
+    auto number = value.to_uint<u64>();
+    if (!number.has_value())
+        return {};
+    return number.value() * multiplier;
+}
+
+// ramdisk=<size>[K|M|G], optionally with ramdisk_block_size=<bytes> and ramdisk_latency_us=<us>.
+UNMAP_AFTER_INIT void RamDisk::initialize_from_command_line()
+{
+    auto size_argument = kernel_command_line().lookup("ramdisk"sv);
+    if (!size_argument.has_value())
+        return;
+    auto size = parse_size(size_argument.value());
+    auto block_size = kernel_command_line().lookup("ramdisk_block_size"sv).value_or("512"sv).to_uint();
+    auto latency_us = kernel_command_line().lookup("ramdisk_latency_us"sv).value_or("0"sv).to_uint();
+    if (!size.has_value() || !block_size.has_value() || !latency_us.has_value()) {
+        dmesgln("RamDisk: Invalid ramdisk arguments on the command line");
+        return;
+    }
+    auto ram_disk = try_create(size.value(), block_size.value(), latency_us.value());
+    if (!ram_disk) {
+        dmesgln("RamDisk: Failed to create a {} byte RAM disk with {} byte blocks", size.value(), block_size.value());
+        return;
+    }
+    s_ram_disks->append(ram_disk.release_nonnull());
+}
+
+RefPtr<RamDisk> RamDisk::try_create(u64 size, size_t block_size, u32 latency_us)
+{
+    if (block_size < 512 || block_size > PAGE_SIZE || !is_power_of_two(block_size) || size < block_size || latency_us > max_latency_us)
+        return {};
+    // Backing pages are committed up front, so that no page faults show up in measurements.
+    auto storage = MM.allocate_kernel_region(Memory::page_round_up(size), "RamDisk", Memory::Region::Access::ReadWrite, AllocationStrategy::AllocateNow);
+    if (!storage)
+        return {};
+    memset(storage->vaddr().as_ptr(), 0, storage->size());
+    return adopt_ref_if_nonnull(new (nothrow) RamDisk(storage.release_nonnull(), size / block_size, block_size, latency_us, s_next_index.fetch_add(1)));
+}
+
+RamDisk::RamDisk(NonnullOwnPtr<Memory::Region> storage, u64 block_count, size_t block_size, u32 latency_us, unsigned index)
+    : DiskDevice(3, allocate_minor_number(), block_size)
+    , m_storage(move(storage))
+    , m_block_count(block_count)
+    , m_latency_us(latency_us)
+    , m_index(index)
+{
+    dmesgln("RamDisk: {} with {} blocks of {} bytes, {} us latency", device_name(), block_count, block_size, latency_us);
+}
+
+RamDisk::~RamDisk()
+{
+}
+
+String RamDisk::device_name() const
+{
+    return String::formatted("ram{}", m_index);
+}
+
+KResult RamDisk::set_injected_latency_us(u32 latency_us)
+{
+    if (latency_us > max_latency_us)
+        return EINVAL;
+    m_latency_us.store(latency_us, Base::MemoryOrder::memory_order_relaxed);
+    return KSuccess;
+}
+
+void RamDisk::start_request(AsyncBlockDeviceRequest& request)
+{
+    if (request.end_block_index() > m_block_count) {
+        request.complete(AsyncDeviceRequest::Failure);
+        return;
+    }
+
+    auto* data = m_storage->vaddr().offset(request.block_index() * block_size()).as_ptr();
+    size_t size = request.block_count() * block_size();
+    bool success = true;
+    if (request.request_type() == AsyncBlockDeviceRequest::Read)
+        success = request.write_data(0, data, size);
+    else if (request.request_type() == AsyncBlockDeviceRequest::Write)
+        success = request.read_data(0, data, size);
+    auto result = success ? AsyncDeviceRequest::Success : AsyncDeviceRequest::MemoryFault;
+
+    // Completing from the work queue keeps dispatching the next request from recursing into this one.
+    NonnullRefPtr<AsyncBlockDeviceRequest> request_reference = request;
+    auto complete = [request_reference, result]() {
+        request_reference->complete(result);
+    };
+    u32 latency_us = m_latency_us.load(Base::MemoryOrder::memory_order_relaxed);
+    if (latency_us == 0) {
+        g_io_work->queue(move(complete));
+        return;
+    }
+    auto latency_timer = adopt_ref_if_nonnull(new (nothrow) Timer);
+    if (!latency_timer) {
+        g_io_work->queue([request_reference = move(request_reference)]() {
+            request_reference->complete(AsyncDeviceRequest::Failure);
+        });
+        return;
+    }
+    latency_timer->setup(CLOCK_MONOTONIC, TimeManagement::the().monotonic_time() + Time::from_microseconds(latency_us), [complete = move(complete)]() mutable {
+        g_io_work->queue(move(complete));
+    });
+    TimerQueue::the().add_timer(latency_timer.release_nonnull());
+}
+
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <kernel/devices/DiskDevice.h>
+#include <kernel/memory/Region.h>
+
+namespace Kernel {
+
+// A disk backed by kernel memory, meant for measuring the block and filesystem layers without
+// hardware noise. An artificial per-request latency can be injected to model slower media.
+class RamDisk final : public DiskDevice {
+public:
+    static void initialize_from_command_line();
+    static RefPtr<RamDisk> try_create(u64 size, size_t block_size, u32 latency_us);
+    virtual ~RamDisk() override;
+
+    // ^DiskDevice
+    virtual u64 max_addressable_block() const override { return m_block_count; }
+
+    // ^BlockDevice
+    virtual void start_request(AsyncBlockDeviceRequest&) override;
+    virtual size_t max_queue_depth() const override { return 32; }
+    virtual bool supports_flush() const override { return true; }
+    virtual Optional<u32> injected_latency_us() const override { return m_latency_us.load(Base::MemoryOrder::memory_order_relaxed); }
+    virtual KResult set_injected_latency_us(u32) override;
+
+    // ^Device
+    virtual String device_name() const override;
+    virtual StringView class_name() const override { return "RamDisk"; }
+
+private:
+    RamDisk(NonnullOwnPtr<Memory::Region>, u64 block_count, size_t block_size, u32 latency_us, unsigned index);
+
+    NonnullOwnPtr<Memory::Region> m_storage;
+    u64 m_block_count { 0 };
+    Atomic<u32> m_latency_us { 0 };
+    unsigned m_index { 0 };
+};
+
+}
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/JsonObjectSerializer.h>
+#include <kernel/devices/SysFSBlockDevices.h>
+#include <kernel/KBufferBuilder.h>
+
+namespace Kernel {
+
+static StringView scheduler_name(BlockDevice::IOScheduler scheduler)
+{
+    switch (scheduler) {
+    case BlockDevice::IOScheduler::None:
+        return "none"sv;
+    case BlockDevice::IOScheduler::Deadline:
+        return "deadline"sv;
+    case BlockDevice::IOScheduler::Elevator:
+        return "elevator"sv;
+    }
+    VERIFY_NOT_REACHED();
+}
+
+static StringView request_type_name(AsyncBlockDeviceRequest::RequestType type)
+{
+    switch (type) {
+    case AsyncBlockDeviceRequest::Read:
+        return "reads"sv;
+    case AsyncBlockDeviceRequest::Write:
+        return "writes"sv;
+    case AsyncBlockDeviceRequest::Flush:
+        return "flushes"sv;
+    }
+    VERIFY_NOT_REACHED();
+}
+
+static StringView attribute_name(SysFSBlockDeviceAttribute::Type type)
+{
+    switch (type) {
+    case SysFSBlockDeviceAttribute::Type::QueueDepth:
+        return "queue_depth"sv;
+    case SysFSBlockDeviceAttribute::Type::Scheduler:
+        return "scheduler"sv;
+    case SysFSBlockDeviceAttribute::Type::Statistics:
+        return "statistics"sv;
+    case SysFSBlockDeviceAttribute::Type::Polling:
+        return "io_poll"sv;
+    case SysFSBlockDeviceAttribute::Type::InjectedLatency:
+        return "latency_us"sv;
+    }
+    VERIFY_NOT_REACHED();
+}
+
+NonnullRefPtr<SysFSBlockDeviceAttribute> SysFSBlockDeviceAttribute::create(BlockDevice& device, Type type)
+{
+    return adopt_ref(*new (nothrow) SysFSBlockDeviceAttribute(attribute_name(type), device, type));
+}
+
+SysFSBlockDeviceAttribute::SysFSBlockDeviceAttribute(StringView name, BlockDevice& device, Type type)
+    : SysFSAttribute(name)
+    , m_device(device.make_weak_ptr<BlockDevice>())
+    , m_type(type)
+{
+}
+
+KResult SysFSBlockDeviceAttribute::generate(SysFSContentWriter& writer) const
+{
+    auto device = m_device.strong_ref();
+    if (!device)
+        return ENODEV;
+
+    switch (m_type) {
+    case Type::QueueDepth:
+        return writer.append(String::formatted("{} (max {})\n", device->queue_depth(), device->max_queue_depth()).view());
+    case Type::Scheduler: {
+        auto current = device->io_scheduler();
+        StringBuilder builder;
+        for (auto scheduler : { BlockDevice::IOScheduler::None, BlockDevice::IOScheduler::Deadline, BlockDevice::IOScheduler::Elevator }) {
+            if (!builder.is_empty())
+                builder.append(' ');
+            if (scheduler == current)
+                builder.appendff("[{}]", scheduler_name(scheduler));
+            else
+                builder.append(scheduler_name(scheduler));
+        }
+        builder.append('\n');
+        return writer.append(builder.string_view());
+    }
+    case Type::Statistics: {
+        auto statistics = device->queue_statistics();
+        KBufferBuilder builder;
+        JsonObjectSerializer<KBufferBuilder> object { builder };
+        object.add("submitted", statistics.submitted);
+        object.add("completed", statistics.completed);
+        object.add("merged", statistics.merged);
+        object.add("in_flight", statistics.in_flight);
+        object.add("max_in_flight", statistics.max_in_flight);
+        object.add("average_latency_us", statistics.completed ? statistics.total_latency_us / statistics.completed : 0);
+        object.add("max_latency_us", statistics.max_latency_us);
+        for (auto type : { AsyncBlockDeviceRequest::Read, AsyncBlockDeviceRequest::Write, AsyncBlockDeviceRequest::Flush }) {
+            auto& type_statistics = statistics.by_type[type];
+            auto type_object = object.add_object(request_type_name(type));
+            type_object.add("completed", type_statistics.completed);
+            type_object.add("bytes", type_statistics.bytes);
+            type_object.add("merged", type_statistics.merged);
+            type_object.add("average_queue_time_us", type_statistics.completed ? type_statistics.total_queue_time_us / type_statistics.completed : 0);
+            type_object.add("average_service_time_us", type_statistics.completed ? type_statistics.total_service_time_us / type_statistics.completed : 0);
+            type_object.add("total_queue_time_us", type_statistics.total_queue_time_us);
+            type_object.add("total_service_time_us", type_statistics.total_service_time_us);
+            type_object.add("max_latency_us", type_statistics.max_latency_us);
+            // Entry i counts requests that completed in under 2^i microseconds (and at least half that).
+            auto histogram = type_object.add_array("latency_histogram_log2_us");
+            for (auto count : type_statistics.latency_histogram)
+                histogram.add(count);
+            histogram.finish();
+            type_object.finish();
+        }
+        object.finish();
+        auto data = builder.build();
+        if (!data)
+            return ENOMEM;
+        return writer.append(data->bytes());
+    }
+    case Type::Polling:
+        return writer.append(device->is_polling_enabled() ? "1\n"sv : "0\n"sv);
+    case Type::InjectedLatency:
+        return writer.append(String::formatted("{}\n", device->injected_latency_us().value_or(0)).view());
+    }
+    VERIFY_NOT_REACHED();
+}
+
+KResult SysFSBlockDeviceAttribute::write_value(StringView value)
+{
+    auto device = m_device.strong_ref();
+    if (!device)
+        return ENODEV;
+
+    switch (m_type) {
+    case Type::QueueDepth: {
+        auto depth = value.to_uint();
+        if (!depth.has_value())
+            return EINVAL;
+        return device->set_queue_depth(depth.value());
+    }
+    case Type::Scheduler:
+        for (auto scheduler : { BlockDevice::IOScheduler::None, BlockDevice::IOScheduler::Deadline, BlockDevice::IOScheduler::Elevator }) {
+            if (value == scheduler_name(scheduler))
+                return device->set_io_scheduler(scheduler);
+        }
+        return EINVAL;
+    case Type::Polling: {
+        auto enabled = parse_boolean(value);
+        if (!enabled.has_value())
+            return EINVAL;
+        return device->set_polling_enabled(enabled.value());
+    }
+    case Type::InjectedLatency: {
+        auto latency_us = value.to_uint();
+        if (!latency_us.has_value())
+            return EINVAL;
+        return device->set_injected_latency_us(latency_us.value());
+    }
+    case Type::Statistics:
+        return EROFS;
+    }
+    VERIFY_NOT_REACHED();
+}
+
+NonnullRefPtr<SysFSBlockDeviceDirectory> SysFSBlockDeviceDirectory::create(SysFSDirectory const& parent_directory, BlockDevice& device)
+{
+    return adopt_ref(*new (nothrow) SysFSBlockDeviceDirectory(parent_directory, device));
+}
+
+SysFSBlockDeviceDirectory::SysFSBlockDeviceDirectory(SysFSDirectory const& parent_directory, BlockDevice& device)
+    : SysFSDirectory(device.device_name(), parent_directory)
+    , m_device(device.make_weak_ptr<BlockDevice>())
+{
+    m_components.append(SysFSBlockDeviceAttribute::create(device, SysFSBlockDeviceAttribute::Type::QueueDepth));
+    m_components.append(SysFSBlockDeviceAttribute::create(device, SysFSBlockDeviceAttribute::Type::Scheduler));
+    m_components.append(SysFSBlockDeviceAttribute::create(device, SysFSBlockDeviceAttribute::Type::Statistics));
+    if (device.supports_polling())
+        m_components.append(SysFSBlockDeviceAttribute::create(device, SysFSBlockDeviceAttribute::Type::Polling));
+    if (device.injected_latency_us().has_value())
+        m_components.append(SysFSBlockDeviceAttribute::create(device, SysFSBlockDeviceAttribute::Type::InjectedLatency));
+}
+
+NonnullRefPtr<SysFSBlockDevicesDirectory> SysFSBlockDevicesDirectory::must_create(SysFSDirectory const& parent_directory)
+{
+    return adopt_ref(*new (nothrow) SysFSBlockDevicesDirectory(parent_directory));
+}
+
+SysFSBlockDevicesDirectory::SysFSBlockDevicesDirectory(SysFSDirectory const& parent_directory)
+    : SysFSDynamicDirectory("block"sv, parent_directory)
+{
+}
+
+void SysFSBlockDevicesDirectory::update_children() const
+{
+    // Framebuffers and KCOV are block devices too, but only disks belong under /sys/block.
+    Device::for_each([&](Device& device) {
+        if (!device.is_disk_device())
+            return;
+        auto& block_device = static_cast<BlockDevice&>(device);
+        auto existing = previous_child(block_device.device_name());
+        if (existing && static_cast<SysFSBlockDeviceDirectory&>(*existing).refers_to(block_device))
+            add_child(existing.release_nonnull());
+        else
+            add_child(SysFSBlockDeviceDirectory::create(*this, block_device));
+    });
+}
+
+}
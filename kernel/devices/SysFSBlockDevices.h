@@ -0,0 +1,61 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/WeakPtr.h>
+#include <kernel/devices/BlockDevice.h>
+#include <kernel/filesystem/SysFSComponent.h>
+
+namespace Kernel {
+
+class SysFSBlockDeviceAttribute final : public SysFSAttribute {
+public:
+    enum class Type {
+        QueueDepth,
+        Scheduler,
+        Statistics,
+        Polling,
+        InjectedLatency,
+    };
+
+    static NonnullRefPtr<SysFSBlockDeviceAttribute> create(BlockDevice&, Type);
+
+private:
+    SysFSBlockDeviceAttribute(StringView name, BlockDevice&, Type);
+
+    virtual KResult generate(SysFSContentWriter&) const override;
+    virtual bool is_writable() const override { return m_type != Type::Statistics; }
+    virtual KResult write_value(StringView) override;
+
+    WeakPtr<BlockDevice> m_device;
+    Type m_type;
+};
+
+class SysFSBlockDeviceDirectory final : public SysFSDirectory {
+public:
+    static NonnullRefPtr<SysFSBlockDeviceDirectory> create(SysFSDirectory const& parent_directory, BlockDevice&);
+
+    bool refers_to(BlockDevice const& device) const { return m_device.ptr() == &device; }
+
+private:
+    SysFSBlockDeviceDirectory(SysFSDirectory const& parent_directory, BlockDevice&);
+
+    WeakPtr<BlockDevice> m_device;
+};
+
+class SysFSBlockDevicesDirectory final : public SysFSDynamicDirectory {
+public:
+    static NonnullRefPtr<SysFSBlockDevicesDirectory> must_create(SysFSDirectory const& parent_directory);
+
+private:
+    explicit SysFSBlockDevicesDirectory(SysFSDirectory const& parent_directory);
+
+    virtual void update_children() const override;
+};
+
+}
@@ -0,0 +1,128 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Singleton.h>
+#include <kernel/devices/ahci/AHCIController.h>
+#include <kernel/IO.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/Sections.h>
+
+namespace Kernel {
+
+static constexpr size_t reset_timeout_ms = 1000;
+
+static Singleton<Vector<NonnullRefPtr<AHCIController>>> s_controllers;
+
+static bool is_ahci_controller(PCI::Address address)
+{
+    return PCI::get_class(address) == 0x1 && PCI::get_subclass(address) == 0x6 && PCI::get_programming_interface(address) == 0x1;
+}
+
+UNMAP_AFTER_INIT void AHCIController::detect()
+{
+    PCI::enumerate([&](const PCI::Address& address, PCI::ID) {
+        if (address.is_null() || !is_ahci_controller(address))
+            return;
+        auto controller_or_error = try_to_initialize(address);
+        if (controller_or_error.is_error()) {
+            dmesgln("AHCI: Failed to initialize controller @ {}: {}", address, controller_or_error.error());
+            return;
+        }
+        s_controllers->append(controller_or_error.release_value());
+    });
+}
+
+UNMAP_AFTER_INIT KResultOr<NonnullRefPtr<AHCIController>> AHCIController::try_to_initialize(PCI::Address address)
+{
+    auto controller = adopt_ref_if_nonnull(new (nothrow) AHCIController(address));
+    if (!controller)
+        return ENOMEM;
+    if (auto result = controller->initialize(); result.is_error())
+        return result;
+    return controller.release_nonnull();
+}
+
+UNMAP_AFTER_INIT AHCIController::AHCIController(PCI::Address address)
+    : PCI::Device(address)
+{
+}
+
+AHCIController::~AHCIController()
+{
+}
+
+UNMAP_AFTER_INIT KResult AHCIController::initialize()
+{
+    auto address = pci_address();
+    PCI::enable_memory_space(address);
+    PCI::enable_bus_mastering(address);
+
+    auto registers_base = PhysicalAddress(PCI::get_BAR5(address) & 0xfffffff0);
+    m_registers_region = MM.allocate_kernel_region(registers_base, Memory::page_round_up(PCI::get_BAR_space_size(address, 5)), "AHCI Registers", Memory::Region::Access::ReadWrite, Memory::Region::Cacheable::No);
+    if (!m_registers_region)
+        return ENOMEM;
+    m_hba = reinterpret_cast<volatile AHCI::HBARegisters*>(m_registers_region->vaddr().offset(registers_base.offset_in_page()).as_ptr());
+
+    m_hba->ghc = m_hba->ghc | AHCI::GHC_AE;
+    m_hba->ghc = m_hba->ghc | AHCI::GHC_HR;
+    for (size_t waited_ms = 0; m_hba->ghc & AHCI::GHC_HR; ++waited_ms) {
+        if (waited_ms >= reset_timeout_ms)
+            return ETIMEDOUT;
+        IO::delay(1000);
+    }
+    m_hba->ghc = m_hba->ghc | AHCI::GHC_AE;
+    m_capabilities = m_hba->cap;
+
+    u32 implemented_ports = m_hba->pi;
+    size_t disk_count = 0;
+    for (u32 port_index = 0; port_index < m_disks.size(); ++port_index) {
+        if (!(implemented_ports & (1u << port_index)))
+            continue;
+        auto& port = m_hba->ports[port_index];
+        if ((port.ssts & AHCI::PORT_SSTS_DET_MASK) != AHCI::PORT_SSTS_DET_PRESENT || port.sig != AHCI::SIGNATURE_ATA)
+            continue;
+        m_disks[port_index] = AHCIDisk::try_create(*this, port_index);
+        if (m_disks[port_index])
+            ++disk_count;
+    }
+
+    dmesgln("AHCI: Controller @ {}, {} command slot(s), {}NCQ, {} disk(s)", address, ((m_capabilities >> AHCI::CAP_NCS_SHIFT) & AHCI::CAP_NCS_MASK) + 1, (m_capabilities & AHCI::CAP_SNCQ) ? "" : "no ", disk_count);
+    m_hba->is = 0xffffffff;
+    m_hba->ghc = m_hba->ghc | AHCI::GHC_IE;
+    // Every port reports through one vector, so a single MSI message is all the HBA needs.
+    m_interrupts = PCI::MessageSignalledInterrupts::try_create(address, 1, "AHCI"sv);
+    if (m_interrupts) {
+        m_interrupts->handler(0).set_handler([this]() {
+            handle_port_interrupts();
+        });
+        m_interrupts->enable();
+    } else {
+        enable_irq();
+    }
+    return KSuccess;
+}
+
+bool AHCIController::handle_irq(const RegisterState&)
+{
+    return handle_port_interrupts();
+}
+
+bool AHCIController::handle_port_interrupts()
+{
+    u32 pending_ports = m_hba->is;
+    if (!pending_ports)
+        return false;
+    // Each port's status has to be cleared before the controller-wide bit it feeds.
+    for (u32 port_index = 0; port_index < m_disks.size(); ++port_index) {
+        if ((pending_ports & (1u << port_index)) && m_disks[port_index])
+            m_disks[port_index]->handle_interrupt();
+    }
+    m_hba->is = pending_ports;
+    return true;
+}
+
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Array.h>
+#include <base/RefCounted.h>
+#include <kernel/bus/pci/Device.h>
+#include <kernel/bus/pci/MessageSignalledInterrupts.h>
+#include <kernel/devices/ahci/AHCIDefinitions.h>
+#include <kernel/devices/ahci/AHCIDisk.h>
+#include <kernel/KResult.h>
+#include <kernel/memory/Region.h>
+
+namespace Kernel {
+
+class AHCIController final
+    : public PCI::Device
+    , public RefCounted<AHCIController> {
+public:
+    static void detect();
+    static KResultOr<NonnullRefPtr<AHCIController>> try_to_initialize(PCI::Address);
+    virtual ~AHCIController() override;
+
+    virtual StringView purpose() const override { return "AHCI"; }
+
+    u32 capabilities() const { return m_capabilities; }
+    volatile AHCI::PortRegisters& port_registers(u32 port_index) const { return m_hba->ports[port_index]; }
+
+private:
+    explicit AHCIController(PCI::Address);
+
+    KResult initialize();
+    virtual bool handle_irq(const RegisterState&) override;
+    bool handle_port_interrupts();
+
+    OwnPtr<Memory::Region> m_registers_region;
+    volatile AHCI::HBARegisters* m_hba { nullptr };
+    u32 m_capabilities { 0 };
+    Array<RefPtr<AHCIDisk>, 32> m_disks;
+    OwnPtr<PCI::MessageSignalledInterrupts> m_interrupts;
+};
+
+}
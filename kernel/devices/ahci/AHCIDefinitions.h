@@ -0,0 +1,160 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel::AHCI {
+
+struct [[gnu::packed]] PortRegisters {
+    u32 clb;
+    u32 clbu;
+    u32 fb;
+    u32 fbu;
+    u32 is;
+    u32 ie;
+    u32 cmd;
+    u32 reserved0;
+    u32 tfd;
+    u32 sig;
+    u32 ssts;
+    u32 sctl;
+    u32 serr;
+    u32 sact;
+    u32 ci;
+    u32 sntf;
+    u32 fbs;
+    u32 devslp;
+    u32 reserved1[10];
+    u32 vendor[4];
+};
+static_assert(sizeof(PortRegisters) == 0x80);
+
+struct [[gnu::packed]] HBARegisters {
+    u32 cap;
+    u32 ghc;
+    u32 is;
+    u32 pi;
+    u32 vs;
+    u32 ccc_ctl;
+    u32 ccc_ports;
+    u32 em_loc;
+    u32 em_ctl;
+    u32 cap2;
+    u32 bohc;
+    u8 reserved[0xa0 - 0x2c];
+    u8 vendor[0x100 - 0xa0];
+    PortRegisters ports[32];
+};
+
+static constexpr u32 CAP_SNCQ = 1 << 30;
+static constexpr u32 CAP_S64A = 1u << 31;
+static constexpr u32 CAP_NCS_SHIFT = 8;
+static constexpr u32 CAP_NCS_MASK = 0x1f;
+
+static constexpr u32 GHC_HR = 1 << 0;
+static constexpr u32 GHC_IE = 1 << 1;
+static constexpr u32 GHC_AE = 1u << 31;
+
+static constexpr u32 PORT_CMD_ST = 1 << 0;
+static constexpr u32 PORT_CMD_SUD = 1 << 1;
+static constexpr u32 PORT_CMD_POD = 1 << 2;
+static constexpr u32 PORT_CMD_FRE = 1 << 4;
+static constexpr u32 PORT_CMD_FR = 1 << 14;
+static constexpr u32 PORT_CMD_CR = 1 << 15;
+
+static constexpr u32 PORT_IS_DHRS = 1 << 0;
+static constexpr u32 PORT_IS_SDBS = 1 << 3;
+static constexpr u32 PORT_IS_IFS = 1 << 27;
+static constexpr u32 PORT_IS_HBDS = 1 << 28;
+static constexpr u32 PORT_IS_HBFS = 1 << 29;
+static constexpr u32 PORT_IS_TFES = 1 << 30;
+static constexpr u32 PORT_IS_ERROR_MASK = PORT_IS_IFS | PORT_IS_HBDS | PORT_IS_HBFS | PORT_IS_TFES;
+
+static constexpr u32 PORT_TFD_BSY = 1 << 7;
+static constexpr u32 PORT_TFD_DRQ = 1 << 3;
+
+static constexpr u32 PORT_SSTS_DET_MASK = 0xf;
+static constexpr u32 PORT_SSTS_DET_PRESENT = 0x3;
+static constexpr u32 SIGNATURE_ATA = 0x00000101;
+
+struct [[gnu::packed]] CommandHeader {
+    u16 attributes;
+    u16 prdtl;
+    volatile u32 prdbc;
+    u32 ctba;
+    u32 ctbau;
+    u32 reserved[4];
+};
+static_assert(sizeof(CommandHeader) == 32);
+
+static constexpr u16 COMMAND_HEADER_WRITE = 1 << 6;
+static constexpr u16 COMMAND_HEADER_CLEAR_BUSY = 1 << 10;
+
+struct [[gnu::packed]] PhysicalRegionDescriptor {
+    u32 base_low;
+    u32 base_high;
+    u32 reserved;
+    u32 byte_count; // Byte count minus one, bit 31 requests an interrupt.
+};
+static_assert(sizeof(PhysicalRegionDescriptor) == 16);
+
+static constexpr u32 max_prd_byte_count = 4 * MiB;
+
+struct [[gnu::packed]] CommandTable {
+    u8 command_fis[64];
+    u8 atapi_command[16];
+    u8 reserved[48];
+    PhysicalRegionDescriptor prdt[];
+};
+
+enum class FISType : u8 {
+    RegisterHostToDevice = 0x27,
+};
+
+struct [[gnu::packed]] RegisterHostToDeviceFIS {
+    u8 type;
+    u8 flags; // Bit 7 marks a command rather than a control update.
+    u8 command;
+    u8 features_low;
+    u8 lba0;
+    u8 lba1;
+    u8 lba2;
+    u8 device;
+    u8 lba3;
+    u8 lba4;
+    u8 lba5;
+    u8 features_high;
+    u8 count_low;
+    u8 count_high;
+    u8 icc;
+    u8 control;
+    u32 reserved;
+};
+
+enum class ATACommand : u8 {
+    ReadDMAExt = 0x25,
+    WriteDMAExt = 0x35,
+    ReadFPDMAQueued = 0x60,
+    WriteFPDMAQueued = 0x61,
+    FlushCacheExt = 0xea,
+    IdentifyDevice = 0xec,
+};
+
+static constexpr u8 DEVICE_LBA = 1 << 6;
+
+// Word offsets into the IDENTIFY DEVICE data.
+static constexpr size_t IDENTIFY_QUEUE_DEPTH = 75;
+static constexpr size_t IDENTIFY_SATA_CAPABILITIES = 76;
+static constexpr size_t IDENTIFY_MAX_LBA_48 = 100;
+static constexpr size_t IDENTIFY_LOGICAL_SECTOR_INFO = 106;
+static constexpr size_t IDENTIFY_LOGICAL_SECTOR_SIZE = 117;
+static constexpr size_t IDENTIFY_ROTATION_RATE = 217;
+static constexpr u16 SATA_CAPABILITY_NCQ = 1 << 8;
+
+}
@@ -0,0 +1,458 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/devices/ahci/AHCIController.h>
+#include <kernel/devices/ahci/AHCIDisk.h>
+#include <kernel/IO.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/StdLib.h>
+#include <kernel/WorkQueue.h>
+
+namespace Kernel {
+
+static constexpr size_t engine_timeout_ms = 500;
+static constexpr size_t identify_timeout_ms = 1000;
+
+static Atomic<unsigned> s_next_disk_index;
+
+RefPtr<AHCIDisk> AHCIDisk::try_create(AHCIController& controller, u32 port_index)
+{
+    auto disk = adopt_ref_if_nonnull(new (nothrow) AHCIDisk(controller, port_index, s_next_disk_index.fetch_add(1, Base::MemoryOrder::memory_order_relaxed)));
+    if (!disk || !disk->initialize())
+        return {};
+    return disk;
+}
+
+AHCIDisk::AHCIDisk(AHCIController& controller, u32 port_index, unsigned disk_index)
+    : DiskDevice(3, allocate_minor_number(), sector_size)
+    , m_controller(controller)
+    , m_port_index(port_index)
+    , m_port(controller.port_registers(port_index))
+    , m_disk_index(disk_index)
+{
+}
+
+AHCIDisk::~AHCIDisk()
+{
+}
+
+String AHCIDisk::device_name() const
+{
+    return String::formatted("sd{:c}", 'a' + m_disk_index);
+}
+
+AHCI::CommandHeader& AHCIDisk::command_header(size_t slot_index) const
+{
+    return reinterpret_cast<AHCI::CommandHeader*>(m_command_list->vaddr().as_ptr())[slot_index];
+}
+
+AHCI::CommandTable& AHCIDisk::command_table(size_t slot_index) const
+{
+    return *reinterpret_cast<AHCI::CommandTable*>(m_command_tables->vaddr().offset(slot_index * PAGE_SIZE).as_ptr());
+}
+
+PhysicalAddress AHCIDisk::command_table_address(size_t slot_index) const
+{
+    return m_command_tables->physical_page(slot_index)->paddr();
+}
+
+bool AHCIDisk::stop_command_engine()
+{
+    m_port.cmd = m_port.cmd & ~AHCI::PORT_CMD_ST;
+    for (size_t waited_ms = 0; m_port.cmd & AHCI::PORT_CMD_CR; ++waited_ms) {
+        if (waited_ms >= engine_timeout_ms)
+            return false;
+        IO::delay(1000);
+    }
+    m_port.cmd = m_port.cmd & ~AHCI::PORT_CMD_FRE;
+    for (size_t waited_ms = 0; m_port.cmd & AHCI::PORT_CMD_FR; ++waited_ms) {
+        if (waited_ms >= engine_timeout_ms)
+            return false;
+        IO::delay(1000);
+    }
+    return true;
+}
+
+bool AHCIDisk::start_command_engine()
+{
+    m_port.serr = 0xffffffff;
+    m_port.is = 0xffffffff;
+    m_port.cmd = m_port.cmd | AHCI::PORT_CMD_FRE;
+    for (size_t waited_ms = 0; m_port.tfd & (AHCI::PORT_TFD_BSY | AHCI::PORT_TFD_DRQ); ++waited_ms) {
+        if (waited_ms >= engine_timeout_ms)
+            return false;
+        IO::delay(1000);
+    }
+    m_port.cmd = m_port.cmd | AHCI::PORT_CMD_ST;
+    return true;
+}
+
+bool AHCIDisk::initialize()
+{
+    u32 capabilities = m_controller.capabilities();
+    size_t hba_slots = ((capabilities >> AHCI::CAP_NCS_SHIFT) & AHCI::CAP_NCS_MASK) + 1;
+
+    m_command_list = MM.allocate_contiguous_kernel_region(PAGE_SIZE, "AHCI Command List", Memory::Region::Access::ReadWrite);
+    m_command_tables = MM.allocate_contiguous_kernel_region(hba_slots * PAGE_SIZE, "AHCI Command Tables", Memory::Region::Access::ReadWrite);
+    if (!m_command_list || !m_command_tables)
+        return false;
+    memset(m_command_list->vaddr().as_ptr(), 0, PAGE_SIZE);
+    memset(m_command_tables->vaddr().as_ptr(), 0, hba_slots * PAGE_SIZE);
+
+    m_slots.resize(hba_slots);
+    for (auto& slot : m_slots) {
+        slot.bounce_buffer = MM.allocate_kernel_region(max_bounce_pages * PAGE_SIZE, "AHCI Bounce Buffer", Memory::Region::Access::ReadWrite, AllocationStrategy::AllocateNow);
+        if (!slot.bounce_buffer)
+            return false;
+    }
+
+    if (!stop_command_engine()) {
+        dbgln("AHCI: Port {} did not stop its command engine", m_port_index);
+        return false;
+    }
+    auto command_list_address = m_command_list->physical_page(0)->paddr().get();
+    auto fis_address = command_list_address + fis_receive_offset;
+    m_port.clb = command_list_address & 0xffffffff;
+    m_port.clbu = command_list_address >> 32;
+    m_port.fb = fis_address & 0xffffffff;
+    m_port.fbu = fis_address >> 32;
+    m_port.cmd = m_port.cmd | AHCI::PORT_CMD_SUD | AHCI::PORT_CMD_POD;
+    if (!start_command_engine()) {
+        dbgln("AHCI: Port {} stayed busy after spin-up", m_port_index);
+        return false;
+    }
+
+    if (!identify())
+        return false;
+
+    if (m_ncq && (capabilities & AHCI::CAP_SNCQ)) {
+        m_slot_count = min(m_slot_count, hba_slots);
+    } else {
+        m_ncq = false;
+        m_slot_count = 1;
+    }
+
+    m_port.ie = AHCI::PORT_IS_DHRS | AHCI::PORT_IS_SDBS | AHCI::PORT_IS_ERROR_MASK;
+    dmesgln("AHCI: {} on port {}, {} sectors, {}, queue depth {}", device_name(), m_port_index, m_block_count, m_rotational ? "rotational" : "solid state", m_slot_count);
+    return true;
+}
+
+bool AHCIDisk::identify()
+{
+    auto& identify_data_region = *m_slots[0].bounce_buffer;
+    memset(identify_data_region.vaddr().as_ptr(), 0, sector_size);
+    build_bounce_prdt(0, sector_size);
+    issue_command(0, AHCI::ATACommand::IdentifyDevice, 0, 0, 1, false);
+
+    // Interrupts are not enabled on the port yet, so the command is polled.
+    for (size_t waited_ms = 0; m_port.ci & 1; ++waited_ms) {
+        if ((m_port.is & AHCI::PORT_IS_ERROR_MASK) || waited_ms >= identify_timeout_ms) {
+            dbgln("AHCI: IDENTIFY DEVICE failed on port {} (tfd={:#x})", m_port_index, (u32)m_port.tfd);
+            return false;
+        }
+        IO::delay(1000);
+    }
+    m_issued_slots = 0;
+    m_port.is = 0xffffffff;
+
+    auto* words = reinterpret_cast<u16 const*>(identify_data_region.vaddr().as_ptr());
+    auto logical_sector_info = words[AHCI::IDENTIFY_LOGICAL_SECTOR_INFO];
+    if ((logical_sector_info & 0xc000) == 0x4000 && (logical_sector_info & (1 << 12))) {
+        u32 logical_sector_words = words[AHCI::IDENTIFY_LOGICAL_SECTOR_SIZE] | (u32)words[AHCI::IDENTIFY_LOGICAL_SECTOR_SIZE + 1] << 16;
+        if (logical_sector_words * 2 != sector_size) {
+            dbgln("AHCI: Port {} has unsupported logical sector size {}", m_port_index, logical_sector_words * 2);
+            return false;
+        }
+    }
+
+    m_block_count = 0;
+    for (size_t i = 0; i < 4; ++i)
+        m_block_count |= (u64)words[AHCI::IDENTIFY_MAX_LBA_48 + i] << (16 * i);
+    if (m_block_count == 0)
+        return false;
+
+    m_ncq = words[AHCI::IDENTIFY_SATA_CAPABILITIES] & AHCI::SATA_CAPABILITY_NCQ;
+    if (m_ncq)
+        m_slot_count = (words[AHCI::IDENTIFY_QUEUE_DEPTH] & 0x1f) + 1;
+    m_rotational = words[AHCI::IDENTIFY_ROTATION_RATE] != 1;
+    return true;
+}
+
+size_t AHCIDisk::build_direct_prdt(size_t slot_index, AsyncBlockDeviceRequest const& request, size_t offset, size_t size)
+{
+    bool can_address_64bit = m_controller.capabilities() & AHCI::CAP_S64A;
+    auto* prdt = command_table(slot_index).prdt;
+    size_t prd_count = 0;
+    u64 previous_end = 0;
+    bool success = request.for_each_physical_range(offset, size, [&](PhysicalAddress address, size_t length) {
+        u64 paddr = address.get();
+        // The HBA transfers whole words.
+        if ((paddr | length) & 1)
+            return false;
+        if (!can_address_64bit && paddr + length > 0x100000000ull)
+            return false;
+        if (prd_count && paddr == previous_end && prdt[prd_count - 1].byte_count + 1 + length <= AHCI::max_prd_byte_count) {
+            prdt[prd_count - 1].byte_count += length;
+        } else {
+            if (prd_count == max_prd_entries)
+                return false;
+            prdt[prd_count++] = { (u32)(paddr & 0xffffffff), (u32)(paddr >> 32), 0, (u32)length - 1 };
+        }
+        previous_end = paddr + length;
+        return true;
+    });
+    return success ? prd_count : 0;
+}
+
+size_t AHCIDisk::build_bounce_prdt(size_t slot_index, size_t size)
+{
+    auto& bounce_buffer = *m_slots[slot_index].bounce_buffer;
+    auto* prdt = command_table(slot_index).prdt;
+    size_t page_count = Memory::page_round_up(size) / PAGE_SIZE;
+    for (size_t page = 0; page < page_count; ++page) {
+        u64 paddr = bounce_buffer.physical_page(page)->paddr().get();
+        size_t chunk_size = min(size - page * PAGE_SIZE, PAGE_SIZE);
+        prdt[page] = { (u32)(paddr & 0xffffffff), (u32)(paddr >> 32), 0, (u32)chunk_size - 1 };
+    }
+    return page_count;
+}
+
+void AHCIDisk::issue_command(size_t slot_index, AHCI::ATACommand command, u64 lba, u16 sector_count, size_t prd_count, bool is_write)
+{
+    auto table_address = command_table_address(slot_index).get();
+    auto& header = command_header(slot_index);
+    header.attributes = sizeof(AHCI::RegisterHostToDeviceFIS) / sizeof(u32) | (is_write ? AHCI::COMMAND_HEADER_WRITE : 0);
+    header.prdtl = prd_count;
+    header.prdbc = 0;
+    header.ctba = table_address & 0xffffffff;
+    header.ctbau = table_address >> 32;
+
+    auto& fis = *reinterpret_cast<AHCI::RegisterHostToDeviceFIS*>(command_table(slot_index).command_fis);
+    memset(&fis, 0, sizeof(fis));
+    fis.type = to_underlying(AHCI::FISType::RegisterHostToDevice);
+    fis.flags = 1 << 7;
+    fis.command = to_underlying(command);
+    if (command != AHCI::ATACommand::IdentifyDevice)
+        fis.device = AHCI::DEVICE_LBA;
+    fis.lba0 = lba & 0xff;
+    fis.lba1 = (lba >> 8) & 0xff;
+    fis.lba2 = (lba >> 16) & 0xff;
+    fis.lba3 = (lba >> 24) & 0xff;
+    fis.lba4 = (lba >> 32) & 0xff;
+    fis.lba5 = (lba >> 40) & 0xff;
+
+    bool is_queued = command == AHCI::ATACommand::ReadFPDMAQueued || command == AHCI::ATACommand::WriteFPDMAQueued;
+    if (is_queued) {
+        // First-party DMA commands carry the sector count in the feature register and the tag in the count register.
+        fis.features_low = sector_count & 0xff;
+        fis.features_high = sector_count >> 8;
+        fis.count_low = slot_index << 3;
+    } else {
+        fis.count_low = sector_count & 0xff;
+        fis.count_high = sector_count >> 8;
+    }
+
+    Base::full_memory_barrier();
+    ScopedSpinLock lock(m_lock);
+    if (is_queued)
+        m_non_queued_slots &= ~(1u << slot_index);
+    else
+        m_non_queued_slots |= 1u << slot_index;
+    m_held_slots |= 1u << slot_index;
+    issue_held_commands();
+}
+
+void AHCIDisk::issue_held_commands()
+{
+    VERIFY(m_lock.is_locked());
+    // While the port restarts, commands are held back and issued once the engine runs again.
+    if (m_recovering || (m_issued_slots & m_non_queued_slots))
+        return;
+
+    // A non-queued command, such as FLUSH CACHE EXT next to NCQ traffic, has the port to itself:
+    // it waits for the queued commands already issued to drain, and new ones wait for it.
+    if (u32 held_non_queued_slots = m_held_slots & m_non_queued_slots) {
+        if (m_issued_slots)
+            return;
+        u32 slot = held_non_queued_slots & -held_non_queued_slots;
+        m_held_slots &= ~slot;
+        m_issued_slots |= slot;
+        m_port.ci = slot;
+        return;
+    }
+
+    if (!m_held_slots)
+        return;
+    m_issued_slots |= m_held_slots;
+    m_port.sact = m_held_slots;
+    m_port.ci = m_held_slots;
+    m_held_slots = 0;
+}
+
+void AHCIDisk::start_request(AsyncBlockDeviceRequest& request)
+{
+    if (request.end_block_index() > m_block_count) {
+        request.complete(AsyncDeviceRequest::Failure);
+        return;
+    }
+
+    size_t slot_index = 0;
+    {
+        ScopedSpinLock lock(m_lock);
+        // The request queue never has more than max_queue_depth() requests in flight.
+        while (m_slots[slot_index].request) {
+            ++slot_index;
+            VERIFY(slot_index < m_slot_count);
+        }
+        auto& slot = m_slots[slot_index];
+        slot.request = request;
+        slot.next_block = request.block_index();
+    }
+    start_transfer(slot_index);
+}
+
+void AHCIDisk::start_transfer(size_t slot_index)
+{
+    auto& slot = m_slots[slot_index];
+    auto& request = *slot.request;
+    if (request.request_type() == AsyncBlockDeviceRequest::Flush) {
+        slot.uses_bounce_buffer = false;
+        slot.blocks_in_transfer = 0;
+        issue_command(slot_index, AHCI::ATACommand::FlushCacheExt, 0, 0, 0, false);
+        return;
+    }
+
+    bool is_write = request.request_type() == AsyncBlockDeviceRequest::Write;
+    u64 remaining_blocks = request.end_block_index() - slot.next_block;
+    size_t offset = (slot.next_block - request.block_index()) * block_size();
+
+    // An unaligned buffer can need one more page than its size suggests, hence the spare PRD entry.
+    u64 max_direct_blocks = min((max_prd_entries - 1) * PAGE_SIZE / block_size(), (size_t)NumericLimits<u16>::max());
+    u32 block_count = min(remaining_blocks, max_direct_blocks);
+    size_t prd_count = build_direct_prdt(slot_index, request, offset, block_count * block_size());
+    slot.uses_bounce_buffer = prd_count == 0;
+    if (slot.uses_bounce_buffer) {
+        block_count = min(remaining_blocks, (u64)(max_bounce_pages * PAGE_SIZE / block_size()));
+        size_t size = block_count * block_size();
+        if (is_write && !request.read_data(offset, slot.bounce_buffer->vaddr().as_ptr(), size)) {
+            release_slot(slot_index, AsyncDeviceRequest::MemoryFault);
+            return;
+        }
+        prd_count = build_bounce_prdt(slot_index, size);
+    }
+    slot.blocks_in_transfer = block_count;
+
+    AHCI::ATACommand command;
+    if (m_ncq)
+        command = is_write ? AHCI::ATACommand::WriteFPDMAQueued : AHCI::ATACommand::ReadFPDMAQueued;
+    else
+        command = is_write ? AHCI::ATACommand::WriteDMAExt : AHCI::ATACommand::ReadDMAExt;
+    issue_command(slot_index, command, slot.next_block, block_count, prd_count, is_write);
+}
+
+void AHCIDisk::finish_transfer(size_t slot_index)
+{
+    auto& slot = m_slots[slot_index];
+    auto& request = *slot.request;
+
+    if (slot.uses_bounce_buffer && request.request_type() == AsyncBlockDeviceRequest::Read) {
+        size_t offset = (slot.next_block - request.block_index()) * block_size();
+        if (!request.write_data(offset, slot.bounce_buffer->vaddr().as_ptr(), slot.blocks_in_transfer * block_size())) {
+            release_slot(slot_index, AsyncDeviceRequest::MemoryFault);
+            return;
+        }
+    }
+
+    slot.next_block += slot.blocks_in_transfer;
+    if (slot.next_block < request.end_block_index()) {
+        start_transfer(slot_index);
+        return;
+    }
+    release_slot(slot_index, AsyncDeviceRequest::Success);
+}
+
+void AHCIDisk::release_slot(size_t slot_index, AsyncDeviceRequest::RequestResult result)
+{
+    RefPtr<AsyncBlockDeviceRequest> finished_request;
+    {
+        ScopedSpinLock lock(m_lock);
+        finished_request = move(m_slots[slot_index].request);
+    }
+    finished_request->complete(result);
+}
+
+void AHCIDisk::handle_interrupt()
+{
+    u32 status = m_port.is;
+    m_port.is = status;
+    if (status & AHCI::PORT_IS_ERROR_MASK)
+        m_error_pending = true;
+
+    if (!m_completion_work_queued.exchange(true)) {
+        g_io_work->queue([this]() {
+            m_completion_work_queued = false;
+            if (m_error_pending.exchange(false))
+                recover_from_error();
+            else
+                complete_finished_commands();
+        });
+    }
+}
+
+void AHCIDisk::complete_finished_commands()
+{
+    u32 finished_slots;
+    {
+        ScopedSpinLock lock(m_lock);
+        u32 active_slots = m_port.ci | (m_ncq ? m_port.sact : 0);
+        finished_slots = m_issued_slots & ~active_slots;
+        m_issued_slots &= ~finished_slots;
+        issue_held_commands();
+    }
+    for (size_t slot_index = 0; finished_slots; ++slot_index, finished_slots >>= 1) {
+        if (finished_slots & 1)
+            finish_transfer(slot_index);
+    }
+}
+
+void AHCIDisk::recover_from_error()
+{
+    // A task file error aborts every queued command, so all of them are failed and the port is restarted.
+    dbgln("AHCI: {} error, tfd={:#x} serr={:#x}", device_name(), (u32)m_port.tfd, (u32)m_port.serr);
+    MutexLocker recovery_locker(m_recovery_lock);
+    u32 failed_slots;
+    {
+        ScopedSpinLock lock(m_lock);
+        u32 active_slots = m_port.ci | (m_ncq ? m_port.sact : 0);
+        failed_slots = m_issued_slots & active_slots;
+        u32 finished_slots = m_issued_slots & ~active_slots;
+        m_issued_slots = finished_slots;
+        m_recovering = true;
+    }
+
+    // Restarting the engine can wait up to a second for the port, so it's done without holding m_lock.
+    stop_command_engine();
+    bool recovered = start_command_engine();
+    if (!recovered)
+        dbgln("AHCI: {} did not recover", device_name());
+
+    {
+        ScopedSpinLock lock(m_lock);
+        m_recovering = false;
+        if (!recovered) {
+            failed_slots |= m_held_slots;
+            m_held_slots = 0;
+        }
+    }
+    complete_finished_commands();
+    for (size_t slot_index = 0; failed_slots; ++slot_index, failed_slots >>= 1) {
+        if (failed_slots & 1)
+            release_slot(slot_index, AsyncDeviceRequest::Failure);
+    }
+}
+
+}
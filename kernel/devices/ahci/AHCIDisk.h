@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Vector.h>
+#include <kernel/devices/ahci/AHCIDefinitions.h>
+#include <kernel/devices/DiskDevice.h>
+#include <kernel/locking/Mutex.h>
+#include <kernel/locking/SpinLock.h>
+#include <kernel/memory/Region.h>
+
+namespace Kernel {
+
+class AHCIController;
+
+// A SATA disk attached to one port of an AHCI controller.
+class AHCIDisk final : public DiskDevice {
+public:
+    static RefPtr<AHCIDisk> try_create(AHCIController&, u32 port_index);
+    virtual ~AHCIDisk() override;
+
+    u32 port_index() const { return m_port_index; }
+    void handle_interrupt();
+
+    // ^DiskDevice
+    virtual u64 max_addressable_block() const override { return m_block_count; }
+
+    // ^BlockDevice
+    virtual void start_request(AsyncBlockDeviceRequest&) override;
+    virtual size_t max_queue_depth() const override { return m_slot_count; }
+    virtual bool is_rotational() const override { return m_rotational; }
+    virtual bool supports_flush() const override { return true; }
+
+    // ^Device
+    virtual String device_name() const override;
+    virtual StringView class_name() const override { return "AHCIDisk"; }
+
+private:
+    static constexpr size_t sector_size = 512;
+    static constexpr size_t max_bounce_pages = 16;
+    static constexpr size_t max_prd_entries = (PAGE_SIZE - sizeof(AHCI::CommandTable)) / sizeof(AHCI::PhysicalRegionDescriptor);
+    static constexpr size_t fis_receive_offset = 1024;
+
+    struct CommandSlot {
+        RefPtr<AsyncBlockDeviceRequest> request;
+        u64 next_block { 0 };
+        u32 blocks_in_transfer { 0 };
+        bool uses_bounce_buffer { false };
+        OwnPtr<Memory::Region> bounce_buffer;
+    };
+
+    AHCIDisk(AHCIController&, u32 port_index, unsigned disk_index);
+
+    bool initialize();
+    bool start_command_engine();
+    bool stop_command_engine();
+    bool identify();
+    void recover_from_error();
+
+    AHCI::CommandHeader& command_header(size_t slot_index) const;
+    AHCI::CommandTable& command_table(size_t slot_index) const;
+    PhysicalAddress command_table_address(size_t slot_index) const;
+
+    size_t build_direct_prdt(size_t slot_index, AsyncBlockDeviceRequest const&, size_t offset, size_t size);
+    size_t build_bounce_prdt(size_t slot_index, size_t size);
+    void issue_command(size_t slot_index, AHCI::ATACommand, u64 lba, u16 sector_count, size_t prd_count, bool is_write);
+    void issue_held_commands();
+
+    void start_transfer(size_t slot_index);
+    void finish_transfer(size_t slot_index);
+    void release_slot(size_t slot_index, AsyncDeviceRequest::RequestResult);
+    void complete_finished_commands();
+
+    AHCIController& m_controller;
+    u32 m_port_index { 0 };
+    volatile AHCI::PortRegisters& m_port;
+    unsigned m_disk_index { 0 };
+
+    u64 m_block_count { 0 };
+    bool m_ncq { false };
+    bool m_rotational { false };
+    size_t m_slot_count { 1 };
+
+    // The command list and the received FIS area share one page; every slot gets a page for its command table.
+    OwnPtr<Memory::Region> m_command_list;
+    OwnPtr<Memory::Region> m_command_tables;
+
+    SpinLock<u8> m_lock;
+    u32 m_issued_slots { 0 };
+    u32 m_held_slots { 0 };
+    u32 m_non_queued_slots { 0 };
+    bool m_recovering { false };
+    Mutex m_recovery_lock { "AHCIDisk recovery" };
+    Vector<CommandSlot> m_slots;
+    Atomic<bool> m_completion_work_queued { false };
+    Atomic<bool> m_error_pending { false };
+};
+
+}
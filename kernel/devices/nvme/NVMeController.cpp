@@ -0,0 +1,282 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Singleton.h>
+#include <kernel/devices/nvme/NVMeController.h>
+#include <kernel/IO.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/Sections.h>
+#include <kernel/WorkQueue.h>
+
+namespace Kernel {
+
+static constexpr u16 admin_queue_depth = 32;
+static constexpr u16 max_io_queue_depth = 64;
+static constexpr u8 default_coalescing_threshold = 3;
+static constexpr u8 default_coalescing_time_100us = 1;
+
+static Singleton<Vector<NonnullRefPtr<NVMeController>>> s_controllers;
+
+static bool is_nvme_controller(PCI::Address address)
+{
+    return PCI::get_class(address) == 0x1 && PCI::get_subclass(address) == 0x8 && PCI::get_programming_interface(address) == 0x2;
+}
+
+UNMAP_AFTER_INIT void NVMeController::detect()
+{
+    unsigned index = 0;
+    PCI::enumerate([&](const PCI::Address& address, PCI::ID) {
+        if (address.is_null() || !is_nvme_controller(address))
+            return;
+        auto controller_or_error = try_to_initialize(address, index);
+        if (controller_or_error.is_error()) {
+            dmesgln("NVMe: Failed to initialize controller @ {}: {}", address, controller_or_error.error());
+            return;
+        }
+        ++index;
+        s_controllers->append(controller_or_error.release_value());
+    });
+}
+
+UNMAP_AFTER_INIT KResultOr<NonnullRefPtr<NVMeController>> NVMeController::try_to_initialize(PCI::Address address, unsigned index)
+{
+    auto controller = adopt_ref_if_nonnull(new (nothrow) NVMeController(address, index));
+    if (!controller)
+        return ENOMEM;
+    if (auto result = controller->initialize(); result.is_error())
+        return result;
+    return controller.release_nonnull();
+}
+
+UNMAP_AFTER_INIT NVMeController::NVMeController(PCI::Address address, unsigned index)
+    : PCI::Device(address)
+    , m_index(index)
+{
+}
+
+NVMeController::~NVMeController()
+{
+}
+
+volatile u32* NVMeController::doorbell(u16 qid, bool completion) const
+{
+    auto offset = NVMe::doorbell_offset + (2 * qid + (completion ? 1 : 0)) * m_doorbell_stride;
+    return reinterpret_cast<volatile u32*>(m_registers_region->vaddr().offset(offset).as_ptr());
+}
+
+KResult NVMeController::set_enabled(bool enabled)
+{
+    if (enabled)
+        m_registers->cc = m_registers->cc | NVMe::CC_EN;
+    else
+        m_registers->cc = m_registers->cc & ~NVMe::CC_EN;
+
+    for (u32 waited_ms = 0; ((m_registers->csts & NVMe::CSTS_RDY) != 0) != enabled; ++waited_ms) {
+        if (m_registers->csts & NVMe::CSTS_CFS)
+            return EIO;
+        if (waited_ms >= m_ready_timeout_ms)
+            return ETIMEDOUT;
+        IO::delay(1000);
+    }
+    return KSuccess;
+}
+
+UNMAP_AFTER_INIT KResult NVMeController::initialize()
+{
+    auto address = pci_address();
+    PCI::enable_memory_space(address);
+    PCI::enable_bus_mastering(address);
+
+    u64 bar = PCI::get_BAR0(address);
+    u64 registers_base = bar & 0xfffffff0;
+    if ((bar & 0x6) == 0x4)
+        registers_base |= (u64)PCI::get_BAR1(address) << 32;
+    m_registers_region = MM.allocate_kernel_region(PhysicalAddress(registers_base), Memory::page_round_up(PCI::get_BAR_space_size(address, 0)), "NVMe Registers", Memory::Region::Access::ReadWrite, Memory::Region::Cacheable::No);
+    m_identify_buffer = MM.allocate_contiguous_kernel_region(PAGE_SIZE, "NVMe Identify", Memory::Region::Access::ReadWrite);
+    if (!m_registers_region || !m_identify_buffer)
+        return ENOMEM;
+    m_registers = reinterpret_cast<volatile NVMe::ControllerRegisters*>(m_registers_region->vaddr().as_ptr());
+
+    m_capabilities = m_registers->cap;
+    m_doorbell_stride = 4 << ((m_capabilities >> NVMe::CAP_DSTRD_SHIFT) & NVMe::CAP_DSTRD_MASK);
+    m_ready_timeout_ms = ((m_capabilities >> NVMe::CAP_TO_SHIFT) & NVMe::CAP_TO_MASK) * 500;
+    u16 max_queue_depth = min((m_capabilities & NVMe::CAP_MQES_MASK) + 1, (u64)max_io_queue_depth);
+
+    if (auto result = set_enabled(false); result.is_error())
+        return result;
+
+    u16 admin_depth = min(admin_queue_depth, max_queue_depth);
+    m_admin_queue = NVMeQueue::try_create(0, admin_depth, 0, doorbell(0, false), doorbell(0, true));
+    if (!m_admin_queue)
+        return ENOMEM;
+    m_registers->aqa = (admin_depth - 1) << 16 | (admin_depth - 1);
+    m_registers->asq = m_admin_queue->submission_queue_address().get();
+    m_registers->acq = m_admin_queue->completion_queue_address().get();
+    // NVM command set, 4 KiB memory pages, 64-byte submission and 16-byte completion entries.
+    m_registers->cc = (6 << NVMe::CC_IOSQES_SHIFT) | (4 << NVMe::CC_IOCQES_SHIFT);
+    if (auto result = set_enabled(true); result.is_error())
+        return result;
+
+    if (!identify(NVMe::IdentifyCNS::Controller, 0).has_value())
+        return EIO;
+    auto& controller_info = *reinterpret_cast<NVMe::IdentifyController*>(m_identify_buffer->vaddr().as_ptr());
+    if (controller_info.mdts)
+        m_max_transfer_pages = min(m_max_transfer_pages, (size_t)1 << controller_info.mdts);
+    u32 namespace_count = controller_info.nn;
+
+    // Vectors have to exist before the completion queues that name them are created.
+    m_interrupts = PCI::MessageSignalledInterrupts::try_create(address, Processor::count(), "NVMe"sv);
+    if (auto result = create_io_queues(min(Processor::count(), (u32)NumericLimits<u16>::max()), max_queue_depth); result.is_error())
+        return result;
+    if (auto result = set_interrupt_coalescing(default_coalescing_threshold, default_coalescing_time_100us); result.is_error())
+        dbgln("NVMe: Controller {} does not support interrupt coalescing", m_index);
+    if (auto result = identify_namespaces(namespace_count); result.is_error())
+        return result;
+
+    dmesgln("NVMe: Controller {} @ {}, {} I/O queue(s) of depth {}, {} namespace(s), {} interrupt vector(s)", m_index, address, m_io_queues.size(), max_queue_depth, m_namespaces.size(), m_interrupts ? m_interrupts->count() : 0);
+    setup_interrupt_vectors();
+    if (m_interrupts)
+        m_interrupts->enable();
+    else
+        enable_irq();
+    return KSuccess;
+}
+
+Optional<u32> NVMeController::identify(NVMe::IdentifyCNS cns, u32 nsid)
+{
+    NVMe::SubmissionQueueEntry entry {};
+    entry.opcode = to_underlying(NVMe::AdminOpcode::Identify);
+    entry.nsid = nsid;
+    entry.prp1 = m_identify_buffer->physical_page(0)->paddr().get();
+    entry.cdw10 = to_underlying(cns);
+    return m_admin_queue->submit_and_wait(entry);
+}
+
+UNMAP_AFTER_INIT KResult NVMeController::create_io_queues(u16 requested_count, u16 depth)
+{
+    NVMe::SubmissionQueueEntry set_queue_count {};
+    set_queue_count.opcode = to_underlying(NVMe::AdminOpcode::SetFeatures);
+    set_queue_count.cdw10 = to_underlying(NVMe::FeatureID::NumberOfQueues);
+    set_queue_count.cdw11 = (requested_count - 1) << 16 | (requested_count - 1);
+    auto allocated = m_admin_queue->submit_and_wait(set_queue_count);
+    if (!allocated.has_value())
+        return EIO;
+    u16 queue_count = min(requested_count, (u16)(min(allocated.value() & 0xffff, allocated.value() >> 16) + 1));
+
+    // One queue pair per processor, so that submitters never share a queue (or its lock).
+    for (u16 qid = 1; qid <= queue_count; ++qid) {
+        auto queue = NVMeQueue::try_create(qid, depth, m_max_transfer_pages, doorbell(qid, false), doorbell(qid, true));
+        if (!queue)
+            return ENOMEM;
+
+        NVMe::SubmissionQueueEntry create_completion_queue {};
+        create_completion_queue.opcode = to_underlying(NVMe::AdminOpcode::CreateIOCompletionQueue);
+        create_completion_queue.prp1 = queue->completion_queue_address().get();
+        create_completion_queue.cdw10 = (depth - 1) << 16 | qid;
+        u32 interrupt_vector = m_interrupts ? (qid - 1) % m_interrupts->count() : 0;
+        create_completion_queue.cdw11 = interrupt_vector << 16 | NVMe::QUEUE_IRQ_ENABLED | NVMe::QUEUE_PHYSICALLY_CONTIGUOUS;
+        if (!m_admin_queue->submit_and_wait(create_completion_queue).has_value())
+            return EIO;
+
+        NVMe::SubmissionQueueEntry create_submission_queue {};
+        create_submission_queue.opcode = to_underlying(NVMe::AdminOpcode::CreateIOSubmissionQueue);
+        create_submission_queue.prp1 = queue->submission_queue_address().get();
+        create_submission_queue.cdw10 = (depth - 1) << 16 | qid;
+        create_submission_queue.cdw11 = (u32)qid << 16 | NVMe::QUEUE_PHYSICALLY_CONTIGUOUS;
+        if (!m_admin_queue->submit_and_wait(create_submission_queue).has_value())
+            return EIO;
+
+        m_io_queues.append(queue.release_nonnull());
+    }
+    return KSuccess;
+}
+
+UNMAP_AFTER_INIT KResult NVMeController::identify_namespaces(u32 namespace_count)
+{
+    for (u32 nsid = 1; nsid <= namespace_count; ++nsid) {
+        if (!identify(NVMe::IdentifyCNS::Namespace, nsid).has_value())
+            continue;
+        auto& namespace_info = *reinterpret_cast<NVMe::IdentifyNamespace*>(m_identify_buffer->vaddr().as_ptr());
+        if (namespace_info.nsze == 0)
+            continue;
+        size_t block_size = 1 << namespace_info.lbaf[namespace_info.flbas & 0xf].lbads;
+        if (block_size < 512 || block_size > PAGE_SIZE) {
+            dbgln("NVMe: Skipping namespace {} with unsupported block size {}", nsid, block_size);
+            continue;
+        }
+        auto nvme_namespace = NVMeNamespace::try_create(*this, nsid, namespace_info.nsze, block_size);
+        if (!nvme_namespace)
+            return ENOMEM;
+        m_namespaces.append(nvme_namespace.release_nonnull());
+    }
+    return KSuccess;
+}
+
+KResult NVMeController::set_interrupt_coalescing(u8 threshold, u8 time_100us)
+{
+    NVMe::SubmissionQueueEntry entry {};
+    entry.opcode = to_underlying(NVMe::AdminOpcode::SetFeatures);
+    entry.cdw10 = to_underlying(NVMe::FeatureID::InterruptCoalescing);
+    entry.cdw11 = (u32)time_100us << 8 | threshold;
+    if (!m_admin_queue->submit_and_wait(entry).has_value())
+        return EIO;
+    return KSuccess;
+}
+
+UNMAP_AFTER_INIT void NVMeController::setup_interrupt_vectors()
+{
+    if (!m_interrupts)
+        return;
+    // A single MSI vector is treated like the pin, masked through INTMS until the queues are drained.
+    if (!m_interrupts->is_extended()) {
+        m_interrupts->handler(0).set_handler([this]() {
+            handle_shared_interrupt();
+        });
+        return;
+    }
+    // With MSI-X, INTMS and INTMC are off limits; every vector serves the queues created with it instead.
+    size_t vector_count = m_interrupts->count();
+    for (size_t vector = 0; vector < vector_count; ++vector) {
+        m_interrupts->handler(vector).set_handler([this, vector, vector_count]() {
+            for (size_t i = vector; i < m_io_queues.size(); i += vector_count)
+                m_io_queues[i]->handle_interrupt();
+        });
+    }
+}
+
+bool NVMeController::handle_irq(const RegisterState&)
+{
+    return handle_shared_interrupt();
+}
+
+bool NVMeController::handle_shared_interrupt()
+{
+    bool has_completions = false;
+    for (auto& queue : m_io_queues)
+        has_completions |= queue->has_completions();
+    if (!has_completions)
+        return false;
+
+    // The pin stays asserted until the completion queues are drained, so mask it until then.
+    m_registers->intms = 1;
+    if (!m_completion_work_queued.exchange(true)) {
+        g_io_work->queue([this]() {
+            process_io_completions();
+        });
+    }
+    return true;
+}
+
+void NVMeController::process_io_completions()
+{
+    m_completion_work_queued = false;
+    for (auto& queue : m_io_queues)
+        queue->process_completions();
+    m_registers->intmc = 1;
+}
+
+}
@@ -0,0 +1,71 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/NonnullOwnPtr.h>
+#include <base/RefCounted.h>
+#include <base/Vector.h>
+#include <kernel/bus/pci/Device.h>
+#include <kernel/bus/pci/MessageSignalledInterrupts.h>
+#include <kernel/devices/nvme/NVMeNamespace.h>
+#include <kernel/devices/nvme/NVMeQueue.h>
+#include <kernel/KResult.h>
+#include <kernel/memory/Region.h>
+
+namespace Kernel {
+
+class NVMeController final
+    : public PCI::Device
+    , public RefCounted<NVMeController> {
+public:
+    static void detect();
+    static KResultOr<NonnullRefPtr<NVMeController>> try_to_initialize(PCI::Address, unsigned index);
+    virtual ~NVMeController() override;
+
+    virtual StringView purpose() const override { return "NVMe"; }
+
+    unsigned index() const { return m_index; }
+    size_t io_queue_count() const { return m_io_queues.size(); }
+    NVMeQueue& io_queue_for_current_processor() { return *m_io_queues[Processor::id() % m_io_queues.size()]; }
+
+    KResult set_interrupt_coalescing(u8 threshold, u8 time_100us);
+
+private:
+    NVMeController(PCI::Address, unsigned index);
+
+    KResult initialize();
+    KResult set_enabled(bool);
+    KResult create_io_queues(u16 requested_count, u16 depth);
+    KResult identify_namespaces(u32 namespace_count);
+    Optional<u32> identify(NVMe::IdentifyCNS, u32 nsid);
+
+    volatile u32* doorbell(u16 qid, bool completion) const;
+
+    void setup_interrupt_vectors();
+    virtual bool handle_irq(const RegisterState&) override;
+    bool handle_shared_interrupt();
+    void process_io_completions();
+
+    unsigned m_index { 0 };
+    OwnPtr<Memory::Region> m_registers_region;
+    volatile NVMe::ControllerRegisters* m_registers { nullptr };
+    u64 m_capabilities { 0 };
+    u32 m_doorbell_stride { 4 };
+    u32 m_ready_timeout_ms { 0 };
+    size_t m_max_transfer_pages { NVMeQueue::max_prp_entries };
+
+    OwnPtr<Memory::Region> m_identify_buffer;
+    OwnPtr<NVMeQueue> m_admin_queue;
+    Vector<NonnullOwnPtr<NVMeQueue>> m_io_queues;
+    Vector<NonnullRefPtr<NVMeNamespace>> m_namespaces;
+    OwnPtr<PCI::MessageSignalledInterrupts> m_interrupts;
+    Atomic<bool> m_completion_work_queued { false };
+};
+
+}
@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Types.h>
+
+namespace Kernel::NVMe {
+
+struct [[gnu::packed]] ControllerRegisters {
+    u64 cap;
+    u32 vs;
+    u32 intms;
+    u32 intmc;
+    u32 cc;
+    u32 reserved0;
+    u32 csts;
+    u32 nssr;
+    u32 aqa;
+    u64 asq;
+    u64 acq;
+};
+
+static constexpr u32 doorbell_offset = 0x1000;
+
+static constexpr u64 CAP_MQES_MASK = 0xffff;
+static constexpr u64 CAP_TO_SHIFT = 24;
+static constexpr u64 CAP_TO_MASK = 0xff;
+static constexpr u64 CAP_DSTRD_SHIFT = 32;
+static constexpr u64 CAP_DSTRD_MASK = 0xf;
+
+static constexpr u32 CC_EN = 1 << 0;
+static constexpr u32 CC_IOSQES_SHIFT = 16;
+static constexpr u32 CC_IOCQES_SHIFT = 20;
+static constexpr u32 CSTS_RDY = 1 << 0;
+static constexpr u32 CSTS_CFS = 1 << 1;
+
+enum class AdminOpcode : u8 {
+    DeleteIOSubmissionQueue = 0x00,
+    CreateIOSubmissionQueue = 0x01,
+    DeleteIOCompletionQueue = 0x04,
+    CreateIOCompletionQueue = 0x05,
+    Identify = 0x06,
+    SetFeatures = 0x09,
+};
+
+enum class IOOpcode : u8 {
+    Flush = 0x00,
+    Write = 0x01,
+    Read = 0x02,
+};
+
+enum class IdentifyCNS : u32 {
+    Namespace = 0x00,
+    Controller = 0x01,
+};
+
+enum class FeatureID : u32 {
+    NumberOfQueues = 0x07,
+    InterruptCoalescing = 0x08,
+};
+
+static constexpr u16 QUEUE_PHYSICALLY_CONTIGUOUS = 1 << 0;
+static constexpr u16 QUEUE_IRQ_ENABLED = 1 << 1;
+
+struct [[gnu::packed]] SubmissionQueueEntry {
+    u8 opcode;
+    u8 flags;
+    u16 command_id;
+    u32 nsid;
+    u64 reserved;
+    u64 metadata;
+    u64 prp1;
+    u64 prp2;
+    u32 cdw10;
+    u32 cdw11;
+    u32 cdw12;
+    u32 cdw13;
+    u32 cdw14;
+    u32 cdw15;
+};
+static_assert(sizeof(SubmissionQueueEntry) == 64);
+
+struct [[gnu::packed]] CompletionQueueEntry {
+    u32 result;
+    u32 reserved;
+    u16 sq_head;
+    u16 sq_id;
+    u16 command_id;
+    u16 status;
+};
+static_assert(sizeof(CompletionQueueEntry) == 16);
+
+// Bit 0 of the status field is the phase tag, the rest is the status code.
+static constexpr u16 STATUS_PHASE = 1 << 0;
+static constexpr u16 status_code(u16 status) { return status >> 1; }
+
+struct [[gnu::packed]] IdentifyController {
+    u16 vid;
+    u16 ssvid;
+    char sn[20];
+    char mn[40];
+    char fr[8];
+    u8 rab;
+    u8 ieee[3];
+    u8 cmic;
+    u8 mdts;
+    u8 reserved0[438];
+    u32 nn;
+    u8 reserved1[3576];
+};
+static_assert(sizeof(IdentifyController) == 4096);
+
+struct [[gnu::packed]] LBAFormat {
+    u16 ms;
+    u8 lbads;
+    u8 rp;
+};
+
+struct [[gnu::packed]] IdentifyNamespace {
+    u64 nsze;
+    u64 ncap;
+    u64 nuse;
+    u8 nsfeat;
+    u8 nlbaf;
+    u8 flbas;
+    u8 reserved0[101];
+    LBAFormat lbaf[16];
+    u8 reserved1[3904];
+};
+static_assert(sizeof(IdentifyNamespace) == 4096);
+
+}
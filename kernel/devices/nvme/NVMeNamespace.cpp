@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/devices/nvme/NVMeController.h>
+#include <kernel/devices/nvme/NVMeNamespace.h>
+
+namespace Kernel {
+
+RefPtr<NVMeNamespace> NVMeNamespace::try_create(NVMeController& controller, u32 nsid, u64 block_count, size_t block_size)
+{
+    return adopt_ref_if_nonnull(new (nothrow) NVMeNamespace(controller, nsid, block_count, block_size));
+}
+
+NVMeNamespace::NVMeNamespace(NVMeController& controller, u32 nsid, u64 block_count, size_t block_size)
+    : DiskDevice(3, allocate_minor_number(), block_size)
+    , m_controller(controller)
+    , m_nsid(nsid)
+    , m_block_count(block_count)
+{
+}
+
+NVMeNamespace::~NVMeNamespace()
+{
+}
+
+String NVMeNamespace::device_name() const
+{
+    return String::formatted("nvme{}n{}", m_controller.index(), m_nsid);
+}
+
+size_t NVMeNamespace::max_queue_depth() const
+{
+    return m_controller.io_queue_count() * m_controller.io_queue_for_current_processor().slot_count();
+}
+
+void NVMeNamespace::start_request(AsyncBlockDeviceRequest& request)
+{
+    if (request.end_block_index() > m_block_count) {
+        request.complete(AsyncDeviceRequest::Failure);
+        return;
+    }
+    m_controller.io_queue_for_current_processor().submit_request(request, m_nsid, block_size());
+}
+
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <kernel/devices/DiskDevice.h>
+
+namespace Kernel {
+
+class NVMeController;
+
+class NVMeNamespace final : public DiskDevice {
+public:
+    static RefPtr<NVMeNamespace> try_create(NVMeController&, u32 nsid, u64 block_count, size_t block_size);
+    virtual ~NVMeNamespace() override;
+
+    u32 nsid() const { return m_nsid; }
+
+    // ^DiskDevice
+    virtual u64 max_addressable_block() const override { return m_block_count; }
+
+    // ^BlockDevice
+    virtual void start_request(AsyncBlockDeviceRequest&) override;
+    virtual bool bypasses_request_queue() const override { return true; }
+    virtual size_t max_queue_depth() const override;
+    virtual bool supports_flush() const override { return true; }
+
+    // ^Device
+    virtual String device_name() const override;
+    virtual StringView class_name() const override { return "NVMeNamespace"; }
+
+private:
+    NVMeNamespace(NVMeController&, u32 nsid, u64 block_count, size_t block_size);
+
+    NVMeController& m_controller;
+    u32 m_nsid { 0 };
+    u64 m_block_count { 0 };
+};
+
+}
@@ -0,0 +1,313 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/devices/nvme/NVMeQueue.h>
+#include <kernel/IO.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/StdLib.h>
+#include <kernel/WorkQueue.h>
+
+namespace Kernel {
+
+static constexpr size_t max_slots_per_queue = 32;
+static constexpr size_t admin_timeout_us = 1'000'000;
+
+OwnPtr<NVMeQueue> NVMeQueue::try_create(u16 qid, u16 depth, size_t max_transfer_pages, volatile u32* submission_doorbell, volatile u32* completion_doorbell)
+{
+    VERIFY(max_transfer_pages <= max_prp_entries);
+    auto submission_queue = MM.allocate_contiguous_kernel_region(Memory::page_round_up(depth * sizeof(NVMe::SubmissionQueueEntry)), "NVMe Submission Queue", Memory::Region::Access::ReadWrite);
+    auto completion_queue = MM.allocate_contiguous_kernel_region(Memory::page_round_up(depth * sizeof(NVMe::CompletionQueueEntry)), "NVMe Completion Queue", Memory::Region::Access::ReadWrite);
+    if (!submission_queue || !completion_queue)
+        return {};
+    memset(submission_queue->vaddr().as_ptr(), 0, submission_queue->size());
+    memset(completion_queue->vaddr().as_ptr(), 0, completion_queue->size());
+
+    auto queue = adopt_own_if_nonnull(new (nothrow) NVMeQueue(qid, depth, max_transfer_pages, submission_queue.release_nonnull(), completion_queue.release_nonnull(), submission_doorbell, completion_doorbell));
+    if (!queue || !max_transfer_pages)
+        return queue;
+
+    // A full queue holds depth - 1 commands.
+    size_t slot_count = min((size_t)depth - 1, max_slots_per_queue);
+    queue->m_prp_lists = MM.allocate_contiguous_kernel_region(Memory::page_round_up(slot_count * max_prp_entries * sizeof(u64)), "NVMe PRP Lists", Memory::Region::Access::ReadWrite);
+    if (!queue->m_prp_lists)
+        return {};
+    queue->m_slots.resize(slot_count);
+    for (auto& slot : queue->m_slots) {
+        slot.data = MM.allocate_kernel_region(max_transfer_pages * PAGE_SIZE, "NVMe Request Data", Memory::Region::Access::ReadWrite, AllocationStrategy::AllocateNow);
+        if (!slot.data)
+            return {};
+    }
+    return queue;
+}
+
+NVMeQueue::NVMeQueue(u16 qid, u16 depth, size_t max_transfer_pages, NonnullOwnPtr<Memory::Region> submission_queue, NonnullOwnPtr<Memory::Region> completion_queue, volatile u32* submission_doorbell, volatile u32* completion_doorbell)
+    : m_qid(qid)
+    , m_depth(depth)
+    , m_max_transfer_pages(max_transfer_pages)
+    , m_submission_queue(move(submission_queue))
+    , m_completion_queue(move(completion_queue))
+    , m_submission_doorbell(submission_doorbell)
+    , m_completion_doorbell(completion_doorbell)
+{
+}
+
+NVMeQueue::~NVMeQueue()
+{
+}
+
+void NVMeQueue::push_submission(NVMe::SubmissionQueueEntry const& entry)
+{
+    VERIFY(m_lock.is_locked());
+    submission_entries()[m_submission_tail] = entry;
+    m_submission_tail = (m_submission_tail + 1) % m_depth;
+    Base::full_memory_barrier();
+    *m_submission_doorbell = m_submission_tail;
+}
+
+bool NVMeQueue::pop_completion(NVMe::CompletionQueueEntry& entry)
+{
+    VERIFY(m_lock.is_locked());
+    auto& next = completion_entries()[m_completion_head];
+    if ((next.status & NVMe::STATUS_PHASE) != m_phase)
+        return false;
+    entry = next;
+    if (++m_completion_head == m_depth) {
+        m_completion_head = 0;
+        m_phase ^= 1;
+    }
+    return true;
+}
+
+bool NVMeQueue::has_completions() const
+{
+    auto& next = completion_entries()[m_completion_head];
+    return (next.status & NVMe::STATUS_PHASE) == m_phase;
+}
+
+void NVMeQueue::handle_interrupt()
+{
+    if (!has_completions() || m_completion_work_queued.exchange(true))
+        return;
+    g_io_work->queue([this]() {
+        m_completion_work_queued = false;
+        process_completions();
+    });
+}
+
+Optional<u32> NVMeQueue::submit_and_wait(NVMe::SubmissionQueueEntry& entry)
+{
+    ScopedSpinLock lock(m_lock);
+    entry.command_id = m_submission_tail;
+    push_submission(entry);
+
+    NVMe::CompletionQueueEntry completion;
+    for (size_t waited_us = 0; !pop_completion(completion); waited_us += 10) {
+        if (waited_us >= admin_timeout_us) {
+            dbgln("NVMe: Admin command {:#02x} timed out", entry.opcode);
+            return {};
+        }
+        IO::delay(10);
+    }
+    *m_completion_doorbell = m_completion_head;
+
+    if (auto code = NVMe::status_code(completion.status); code != 0) {
+        dbgln("NVMe: Admin command {:#02x} failed with status {:#x}", entry.opcode, code);
+        return {};
+    }
+    return completion.result;
+}
+
+void NVMeQueue::submit_request(AsyncBlockDeviceRequest& request, u32 nsid, size_t block_size)
+{
+    VERIFY(!m_slots.is_empty());
+    ScopedSpinLock lock(m_lock);
+    for (size_t slot_index = 0; slot_index < m_slots.size(); ++slot_index) {
+        auto& slot = m_slots[slot_index];
+        if (slot.request)
+            continue;
+        slot.request = request;
+        slot.nsid = nsid;
+        slot.block_size = block_size;
+        slot.next_block = request.block_index();
+        lock.unlock();
+        start_transfer(slot_index);
+        return;
+    }
+    // Every slot is busy; the request starts as soon as one frees up.
+    m_pending_requests.append({ request, nsid, block_size });
+}
+
+void NVMeQueue::start_transfer(size_t slot_index)
+{
+    auto& slot = m_slots[slot_index];
+    auto& request = *slot.request;
+    bool is_read = request.request_type() == AsyncBlockDeviceRequest::Read;
+
+    if (request.request_type() == AsyncBlockDeviceRequest::Flush) {
+        NVMe::SubmissionQueueEntry entry {};
+        entry.opcode = to_underlying(NVMe::IOOpcode::Flush);
+        entry.command_id = slot_index;
+        entry.nsid = slot.nsid;
+        slot.uses_bounce_buffer = false;
+        slot.blocks_in_transfer = 0;
+        ScopedSpinLock lock(m_lock);
+        push_submission(entry);
+        return;
+    }
+
+    // Requests larger than a slot are carried out in several transfers.
+    u64 blocks_per_transfer = m_max_transfer_pages * PAGE_SIZE / slot.block_size;
+    u32 block_count = min(request.end_block_index() - slot.next_block, blocks_per_transfer);
+    size_t offset = (slot.next_block - request.block_index()) * slot.block_size;
+    size_t size = block_count * slot.block_size;
+
+    NVMe::SubmissionQueueEntry entry {};
+    entry.opcode = to_underlying(is_read ? NVMe::IOOpcode::Read : NVMe::IOOpcode::Write);
+    entry.command_id = slot_index;
+    entry.nsid = slot.nsid;
+    entry.cdw10 = slot.next_block & 0xffffffff;
+    entry.cdw11 = slot.next_block >> 32;
+    entry.cdw12 = (block_count - 1) & 0xffff;
+
+    slot.uses_bounce_buffer = !build_direct_prps(slot_index, request, offset, size, entry);
+    if (slot.uses_bounce_buffer) {
+        if (!is_read && !request.read_data(offset, slot.data->vaddr().as_ptr(), size)) {
+            release_slot(slot_index, AsyncDeviceRequest::MemoryFault);
+            return;
+        }
+        // The data pages are scattered, so anything beyond two pages is described by a PRP list.
+        size_t page_count = Memory::page_round_up(size) / PAGE_SIZE;
+        entry.prp1 = slot.data->physical_page(0)->paddr().get();
+        entry.prp2 = 0;
+        if (page_count == 2) {
+            entry.prp2 = slot.data->physical_page(1)->paddr().get();
+        } else if (page_count > 2) {
+            auto* list = prp_list(slot_index);
+            for (size_t page = 1; page < page_count; ++page)
+                list[page - 1] = slot.data->physical_page(page)->paddr().get();
+            entry.prp2 = prp_list_address(slot_index).get();
+        }
+    }
+    slot.blocks_in_transfer = block_count;
+
+    ScopedSpinLock lock(m_lock);
+    push_submission(entry);
+}
+
+bool NVMeQueue::build_direct_prps(size_t slot_index, AsyncBlockDeviceRequest const& request, size_t offset, size_t size, NVMe::SubmissionQueueEntry& entry)
+{
+    // PRPs describe whole pages: only the first one may start mid-page, and every range has to
+    // continue where the previous one stopped or start a fresh page after it filled its own.
+    auto* list = prp_list(slot_index);
+    size_t page_count = 0;
+    u64 previous_end = 0;
+    bool success = request.for_each_physical_range(offset, size, [&](PhysicalAddress address, size_t length) {
+        u64 paddr = address.get();
+        if (page_count == 0) {
+            if (paddr & 3)
+                return false;
+            entry.prp1 = paddr;
+            page_count = 1;
+        } else if (paddr != previous_end) {
+            if (paddr % PAGE_SIZE || previous_end % PAGE_SIZE)
+                return false;
+            if (page_count == m_max_transfer_pages)
+                return false;
+            list[page_count++ - 1] = paddr;
+        } else if (paddr % PAGE_SIZE == 0) {
+            if (page_count == m_max_transfer_pages)
+                return false;
+            list[page_count++ - 1] = paddr;
+        }
+        // A range that crosses into further pages (physically contiguous kernel memory) needs an entry for each.
+        for (u64 page = Memory::page_round_down(paddr) + PAGE_SIZE; page < paddr + length; page += PAGE_SIZE) {
+            if (page_count == m_max_transfer_pages)
+                return false;
+            list[page_count++ - 1] = page;
+        }
+        previous_end = paddr + length;
+        return true;
+    });
+    if (!success)
+        return false;
+
+    entry.prp2 = 0;
+    if (page_count == 2)
+        entry.prp2 = list[0];
+    else if (page_count > 2)
+        entry.prp2 = prp_list_address(slot_index).get();
+    return true;
+}
+
+void NVMeQueue::finish_transfer(size_t slot_index, u16 status)
+{
+    auto& slot = m_slots[slot_index];
+    auto& request = *slot.request;
+
+    if (auto code = NVMe::status_code(status); code != 0) {
+        dbgln("NVMe: I/O queue {} transfer at block {} failed with status {:#x}", m_qid, slot.next_block, code);
+        release_slot(slot_index, AsyncDeviceRequest::Failure);
+        return;
+    }
+
+    if (slot.uses_bounce_buffer && request.request_type() == AsyncBlockDeviceRequest::Read) {
+        size_t offset = (slot.next_block - request.block_index()) * slot.block_size;
+        if (!request.write_data(offset, slot.data->vaddr().as_ptr(), slot.blocks_in_transfer * slot.block_size)) {
+            release_slot(slot_index, AsyncDeviceRequest::MemoryFault);
+            return;
+        }
+    }
+
+    slot.next_block += slot.blocks_in_transfer;
+    if (slot.next_block < request.end_block_index()) {
+        start_transfer(slot_index);
+        return;
+    }
+    release_slot(slot_index, AsyncDeviceRequest::Success);
+}
+
+void NVMeQueue::release_slot(size_t slot_index, AsyncDeviceRequest::RequestResult result)
+{
+    RefPtr<AsyncBlockDeviceRequest> finished_request;
+    bool has_next_request = false;
+    {
+        ScopedSpinLock lock(m_lock);
+        auto& slot = m_slots[slot_index];
+        finished_request = move(slot.request);
+        if (!m_pending_requests.is_empty()) {
+            auto pending = m_pending_requests.take_first();
+            slot.request = move(pending.request);
+            slot.nsid = pending.nsid;
+            slot.block_size = pending.block_size;
+            slot.next_block = slot.request->block_index();
+            has_next_request = true;
+        }
+    }
+    finished_request->complete(result);
+    if (has_next_request)
+        start_transfer(slot_index);
+}
+
+void NVMeQueue::process_completions()
+{
+    Vector<NVMe::CompletionQueueEntry, max_slots_per_queue> completions;
+    {
+        ScopedSpinLock lock(m_lock);
+        NVMe::CompletionQueueEntry entry;
+        while (pop_completion(entry))
+            completions.append(entry);
+        if (completions.is_empty())
+            return;
+        *m_completion_doorbell = m_completion_head;
+    }
+    for (auto& completion : completions) {
+        VERIFY(completion.command_id < m_slots.size());
+        finish_transfer(completion.command_id, completion.status);
+    }
+}
+
+}
@@ -0,0 +1,98 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/NonnullOwnPtr.h>
+#include <base/Vector.h>
+#include <kernel/devices/BlockDevice.h>
+#include <kernel/devices/nvme/NVMeDefinitions.h>
+#include <kernel/locking/SpinLock.h>
+#include <kernel/memory/Region.h>
+
+namespace Kernel {
+
+// A submission queue and its completion queue. Every I/O queue pair is used by the
+// submitters of a single processor, so its lock is only ever shared with its own completions.
+class NVMeQueue {
+    BASE_MAKE_NONCOPYABLE(NVMeQueue);
+    BASE_MAKE_NONMOVABLE(NVMeQueue);
+
+public:
+    static constexpr size_t max_prp_entries = 16;
+
+    static OwnPtr<NVMeQueue> try_create(u16 qid, u16 depth, size_t max_transfer_pages, volatile u32* submission_doorbell, volatile u32* completion_doorbell);
+    ~NVMeQueue();
+
+    u16 qid() const { return m_qid; }
+    u16 depth() const { return m_depth; }
+    size_t slot_count() const { return m_slots.size(); }
+    PhysicalAddress submission_queue_address() const { return m_submission_queue->physical_page(0)->paddr(); }
+    PhysicalAddress completion_queue_address() const { return m_completion_queue->physical_page(0)->paddr(); }
+
+    // Only used on the admin queue while the controller is brought up.
+    Optional<u32> submit_and_wait(NVMe::SubmissionQueueEntry&);
+
+    void submit_request(AsyncBlockDeviceRequest&, u32 nsid, size_t block_size);
+    bool has_completions() const;
+    void process_completions();
+
+    // Entry point for a queue with an interrupt vector of its own.
+    void handle_interrupt();
+
+private:
+    struct RequestSlot {
+        RefPtr<AsyncBlockDeviceRequest> request;
+        u32 nsid { 0 };
+        size_t block_size { 0 };
+        u64 next_block { 0 };
+        u32 blocks_in_transfer { 0 };
+        bool uses_bounce_buffer { false };
+        OwnPtr<Memory::Region> data;
+    };
+
+    struct PendingRequest {
+        NonnullRefPtr<AsyncBlockDeviceRequest> request;
+        u32 nsid;
+        size_t block_size;
+    };
+
+    NVMeQueue(u16 qid, u16 depth, size_t max_transfer_pages, NonnullOwnPtr<Memory::Region> submission_queue, NonnullOwnPtr<Memory::Region> completion_queue, volatile u32* submission_doorbell, volatile u32* completion_doorbell);
+
+    NVMe::SubmissionQueueEntry* submission_entries() const { return reinterpret_cast<NVMe::SubmissionQueueEntry*>(m_submission_queue->vaddr().as_ptr()); }
+    NVMe::CompletionQueueEntry* completion_entries() const { return reinterpret_cast<NVMe::CompletionQueueEntry*>(m_completion_queue->vaddr().as_ptr()); }
+    u64* prp_list(size_t slot_index) const { return reinterpret_cast<u64*>(m_prp_lists->vaddr().offset(slot_index * max_prp_entries * sizeof(u64)).as_ptr()); }
+    PhysicalAddress prp_list_address(size_t slot_index) const { return m_prp_lists->physical_page(0)->paddr().offset(slot_index * max_prp_entries * sizeof(u64)); }
+
+    void push_submission(NVMe::SubmissionQueueEntry const&);
+    bool pop_completion(NVMe::CompletionQueueEntry&);
+    void start_transfer(size_t slot_index);
+    bool build_direct_prps(size_t slot_index, AsyncBlockDeviceRequest const&, size_t offset, size_t size, NVMe::SubmissionQueueEntry&);
+    void finish_transfer(size_t slot_index, u16 status);
+    void release_slot(size_t slot_index, AsyncDeviceRequest::RequestResult);
+
+    u16 m_qid { 0 };
+    u16 m_depth { 0 };
+    size_t m_max_transfer_pages { 0 };
+
+    NonnullOwnPtr<Memory::Region> m_submission_queue;
+    NonnullOwnPtr<Memory::Region> m_completion_queue;
+    OwnPtr<Memory::Region> m_prp_lists;
+    volatile u32* m_submission_doorbell { nullptr };
+    volatile u32* m_completion_doorbell { nullptr };
+
+    SpinLock<u8> m_lock;
+    u16 m_submission_tail { 0 };
+    u16 m_completion_head { 0 };
+    u16 m_phase { 1 };
+    Vector<RequestSlot> m_slots;
+    Vector<PendingRequest> m_pending_requests;
+    Atomic<bool> m_completion_work_queued { false };
+};
+
+}
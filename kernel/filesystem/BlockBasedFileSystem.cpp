@@ -6,7 +6,9 @@
 
 // includes
 #include <base/IntrusiveList.h>
+#include <base/QuickSort.h>
 #include <kernel/Debug.h>
+#include <kernel/devices/BlockDevice.h>
 #include <kernel/filesystem/BlockBasedFileSystem.h>
 #include <kernel/Process.h>
 
@@ -187,24 +189,22 @@ bool BlockBasedFileSystem::raw_write(BlockIndex index, const UserOrKernelBuffer&
 
 bool BlockBasedFileSystem::raw_read_blocks(BlockIndex index, size_t count, UserOrKernelBuffer& buffer)
 {
-    auto current = buffer;
-    for (auto block = index.value(); block < (index.value() + count); block++) {
-        if (!raw_read(BlockIndex { block }, current))
-            return false;
-        current = current.offset(logical_block_size());
-    }
-    return true;
+    auto base_offset = index.value() * m_logical_block_size;
+    auto length = count * m_logical_block_size;
+    auto nread = file_description().read(buffer, base_offset, length);
+    if (nread.is_error())
+        return false;
+    return nread.value() == length;
 }
 
 bool BlockBasedFileSystem::raw_write_blocks(BlockIndex index, size_t count, const UserOrKernelBuffer& buffer)
 {
-    auto current = buffer;
-    for (auto block = index.value(); block < (index.value() + count); block++) {
-        if (!raw_write(block, current))
-            return false;
-        current = current.offset(logical_block_size());
-    }
-    return true;
+    auto base_offset = index.value() * m_logical_block_size;
+    auto length = count * m_logical_block_size;
+    auto nwritten = file_description().write(base_offset, buffer, length);
+    if (nwritten.is_error())
+        return false;
+    return nwritten.value() == length;
 }
 
 KResult BlockBasedFileSystem::write_blocks(BlockIndex index, unsigned count, const UserOrKernelBuffer& data, bool allow_cache)
@@ -291,18 +291,58 @@ void BlockBasedFileSystem::flush_specific_block_if_needed(BlockIndex index)
     });
 }
 
+bool BlockBasedFileSystem::write_back_run(Span<CacheEntry*> run)
+{
+    auto& file = file_description().file();
+    if (!file.is_block_device())
+        return false;
+    auto& device = static_cast<BlockDevice&>(file);
+    if (block_size() % device.block_size() != 0)
+        return false;
+
+    Vector<BlockIOSegment> segments;
+    for (auto* entry : run) {
+        if (!BlockDevice::append_kernel_segments(segments, VirtualAddress(entry->data), block_size()))
+            return false;
+    }
+    u64 device_block_index = run.first()->block_index.value() * (block_size() / device.block_size());
+    return !device.transfer_segments(AsyncBlockDeviceRequest::Write, device_block_index, move(segments)).is_error();
+}
+
 void BlockBasedFileSystem::flush_writes_impl()
 {
+    static constexpr size_t max_run_size = 1 * MiB;
     size_t count = 0;
     m_cache.with_exclusive([&](auto& cache) {
         if (!cache->is_dirty())
             return;
+        Vector<CacheEntry*> dirty_entries;
         cache->for_each_dirty_entry([&](CacheEntry& entry) {
-            auto base_offset = entry.block_index.value() * block_size();
-            auto entry_data_buffer = UserOrKernelBuffer::for_kernel_buffer(entry.data);
-            [[maybe_unused]] auto rc = file_description().write(base_offset, entry_data_buffer, block_size());
-            ++count;
+            dirty_entries.append(&entry);
         });
+        quick_sort(dirty_entries, [](auto* a, auto* b) { return a->block_index < b->block_index; });
+
+        // Runs of adjacent dirty blocks go out as one request, straight from the cache pages.
+        size_t max_run_length = max(max_run_size / block_size(), (size_t)1);
+        for (size_t run_start = 0; run_start < dirty_entries.size();) {
+            size_t run_length = 1;
+            while (run_start + run_length < dirty_entries.size() && run_length < max_run_length
+                && dirty_entries[run_start + run_length]->block_index.value() == dirty_entries[run_start]->block_index.value() + run_length)
+                ++run_length;
+            auto run = dirty_entries.span().slice(run_start, run_length);
+            if (!write_back_run(run)) {
+                for (auto* entry : run) {
+                    auto entry_data_buffer = UserOrKernelBuffer::for_kernel_buffer(entry->data);
+                    [[maybe_unused]] auto rc = file_description().write(entry->block_index.value() * block_size(), entry_data_buffer, block_size());
+                }
+            }
+            count += run_length;
+            run_start += run_length;
+        }
+        // Push the writes out of the device's volatile cache as well.
+        auto& file = file_description().file();
+        if (file.is_block_device())
+            (void)static_cast<BlockDevice&>(file).flush();
         cache->mark_all_clean();
         dbgln("{}: Flushed {} blocks to disk", class_name(), count);
     });
@@ -12,6 +12,8 @@
 
 namespace Kernel {
 
+struct CacheEntry;
+
 class BlockBasedFileSystem : public FileBackedFileSystem {
 public:
     TYPEDEF_DISTINCT_ORDERED_ID(u64, BlockIndex);
@@ -44,6 +46,7 @@ protected:
 private:
     DiskCache& cache() const;
     void flush_specific_block_if_needed(BlockIndex index);
+    bool write_back_run(Span<CacheEntry*>);
 
     mutable ProtectedValue<OwnPtr<DiskCache>> m_cache;
 };
@@ -7,6 +7,7 @@
 // includes
 #include <base/Singleton.h>
 #include <base/StringView.h>
+#include <kernel/devices/DiskDevice.h>
 #include <kernel/filesystem/DevFS.h>
 #include <kernel/filesystem/VirtualFileSystem.h>
 
@@ -185,6 +186,7 @@ KResultOr<size_t> DevFSLinkInode::write_bytes(off_t offset, size_t count, UserOr
     VERIFY(offset == 0);
     VERIFY(buffer.is_kernel_buffer());
     m_link = kstring_or_error.release_value();
+    invalidate_cached_link_target_locked();
     return count;
 }
 
@@ -368,6 +370,10 @@ InodeMetadata DevFSDeviceInode::metadata() const
     metadata.uid = m_uid;
     metadata.gid = m_gid;
     metadata.size = 0;
+    if (m_attached_device->is_disk_device()) {
+        auto& disk = static_cast<DiskDevice const&>(*m_attached_device);
+        metadata.size = disk.max_addressable_block() * disk.block_size();
+    }
     metadata.mtime = mepoch;
     metadata.major_device = m_attached_device->major();
     metadata.minor_device = m_attached_device->minor();
@@ -25,6 +25,7 @@ public:
 
     virtual bool initialize() override;
     virtual StringView class_name() const override { return "DevFS"sv; }
+    virtual bool can_cache_link_targets() const override { return true; }
 
     void notify_new_device(Device&);
     void notify_device_removal(Device&);
@@ -13,6 +13,7 @@
 #include <kernel/devices/BlockDevice.h>
 #include <kernel/filesystem/Ext2FileSystem.h>
 #include <kernel/filesystem/FileDescription.h>
+#include <kernel/filesystem/InodeCache.h>
 #include <kernel/filesystem/ext2_fs.h>
 #include <kernel/Process.h>
 #include <kernel/UnixTypes.h>
@@ -685,12 +686,7 @@ void Ext2FS::flush_writes()
         }
 
         Vector<InodeIndex> unused_inodes;
-        for (auto& it : m_inode_cache) {
-
-            if (!it.value) {
-                unused_inodes.append(it.key);
-                continue;
-            }
+        for (auto& it : m_retained_inodes) {
             if (it.value->ref_count() != 1)
                 continue;
             if (it.value->has_watchers())
@@ -765,23 +761,21 @@ void Ext2FSInode::flush_metadata()
 
 RefPtr<Inode> Ext2FS::get_inode(InodeIdentifier inode) const
 {
-    MutexLocker locker(m_lock);
     VERIFY(inode.fsid() == fsid());
 
-    {
-        auto it = m_inode_cache.find(inode.index());
-        if (it != m_inode_cache.end())
-            return (*it).value;
-    }
+    // Inodes already in memory are found without taking the filesystem lock.
+    if (auto cached_inode = inode_cache().get(inode.index()))
+        return cached_inode;
+
+    MutexLocker locker(m_lock);
+    if (auto cached_inode = inode_cache().get(inode.index()))
+        return cached_inode;
 
     auto state_or_error = get_inode_allocation_state(inode.index());
     if (state_or_error.is_error())
         return {};
-
-    if (!state_or_error.value()) {
-        m_inode_cache.set(inode.index(), nullptr);
+    if (!state_or_error.value())
         return {};
-    }
 
     BlockIndex block_index;
     unsigned offset;
@@ -793,7 +787,7 @@ RefPtr<Inode> Ext2FS::get_inode(InodeIdentifier inode) const
     if (auto result = read_block(block_index, &buffer, sizeof(ext2_inode), offset); result.is_error()) {
         return nullptr;
     }
-    m_inode_cache.set(inode.index(), new_inode);
+    m_retained_inodes.set(inode.index(), new_inode);
     return new_inode;
 }
 
@@ -961,6 +955,7 @@ KResultOr<size_t> Ext2FSInode::write_bytes(off_t offset, size_t count, const Use
             if ((size_t)(offset + count) > (size_t)m_raw_inode.i_size)
                 m_raw_inode.i_size = offset + count;
             set_metadata_dirty(true);
+            did_modify_contents();
             return count;
         }
     }
@@ -1041,6 +1036,11 @@ Ext2FS::FeaturesReadOnly Ext2FS::get_features_readonly() const
 }
 
 KResult Ext2FSInode::traverse_as_directory(Function<bool(FileSystem::DirectoryEntryView const&)> callback) const
+{
+    return traverse_as_directory_from(0, move(callback));
+}
+
+KResult Ext2FSInode::traverse_as_directory_from(u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)> callback) const
 {
     VERIFY(is_directory());
 
@@ -1050,17 +1050,19 @@ KResult Ext2FSInode::traverse_as_directory(Function<bool(FileSystem::DirectoryEn
     auto block_size = fs().block_size();
     auto file_size = size();
 
-
-    for (u64 offset = 0; offset < file_size; offset += block_size) {
+    for (u64 offset = cookie - (cookie % block_size); offset < file_size; offset += block_size) {
         if (auto result = read_bytes(offset, block_size, buf, nullptr); result.is_error())
             return result.error();
 
         auto* entry = reinterpret_cast<ext2_dir_entry_2*>(buffer);
         auto* entries_end = reinterpret_cast<ext2_dir_entry_2*>(buffer + block_size);
         while (entry < entries_end) {
-            if (entry->inode != 0) {
+            if (entry->rec_len == 0)
+                return EIO;
+            u64 entry_offset = offset + ((u8*)entry - buffer);
+            if (entry->inode != 0 && entry_offset >= cookie) {
                 dbgln_if(EXT2_DEBUG, "Ext2FSInode[{}]::traverse_as_directory(): inode {}, name_len: {}, rec_len: {}, file_type: {}, name: {}", identifier(), entry->inode, entry->name_len, entry->rec_len, entry->file_type, StringView(entry->name, entry->name_len));
-                if (!callback({ { entry->name, entry->name_len }, { fsid(), entry->inode }, entry->file_type }))
+                if (!callback({ { entry->name, entry->name_len }, { fsid(), entry->inode }, entry->file_type, entry_offset + entry->rec_len }))
                     return KSuccess;
             }
             entry = (ext2_dir_entry_2*)((char*)entry + entry->rec_len);
@@ -1361,7 +1363,7 @@ KResultOr<InodeIndex> Ext2FS::allocate_inode(GroupIndex preferred_group)
         const_cast<ext2_group_desc&>(bgd).bg_free_inodes_count--;
         m_block_group_descriptors_dirty = true;
 
-        m_inode_cache.remove(inode_index.value());
+        m_retained_inodes.remove(inode_index.value());
 
         return inode_index;
     }
@@ -1663,7 +1665,7 @@ KResult Ext2FSInode::decrement_link_count()
 void Ext2FS::uncache_inode(InodeIndex index)
 {
     MutexLocker locker(m_lock);
-    m_inode_cache.remove(index);
+    m_retained_inodes.remove(index);
 }
 
 KResult Ext2FSInode::chmod(mode_t mode)
@@ -1694,6 +1696,7 @@ KResult Ext2FSInode::truncate(u64 size)
         return KSuccess;
     if (auto result = resize(size); result.is_error())
         return result;
+    invalidate_cached_link_target_locked();
     set_metadata_dirty(true);
     return KSuccess;
 }
@@ -1739,12 +1742,12 @@ KResult Ext2FS::prepare_to_unmount()
 {
     MutexLocker locker(m_lock);
 
-    for (auto& it : m_inode_cache) {
+    for (auto& it : m_retained_inodes) {
         if (it.value->ref_count() > 1)
             return EBUSY;
     }
 
-    m_inode_cache.clear();
+    m_retained_inodes.clear();
     m_root_inode = nullptr;
     return KSuccess;
 }
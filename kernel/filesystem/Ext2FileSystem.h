@@ -41,6 +41,7 @@ private:
     virtual KResultOr<size_t> read_bytes(off_t, size_t, UserOrKernelBuffer& buffer, FileDescription*) const override;
     virtual InodeMetadata metadata() const override;
     virtual KResult traverse_as_directory(Function<bool(FileSystem::DirectoryEntryView const&)>) const override;
+    virtual KResult traverse_as_directory_from(u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)>) const override;
     virtual RefPtr<Inode> lookup(StringView name) override;
     virtual void flush_metadata() override;
     virtual KResultOr<size_t> write_bytes(off_t, size_t, const UserOrKernelBuffer& data, FileDescription*) override;
@@ -102,6 +103,7 @@ public:
     virtual KResult prepare_to_unmount() override;
 
     virtual bool supports_watchers() const override { return true; }
+    virtual bool can_cache_link_targets() const override { return true; }
 
     virtual u8 internal_file_type_to_directory_entry_type(const DirectoryEntryView& entry) const override;
 
@@ -162,7 +164,9 @@ private:
     mutable ext2_super_block m_super_block;
     mutable OwnPtr<KBuffer> m_cached_group_descriptor_table;
 
-    mutable HashMap<InodeIndex, RefPtr<Ext2FSInode>> m_inode_cache;
+    // Inodes are looked up through inode_cache(). This only keeps the ones read from disk
+    // alive until flush_writes() finds nobody else using them.
+    mutable HashMap<InodeIndex, NonnullRefPtr<Ext2FSInode>> m_retained_inodes;
 
     bool m_super_block_dirty { false };
     bool m_block_group_descriptors_dirty { false };
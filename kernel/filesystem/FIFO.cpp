@@ -13,6 +13,9 @@
 #include <kernel/filesystem/FileDescription.h>
 #include <kernel/locking/Mutex.h>
 #include <kernel/locking/ProtectedValue.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/memory/Region.h>
+#include <kernel/memory/ScopedQuickMap.h>
 #include <kernel/Process.h>
 #include <kernel/Thread.h>
 
@@ -29,10 +32,10 @@ static Atomic<int> s_next_fifo_id = 1;
 
 RefPtr<FIFO> FIFO::try_create(uid_t uid)
 {
-    auto buffer = DoubleBuffer::try_create();
-    if (buffer)
-        return adopt_ref_if_nonnull(new (nothrow) FIFO(uid, buffer.release_nonnull()));
-    return {};
+    Vector<Segment> segments;
+    if (!segments.try_resize(default_capacity / PAGE_SIZE))
+        return {};
+    return adopt_ref_if_nonnull(new (nothrow) FIFO(uid, move(segments)));
 }
 
 KResultOr<NonnullRefPtr<FileDescription>> FIFO::open_direction(FIFO::Direction direction)
@@ -76,18 +79,15 @@ KResultOr<NonnullRefPtr<FileDescription>> FIFO::open_direction_blocking(FIFO::Di
     return description;
 }
 
-FIFO::FIFO(uid_t uid, NonnullOwnPtr<DoubleBuffer> buffer)
-    : m_buffer(move(buffer))
+FIFO::FIFO(uid_t uid, Vector<Segment>&& segments)
+    : m_segments(move(segments))
+    , m_slot_count(m_segments.size())
     , m_uid(uid)
 {
     all_fifos().with_exclusive([&](auto& table) {
         table.set(this);
     });
     m_fifo_id = ++s_next_fifo_id;
-
-    m_buffer->set_unblock_callback([this]() {
-        evaluate_block_conditions();
-    });
 }
 
 FIFO::~FIFO()
@@ -123,19 +123,174 @@ void FIFO::detach(Direction direction)
 
 bool FIFO::can_read(const FileDescription&, size_t) const
 {
-    return !m_buffer->is_empty() || !m_writers;
+    return m_bytes_buffered || !m_writers;
 }
 
 bool FIFO::can_write(const FileDescription&, size_t) const
 {
-    return m_buffer->space_for_writing() || !m_readers;
+    return space_for_writing() || !m_readers;
+}
+
+size_t FIFO::space_for_writing() const
+{
+    size_t space = (m_slot_count - m_segment_count) * PAGE_SIZE;
+    if (m_segment_count) {
+        auto& last = m_segments[(m_first_segment + m_segment_count - 1) % m_slot_count];
+        if (!last.gifted)
+            space += PAGE_SIZE - (last.offset + last.length);
+    }
+    return space;
+}
+
+KResultOr<size_t> FIFO::set_capacity(size_t new_capacity)
+{
+    if (new_capacity == 0 || new_capacity > max_capacity)
+        return EINVAL;
+    size_t slot_count = Memory::page_round_up(new_capacity) / PAGE_SIZE;
+
+    MutexLocker locker(m_buffer_lock);
+    if (slot_count < m_segment_count)
+        return EBUSY;
+
+    Vector<Segment> segments;
+    if (!segments.try_resize(slot_count))
+        return ENOMEM;
+    for (size_t i = 0; i < m_segment_count; ++i)
+        segments[i] = move(segment_at(i));
+
+    m_segments = move(segments);
+    m_slot_count = slot_count;
+    m_first_segment = 0;
+
+    locker.unlock();
+    evaluate_block_conditions();
+    return capacity();
+}
+
+FIFO::Segment* FIFO::writable_tail_segment()
+{
+    if (!m_segment_count)
+        return nullptr;
+    auto& last = segment_at(m_segment_count - 1);
+    if (last.gifted || last.offset + last.length == PAGE_SIZE)
+        return nullptr;
+    return &last;
+}
+
+void FIFO::append_segment(Segment&& segment)
+{
+    VERIFY(m_segment_count < m_slot_count);
+    m_bytes_buffered += segment.length;
+    segment_at(m_segment_count++) = move(segment);
+}
+
+void FIFO::drop_first_segment()
+{
+    auto& segment = segment_at(0);
+    VERIFY(segment.length == 0);
+    if (!segment.gifted && !m_spare_page)
+        m_spare_page = move(segment.page);
+    segment = {};
+    m_first_segment = (m_first_segment + 1) % m_slot_count;
+    --m_segment_count;
+}
+
+RefPtr<Memory::PhysicalPage> FIFO::take_page()
+{
+    if (m_spare_page)
+        return move(m_spare_page);
+    return MM.allocate_user_physical_page(Memory::MemoryManager::ShouldZeroFill::No);
+}
+
+RefPtr<Memory::PhysicalPage> FIFO::take_user_page_reference(Process& process, VirtualAddress vaddr)
+{
+    auto* region = process.address_space().find_region_containing({ vaddr, PAGE_SIZE });
+    if (!region || region->is_shared() || !region->vmobject().is_anonymous())
+        return {};
+
+    size_t page_index = region->page_index_from_address(vaddr);
+    RefPtr<Memory::PhysicalPage> page = region->physical_page_slot(page_index);
+    if (!page || page->is_shared_zero_page() || page->is_lazy_committed_page())
+        return {};
+
+    // The pipe now shares the page, so the owner's next write has to copy it instead of changing queued data.
+    region->set_should_cow(page_index, true);
+    if (!region->remap_vmobject_page(region->first_page_index() + page_index))
+        return {};
+    return page;
+}
+
+void FIFO::did_write(bool was_empty)
+{
+    // Readers only ever wait for an empty pipe, so only the transition out of empty needs a wakeup.
+    if (was_empty)
+        evaluate_block_conditions();
 }
 
 KResultOr<size_t> FIFO::read(FileDescription&, u64, UserOrKernelBuffer& buffer, size_t size)
 {
-    if (!m_writers && m_buffer->is_empty())
+    MutexLocker locker(m_buffer_lock);
+    if (!m_bytes_buffered)
         return 0;
-    return m_buffer->read(buffer, size);
+
+    size_t space_before = space_for_writing();
+    size_t nread = 0;
+    while (nread < size && m_segment_count) {
+        auto& segment = segment_at(0);
+        size_t chunk = min(size - nread, static_cast<size_t>(segment.length));
+        auto buffer_offset = buffer.offset(nread);
+        if (!Memory::copy_from_page(*segment.page, segment.offset, buffer_offset, chunk)) {
+            if (nread)
+                break;
+            return EFAULT;
+        }
+        segment.offset += chunk;
+        segment.length -= chunk;
+        m_bytes_buffered -= chunk;
+        nread += chunk;
+        if (!segment.length)
+            drop_first_segment();
+    }
+
+    // Writers are woken in batches, once at least half of the pipe has drained.
+    size_t wake_threshold = capacity() / 2;
+    bool should_wake_writers = space_before < wake_threshold && space_for_writing() >= wake_threshold;
+    locker.unlock();
+    if (should_wake_writers)
+        evaluate_block_conditions();
+    return nread;
+}
+
+KResultOr<size_t> FIFO::write_locked(const UserOrKernelBuffer& buffer, size_t size)
+{
+    VERIFY(m_buffer_lock.is_locked());
+    size_t nwritten = 0;
+    while (nwritten < size) {
+        auto* segment = writable_tail_segment();
+        if (!segment) {
+            if (m_segment_count == m_slot_count)
+                break;
+            auto page = take_page();
+            if (!page)
+                break;
+            append_segment({ move(page), 0, 0, false });
+            segment = &segment_at(m_segment_count - 1);
+        }
+
+        size_t segment_end = segment->offset + segment->length;
+        size_t chunk = min(size - nwritten, PAGE_SIZE - segment_end);
+        if (!Memory::copy_to_page(*segment->page, segment_end, buffer.offset(nwritten), chunk)) {
+            if (nwritten)
+                break;
+            return EFAULT;
+        }
+        segment->length += chunk;
+        m_bytes_buffered += chunk;
+        nwritten += chunk;
+    }
+    if (!nwritten && size)
+        return m_segment_count == m_slot_count ? EAGAIN : ENOMEM;
+    return nwritten;
 }
 
 KResultOr<size_t> FIFO::write(FileDescription&, u64, const UserOrKernelBuffer& buffer, size_t size)
@@ -145,7 +300,59 @@ KResultOr<size_t> FIFO::write(FileDescription&, u64, const UserOrKernelBuffer& b
         return EPIPE;
     }
 
-    return m_buffer->write(buffer, size);
+    MutexLocker locker(m_buffer_lock);
+    bool was_empty = !m_bytes_buffered;
+    auto result = write_locked(buffer, size);
+    locker.unlock();
+    did_write(was_empty);
+    return result;
+}
+
+KResultOr<size_t> FIFO::splice_user_pages(Process& process, VirtualAddress address, size_t size)
+{
+    if (!m_readers) {
+        Thread::current()->send_signal(SIGPIPE, Process::current());
+        return EPIPE;
+    }
+
+    MutexLocker locker(m_buffer_lock);
+    bool was_empty = !m_bytes_buffered;
+    size_t nspliced = 0;
+    KResult error = KSuccess;
+    while (nspliced < size) {
+        auto vaddr = address.offset(nspliced);
+        size_t remaining = size - nspliced;
+
+        if (vaddr.is_page_aligned() && remaining >= PAGE_SIZE && m_segment_count < m_slot_count) {
+            if (auto page = take_user_page_reference(process, vaddr)) {
+                append_segment({ move(page), 0, PAGE_SIZE, true });
+                nspliced += PAGE_SIZE;
+                continue;
+            }
+        }
+
+        // Partial or unshareable pages are copied like a regular write.
+        size_t chunk = min(remaining, PAGE_SIZE - (vaddr.get() % PAGE_SIZE));
+        auto buffer = UserOrKernelBuffer::for_user_buffer(vaddr.as_ptr(), chunk);
+        if (!buffer.has_value()) {
+            error = EFAULT;
+            break;
+        }
+        auto nwritten_or_error = write_locked(buffer.value(), chunk);
+        if (nwritten_or_error.is_error()) {
+            error = nwritten_or_error.error();
+            break;
+        }
+        nspliced += nwritten_or_error.value();
+        if (nwritten_or_error.value() < chunk)
+            break;
+    }
+    locker.unlock();
+    did_write(was_empty);
+
+    if (!nspliced && error.is_error())
+        return error;
+    return nspliced;
 }
 
 String FIFO::absolute_path(const FileDescription&) const
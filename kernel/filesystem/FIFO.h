@@ -7,9 +7,10 @@
 #pragma once
 
 // includes
-#include <kernel/DoubleBuffer.h>
+#include <base/Vector.h>
 #include <kernel/filesystem/File.h>
 #include <kernel/locking/Mutex.h>
+#include <kernel/memory/PhysicalPage.h>
 #include <kernel/UnixTypes.h>
 #include <kernel/WaitQueue.h>
 
@@ -25,11 +26,20 @@ public:
         Writer
     };
 
+    static constexpr size_t default_capacity = 64 * KiB;
+    static constexpr size_t max_capacity = 1 * MiB;
+
     static RefPtr<FIFO> try_create(uid_t);
     virtual ~FIFO() override;
 
     uid_t uid() const { return m_uid; }
 
+    size_t capacity() const { return m_slot_count * PAGE_SIZE; }
+    KResultOr<size_t> set_capacity(size_t);
+    size_t space_for_writing() const;
+
+    KResultOr<size_t> splice_user_pages(Process&, VirtualAddress, size_t);
+
     KResultOr<NonnullRefPtr<FileDescription>> open_direction(Direction);
     KResultOr<NonnullRefPtr<FileDescription>> open_direction_blocking(Direction);
 
@@ -50,11 +60,35 @@ private:
     virtual StringView class_name() const override { return "FIFO"; }
     virtual bool is_fifo() const override { return true; }
 
-    explicit FIFO(uid_t, NonnullOwnPtr<DoubleBuffer> buffer);
+    struct Segment {
+        RefPtr<Memory::PhysicalPage> page;
+        u32 offset { 0 };
+        u32 length { 0 };
+        bool gifted { false };
+    };
+
+    FIFO(uid_t, Vector<Segment>&& segments);
+
+    Segment& segment_at(size_t index) { return m_segments[(m_first_segment + index) % m_slot_count]; }
+    Segment* writable_tail_segment();
+    void append_segment(Segment&&);
+    void drop_first_segment();
+    RefPtr<Memory::PhysicalPage> take_page();
+    RefPtr<Memory::PhysicalPage> take_user_page_reference(Process&, VirtualAddress);
+
+    KResultOr<size_t> write_locked(const UserOrKernelBuffer&, size_t);
+    void did_write(bool was_empty);
 
     unsigned m_writers { 0 };
     unsigned m_readers { 0 };
-    NonnullOwnPtr<DoubleBuffer> m_buffer;
+
+    Mutex m_buffer_lock;
+    Vector<Segment> m_segments;
+    size_t m_slot_count { 0 };
+    size_t m_first_segment { 0 };
+    size_t m_segment_count { 0 };
+    size_t m_bytes_buffered { 0 };
+    RefPtr<Memory::PhysicalPage> m_spare_page;
 
     uid_t m_uid { 0 };
 
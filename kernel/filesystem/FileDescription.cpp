@@ -15,6 +15,7 @@
 #include <kernel/filesystem/FileSystem.h>
 #include <kernel/filesystem/InodeFile.h>
 #include <kernel/filesystem/InodeWatcher.h>
+#include <kernel/filesystem/IORing.h>
 #include <kernel/memory/MemoryManager.h>
 #include <kernel/net/Socket.h>
 #include <kernel/Process.h>
@@ -153,6 +154,8 @@ KResultOr<off_t> FileDescription::seek(off_t offset, int whence)
 
 
     m_current_offset = new_offset;
+    if (m_is_directory)
+        m_directory_cursor = new_offset;
 
     m_file->did_seek(*this, new_offset);
     if (m_inode)
@@ -203,6 +206,114 @@ KResultOr<size_t> FileDescription::write(const UserOrKernelBuffer& data, size_t
     return nwritten_or_error;
 }
 
+KResultOr<size_t> FileDescription::transfer_to(FileDescription& destination, size_t count, Optional<u64> source_offset, Optional<u64> destination_offset)
+{
+    static constexpr size_t transfer_chunk_size = 64 * KiB;
+
+    if (!is_readable() || !destination.is_writable())
+        return EBADF;
+    if (is_directory() || destination.is_directory())
+        return EISDIR;
+    if ((source_offset.has_value() && !m_file->is_seekable()) || (destination_offset.has_value() && !destination.file().is_seekable()))
+        return ESPIPE;
+    if (count == 0)
+        return 0;
+
+    auto bounce = KBuffer::try_create_with_size(min(count, transfer_chunk_size), Memory::Region::Access::ReadWrite, "FileDescription: Transfer buffer");
+    if (!bounce)
+        return ENOMEM;
+    auto bounce_buffer = UserOrKernelBuffer::for_kernel_buffer(bounce->data());
+
+    size_t ntransferred = 0;
+    while (ntransferred < count) {
+        // Wait for the destination before reading anything: bytes taken from a
+        // non-seekable source such as a pipe cannot be handed back afterwards.
+        if (!destination.can_write()) {
+            if (ntransferred > 0)
+                break;
+            if (!destination.is_blocking())
+                return EAGAIN;
+            auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
+            if (Thread::current()->block<Thread::WriteBlocker>({}, destination, unblock_flags).was_interrupted())
+                return EINTR;
+            continue;
+        }
+
+        if (!can_read()) {
+            if (ntransferred > 0)
+                break;
+            if (!is_blocking())
+                return EAGAIN;
+            auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
+            if (Thread::current()->block<Thread::ReadBlocker>({}, *this, unblock_flags).was_interrupted())
+                return EINTR;
+        }
+
+        size_t chunk_size = min(count - ntransferred, bounce->size());
+        bool source_is_seekable = m_file->is_seekable();
+        if (!source_is_seekable && destination.is_fifo()) {
+            // Only take as much out of the source as the pipe can hold right now.
+            // A full pipe that is still writable has lost its readers, and the
+            // write below fails with EPIPE either way.
+            size_t space = destination.fifo()->space_for_writing();
+            if (space == 0 && !destination.can_write())
+                continue;
+            if (space > 0)
+                chunk_size = min(chunk_size, space);
+        }
+
+        auto nread_or_error = source_offset.has_value()
+            ? read(bounce_buffer, source_offset.value() + ntransferred, chunk_size)
+            : read(bounce_buffer, chunk_size);
+        if (nread_or_error.is_error()) {
+            if (ntransferred > 0)
+                break;
+            return nread_or_error.error();
+        }
+        size_t nread = nread_or_error.value();
+        if (nread == 0)
+            break;
+
+        size_t nwritten = 0;
+        while (nwritten < nread) {
+            if (!destination.can_write()) {
+                // Once bytes have been consumed from a non-seekable source,
+                // finish delivering them even to a non-blocking destination.
+                if (!destination.is_blocking() && source_is_seekable)
+                    break;
+                auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
+                if (Thread::current()->block<Thread::WriteBlocker>({}, destination, unblock_flags).was_interrupted())
+                    break;
+            }
+            auto data = bounce_buffer.offset(nwritten);
+            auto nwritten_or_error = destination_offset.has_value()
+                ? destination.write(destination_offset.value() + ntransferred + nwritten, data, nread - nwritten)
+                : destination.write(data, nread - nwritten);
+            if (nwritten_or_error.is_error()) {
+                if (ntransferred + nwritten > 0)
+                    break;
+                return nwritten_or_error.error();
+            }
+            if (nwritten_or_error.value() == 0)
+                break;
+            nwritten += nwritten_or_error.value();
+        }
+        ntransferred += nwritten;
+
+        if (nwritten < nread) {
+            // Hand back what was read but could not be written, when the source allows it.
+            if (!source_offset.has_value() && source_is_seekable)
+                (void)seek(-static_cast<off_t>(nread - nwritten), SEEK_CUR);
+            if (ntransferred == 0)
+                return EAGAIN;
+            break;
+        }
+        if (nread < chunk_size && source_is_seekable)
+            break;
+    }
+    return ntransferred;
+}
+
 bool FileDescription::can_write() const
 {
     return m_file->can_write(*this, offset());
@@ -222,7 +333,7 @@ KResultOr<NonnullOwnPtr<KBuffer>> FileDescription::read_entire_file()
 
 KResultOr<size_t> FileDescription::get_dir_entries(UserOrKernelBuffer& output_buffer, size_t size)
 {
-    MutexLocker locker(m_lock, Mutex::Mode::Shared);
+    MutexLocker locker(m_lock);
     if (!is_directory())
         return ENOTDIR;
 
@@ -235,29 +346,42 @@ KResultOr<size_t> FileDescription::get_dir_entries(UserOrKernelBuffer& output_bu
     u8 stack_buffer[PAGE_SIZE];
     Bytes temp_buffer(stack_buffer, sizeof(stack_buffer));
     OutputMemoryStream stream { temp_buffer };
+    u64 cursor = m_directory_cursor;
+    u64 stream_cursor = cursor;
 
-    auto flush_stream_to_output_buffer = [&error, &stream, &remaining, &output_buffer]() -> bool {
+    auto flush_stream_to_output_buffer = [&error, &stream, &remaining, &output_buffer, &cursor, &stream_cursor]() -> bool {
         if (error != 0)
             return false;
         if (stream.size() == 0)
             return true;
-        if (remaining < stream.size()) {
-            error = EINVAL;
-            return false;
-        } else if (!output_buffer.write(stream.bytes())) {
+        VERIFY(remaining >= stream.size());
+        if (!output_buffer.write(stream.bytes())) {
             error = EFAULT;
             return false;
         }
         output_buffer = output_buffer.offset(stream.size());
         remaining -= stream.size();
+        cursor = stream_cursor;
         stream.reset();
         return true;
     };
 
-    KResult result = VirtualFileSystem::the().traverse_directory_inode(*m_inode, [&flush_stream_to_output_buffer, &stream, this](auto& entry) {
-        size_t serialized_size = sizeof(ino_t) + sizeof(u8) + sizeof(size_t) + sizeof(char) * entry.name.length();
+    bool stopped = false;
+    KResult result = VirtualFileSystem::the().traverse_directory_inode(*m_inode, cursor, [&](auto& entry) {
+        // Once an entry has been rejected, later (possibly shorter) entries
+        // must not be emitted, or the cursor would skip the rejected one.
+        if (stopped)
+            return false;
+        size_t serialized_size = sizeof(u32) + sizeof(u8) + sizeof(u32) + sizeof(char) * entry.name.length();
+        if (serialized_size > remaining - stream.size()) {
+            if (remaining == size && stream.size() == 0)
+                error = EINVAL;
+            stopped = true;
+            return false;
+        }
         if (serialized_size > stream.remaining()) {
             if (!flush_stream_to_output_buffer()) {
+                stopped = true;
                 return false;
             }
         }
@@ -265,17 +389,21 @@ KResultOr<size_t> FileDescription::get_dir_entries(UserOrKernelBuffer& output_bu
         stream << m_inode->fs().internal_file_type_to_directory_entry_type(entry);
         stream << (u32)entry.name.length();
         stream << entry.name.bytes();
+        stream_cursor = entry.next_cookie;
         return true;
     });
     flush_stream_to_output_buffer();
 
+    m_directory_cursor = cursor;
+    m_current_offset = static_cast<off_t>(cursor);
+
     if (result.is_error()) {
 
         VERIFY(result != -EFAULT);
         return result;
     }
 
-    if (error) {
+    if (error && remaining == size) {
         return error;
     }
     return size - remaining;
@@ -338,6 +466,18 @@ InodeWatcher* FileDescription::inode_watcher()
     return static_cast<InodeWatcher*>(m_file.ptr());
 }
 
+bool FileDescription::is_io_ring() const
+{
+    return m_file->is_io_ring();
+}
+
+IORing* FileDescription::io_ring()
+{
+    if (!is_io_ring())
+        return nullptr;
+    return static_cast<IORing*>(m_file.ptr());
+}
+
 bool FileDescription::is_master_pty() const
 {
     return m_file->is_master_pty();
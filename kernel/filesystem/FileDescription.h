@@ -55,6 +55,8 @@ public:
     KResultOr<size_t> read(UserOrKernelBuffer&, u64 offset, size_t);
     KResultOr<size_t> write(u64 offset, UserOrKernelBuffer const&, size_t);
 
+    KResultOr<size_t> transfer_to(FileDescription& destination, size_t count, Optional<u64> source_offset = {}, Optional<u64> destination_offset = {});
+
     KResult chmod(mode_t);
 
     bool can_read() const;
@@ -85,6 +87,9 @@ public:
     const InodeWatcher* inode_watcher() const;
     InodeWatcher* inode_watcher();
 
+    bool is_io_ring() const;
+    IORing* io_ring();
+
     bool is_master_pty() const;
     const MasterPTY* master_pty() const;
     MasterPTY* master_pty();
@@ -146,6 +151,7 @@ private:
     NonnullRefPtr<File> m_file;
 
     off_t m_current_offset { 0 };
+    u64 m_directory_cursor { 0 };
 
     OwnPtr<FileDescriptionData> m_data;
 
@@ -11,6 +11,7 @@
 #include <kernel/arch/x86/InterruptDisabler.h>
 #include <kernel/filesystem/FileSystem.h>
 #include <kernel/filesystem/Inode.h>
+#include <kernel/filesystem/InodeCache.h>
 #include <kernel/memory/MemoryManager.h>
 #include <kernel/net/LocalSocket.h>
 
@@ -25,7 +26,8 @@ static HashMap<u32, FileSystem*>& all_file_systems()
 }
 
 FileSystem::FileSystem()
-    : m_fsid(++s_lastFileSystemID)
+    : m_inode_cache(make<InodeCache>())
+    , m_fsid(++s_lastFileSystemID)
 {
     s_file_system_map->set(m_fsid, this);
 }
@@ -43,17 +45,16 @@ FileSystem* FileSystem::from_fsid(u32 id)
     return nullptr;
 }
 
-FileSystem::DirectoryEntryView::DirectoryEntryView(const StringView& n, InodeIdentifier i, u8 ft)
+FileSystem::DirectoryEntryView::DirectoryEntryView(const StringView& n, InodeIdentifier i, u8 ft, u64 nc)
     : name(n)
     , inode(i)
     , file_type(ft)
+    , next_cookie(nc)
 {
 }
 
 void FileSystem::sync()
 {
-    Inode::sync();
-
     NonnullRefPtrVector<FileSystem, 32> file_systems;
     {
         InterruptDisabler disabler;
@@ -61,10 +62,30 @@ void FileSystem::sync()
             file_systems.append(*it.value);
     }
 
+    for (auto& fs : file_systems)
+        fs.flush_dirty_inodes();
+
     for (auto& fs : file_systems)
         fs.flush_writes();
 }
 
+void FileSystem::flush_dirty_inodes()
+{
+    if (!m_inode_cache->has_dirty_inodes())
+        return;
+
+    NonnullRefPtrVector<Inode, 32> inodes;
+    m_inode_cache->for_each_dirty([&](Inode& inode) {
+        if (inode.try_ref())
+            inodes.append(adopt_ref(inode));
+    });
+
+    for (auto& inode : inodes) {
+        if (inode.is_metadata_dirty())
+            inode.flush_metadata();
+    }
+}
+
 void FileSystem::lock_all()
 {
     for (auto& it : all_file_systems()) {
@@ -7,6 +7,7 @@
 #pragma once
 
 // includes
+#include <base/NonnullOwnPtr.h>
 #include <base/RefCounted.h>
 #include <base/RefPtr.h>
 #include <base/StringView.h>
@@ -19,6 +20,8 @@
 
 namespace Kernel {
 
+class InodeCache;
+
 static constexpr u32 mepoch = 476763780;
 
 class FileSystem : public RefCounted<FileSystem> {
@@ -36,6 +39,7 @@ public:
     virtual StringView class_name() const = 0;
     virtual Inode& root_inode() = 0;
     virtual bool supports_watchers() const { return false; }
+    virtual bool can_cache_link_targets() const { return false; }
 
     bool is_readonly() const { return m_readonly; }
 
@@ -47,15 +51,19 @@ public:
     virtual KResult prepare_to_unmount() { return KSuccess; }
 
     struct DirectoryEntryView {
-        DirectoryEntryView(const StringView& name, InodeIdentifier, u8 file_type);
+        DirectoryEntryView(const StringView& name, InodeIdentifier, u8 file_type, u64 next_cookie = 0);
 
         StringView name;
         InodeIdentifier inode;
         u8 file_type { 0 };
+        u64 next_cookie { 0 };
     };
 
     virtual void flush_writes() { }
 
+    InodeCache& inode_cache() { return *m_inode_cache; }
+    InodeCache const& inode_cache() const { return *m_inode_cache; }
+
     u64 block_size() const { return m_block_size; }
     size_t fragment_size() const { return m_fragment_size; }
 
@@ -72,6 +80,9 @@ protected:
     mutable Mutex m_lock { "FS" };
 
 private:
+    void flush_dirty_inodes();
+
+    NonnullOwnPtr<InodeCache> m_inode_cache;
     unsigned m_fsid { 0 };
     u64 m_block_size { 0 };
     size_t m_fragment_size { 0 };
@@ -90,7 +101,7 @@ inline const FileSystem* InodeIdentifier::fs() const
 
 }
 
-namespace AK {
+namespace Base {
 
 template<>
 struct Traits<Kernel::InodeIdentifier> : public GenericTraits<Kernel::InodeIdentifier> {
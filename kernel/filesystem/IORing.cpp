@@ -0,0 +1,455 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/NumericLimits.h>
+#include <base/ScopeGuard.h>
+#include <base/Singleton.h>
+#include <kernel/filesystem/Custody.h>
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/filesystem/FileSystem.h>
+#include <kernel/filesystem/Inode.h>
+#include <kernel/filesystem/IORing.h>
+#include <kernel/filesystem/VirtualFileSystem.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/memory/ProcessPagingScope.h>
+#include <kernel/Process.h>
+#include <kernel/WaitQueue.h>
+
+namespace Kernel {
+
+static constexpr size_t ring_alignment = 64;
+
+class IORingWorkers {
+public:
+    static constexpr size_t initial_worker_count = 4;
+    static constexpr size_t max_worker_count = 64;
+
+    IORingWorkers()
+    {
+        for (size_t i = 0; i < initial_worker_count; ++i)
+            spawn_worker();
+    }
+
+    void queue(NonnullOwnPtr<IORing::Operation> operation)
+    {
+        bool should_spawn = false;
+        {
+            ScopedSpinLock lock(m_lock);
+            m_pending.append(*operation.leak_ptr());
+            // Reads and writes may block on their description, so make sure a
+            // few stuck operations can't hold up everything queued behind them.
+            if (m_idle_count == 0 && m_worker_count < max_worker_count) {
+                ++m_worker_count;
+                should_spawn = true;
+            }
+        }
+        if (should_spawn)
+            create_worker_thread();
+        m_wait_queue.wake_one();
+    }
+
+private:
+    void spawn_worker()
+    {
+        {
+            ScopedSpinLock lock(m_lock);
+            ++m_worker_count;
+        }
+        create_worker_thread();
+    }
+
+    void create_worker_thread()
+    {
+        RefPtr<Thread> worker_thread;
+        Process::create_kernel_process(worker_thread, "IORingWorker", [this] {
+            run();
+        });
+    }
+
+    [[noreturn]] void run()
+    {
+        for (;;) {
+            IORing::Operation* operation = nullptr;
+            {
+                ScopedSpinLock lock(m_lock);
+                if (!m_pending.is_empty())
+                    operation = m_pending.take_first();
+                else
+                    ++m_idle_count;
+            }
+            if (!operation) {
+                m_wait_queue.wait_forever("IORingWorker");
+                ScopedSpinLock lock(m_lock);
+                --m_idle_count;
+                continue;
+            }
+            auto owned_operation = adopt_own(*operation);
+            owned_operation->ring->execute(*owned_operation);
+        }
+    }
+
+    SpinLock<u8> m_lock;
+    IntrusiveList<IORing::Operation, RawPtr<IORing::Operation>, &IORing::Operation::list_node> m_pending;
+    size_t m_worker_count { 0 };
+    size_t m_idle_count { 0 };
+    WaitQueue m_wait_queue;
+};
+
+static Singleton<IORingWorkers> s_workers;
+
+KResultOr<NonnullRefPtr<IORing>> IORing::create(Process& process, u32 entries)
+{
+    if (entries == 0 || entries > IORING_MAX_ENTRIES || (entries & (entries - 1)) != 0)
+        return EINVAL;
+
+    u32 completion_entries = entries * 2;
+    size_t submissions_offset = round_up_to_power_of_two(sizeof(IORingHeader), ring_alignment);
+    size_t completions_offset = round_up_to_power_of_two(submissions_offset + entries * sizeof(IORingSubmission), ring_alignment);
+    size_t mapping_size = Memory::page_round_up(completions_offset + completion_entries * sizeof(IORingCompletion));
+
+    auto vmobject = Memory::AnonymousVMObject::try_create_with_size(mapping_size, AllocationStrategy::AllocateNow);
+    if (!vmobject)
+        return ENOMEM;
+    auto kernel_region = MM.allocate_kernel_region_with_vmobject(*vmobject, mapping_size, "IORing", Memory::Region::Access::ReadWrite);
+    if (!kernel_region)
+        return ENOMEM;
+
+    auto ring = adopt_ref_if_nonnull(new (nothrow) IORing(process, vmobject.release_nonnull(), kernel_region.release_nonnull(), entries, mapping_size));
+    if (!ring)
+        return ENOMEM;
+    return ring.release_nonnull();
+}
+
+IORing::IORing(Process& process, NonnullRefPtr<Memory::AnonymousVMObject> vmobject, NonnullOwnPtr<Memory::Region> kernel_region, u32 entries, u32 mapping_size)
+    : m_process(process)
+    , m_vmobject(move(vmobject))
+    , m_kernel_region(move(kernel_region))
+    , m_entries(entries)
+    , m_completion_entries(entries * 2)
+    , m_mapping_size(mapping_size)
+{
+    m_submissions_offset = round_up_to_power_of_two(sizeof(IORingHeader), ring_alignment);
+    m_completions_offset = round_up_to_power_of_two(m_submissions_offset + entries * sizeof(IORingSubmission), ring_alignment);
+
+    auto& ring_header = header();
+    ring_header.submission_head = 0;
+    ring_header.submission_tail = 0;
+    ring_header.submission_mask = m_entries - 1;
+    ring_header.submission_entries = m_entries;
+    ring_header.completion_head = 0;
+    ring_header.completion_tail = 0;
+    ring_header.completion_mask = m_completion_entries - 1;
+    ring_header.completion_entries = m_completion_entries;
+    ring_header.completion_overflow = 0;
+    ring_header.submissions_offset = m_submissions_offset;
+    ring_header.completions_offset = m_completions_offset;
+    ring_header.mapping_size = m_mapping_size;
+}
+
+IORing::~IORing()
+{
+}
+
+KResult IORing::close()
+{
+    // The submitting process keeps this ring alive through its descriptor
+    // table, so drop our reference back to it once the last descriptor goes.
+    m_process = nullptr;
+    return KSuccess;
+}
+
+KResultOr<Memory::Region*> IORing::mmap(Process& process, FileDescription&, Memory::VirtualRange const& range, u64 offset, int prot, bool shared)
+{
+    if (offset != 0 || !shared)
+        return EINVAL;
+    if (range.size() != m_mapping_size)
+        return EINVAL;
+    return process.address_space().allocate_region_with_vmobject(range, m_vmobject, offset, {}, prot, shared);
+}
+
+u32 IORing::completions_available() const
+{
+    u32 head = Base::atomic_load(&header().completion_head, Base::MemoryOrder::memory_order_acquire);
+    return min(m_completion_tail - head, m_completion_entries);
+}
+
+bool IORing::can_read(const FileDescription&, size_t) const
+{
+    ScopedSpinLock lock(m_completion_lock);
+    return completions_available() >= max(1u, m_completion_threshold.load());
+}
+
+KResultOr<u32> IORing::submit(u32 count)
+{
+    MutexLocker locker(m_submission_lock);
+    // Descriptors, paths and buffers in a submission all refer to the process that created
+    // the ring, so a forked child or a process that was passed the ring can't submit to it.
+    if (!m_process || Process::current() != m_process.ptr())
+        return EPERM;
+    auto& ring_header = header();
+    u32 tail = Base::atomic_load(&ring_header.submission_tail, Base::MemoryOrder::memory_order_acquire);
+    if (tail - m_submission_head > m_entries)
+        return EINVAL;
+
+    u32 submitted = 0;
+    while (submitted < count && m_submission_head != tail) {
+        {
+            // Every operation in flight owns a completion slot, so the completion ring never overflows.
+            ScopedSpinLock lock(m_completion_lock);
+            if (m_in_flight + completions_available() >= m_completion_entries)
+                break;
+            ++m_in_flight;
+        }
+
+        IORingSubmission submission = submissions()[m_submission_head & (m_entries - 1)];
+        ++m_submission_head;
+        Base::atomic_store(&ring_header.submission_head, m_submission_head, Base::MemoryOrder::memory_order_release);
+        ++submitted;
+
+        switch (submission.opcode) {
+        case IORingOpcode::Nop:
+            post_completion(submission.user_data, 0);
+            break;
+        case IORingOpcode::Open:
+        case IORingOpcode::Stat:
+            post_completion(submission.user_data, complete_inline(submission));
+            break;
+        case IORingOpcode::Read:
+        case IORingOpcode::Write:
+        case IORingOpcode::Fsync: {
+            auto description = m_process->fds().file_description(submission.fd);
+            if (!description) {
+                post_completion(submission.user_data, -EBADF);
+                break;
+            }
+            auto operation = adopt_own_if_nonnull(new (nothrow) Operation { *this, *m_process, submission, move(description), {} });
+            if (!operation) {
+                post_completion(submission.user_data, -ENOMEM);
+                break;
+            }
+            s_workers->queue(operation.release_nonnull());
+            break;
+        }
+        default:
+            post_completion(submission.user_data, -EINVAL);
+            break;
+        }
+    }
+
+    if (submitted == 0 && count > 0 && m_submission_head != tail)
+        return EBUSY;
+    return submitted;
+}
+
+KResult IORing::wait_for_completions(FileDescription& description, u32 count)
+{
+    {
+        ScopedSpinLock lock(m_completion_lock);
+        count = min(count, completions_available() + m_in_flight);
+    }
+    if (count == 0)
+        return KSuccess;
+
+    m_completion_threshold = count;
+    ScopeGuard reset_threshold([&] {
+        m_completion_threshold = 1;
+    });
+
+    auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
+    if (Thread::current()->block<Thread::ReadBlocker>({}, description, unblock_flags).was_interrupted())
+        return EINTR;
+    return KSuccess;
+}
+
+void IORing::post_completion(u64 user_data, i64 result)
+{
+    {
+        ScopedSpinLock lock(m_completion_lock);
+        VERIFY(m_in_flight > 0);
+        --m_in_flight;
+
+        auto& ring_header = header();
+        u32 head = Base::atomic_load(&ring_header.completion_head, Base::MemoryOrder::memory_order_acquire);
+        if (m_completion_tail - head >= m_completion_entries) {
+            Base::atomic_fetch_add(&ring_header.completion_overflow, 1u, Base::MemoryOrder::memory_order_release);
+        } else {
+            auto& completion = completions()[m_completion_tail & (m_completion_entries - 1)];
+            completion.user_data = user_data;
+            completion.result = result;
+            ++m_completion_tail;
+            Base::atomic_store(&ring_header.completion_tail, m_completion_tail, Base::MemoryOrder::memory_order_release);
+        }
+    }
+    evaluate_block_conditions();
+}
+
+void IORing::execute(Operation& operation)
+{
+    i64 result = 0;
+    {
+        ProcessPagingScope paging_scope(operation.process);
+        switch (operation.submission.opcode) {
+        case IORingOpcode::Read:
+        case IORingOpcode::Write: {
+            auto nbytes_or_error = do_read_or_write(operation);
+            result = nbytes_or_error.is_error() ? nbytes_or_error.error() : static_cast<i64>(nbytes_or_error.value());
+            break;
+        }
+        case IORingOpcode::Fsync:
+            result = do_fsync(operation).error();
+            break;
+        default:
+            VERIFY_NOT_REACHED();
+        }
+    }
+    operation.description = nullptr;
+    post_completion(operation.submission.user_data, result);
+}
+
+KResultOr<size_t> IORing::do_read_or_write(Operation& operation)
+{
+    auto& submission = operation.submission;
+    auto& description = *operation.description;
+    if (submission.length > static_cast<u64>(NumericLimits<ssize_t>::max()))
+        return EINVAL;
+    if (submission.offset < 0 && submission.offset != IORING_CURRENT_OFFSET)
+        return EINVAL;
+    if (description.is_directory())
+        return EISDIR;
+
+    auto buffer = UserOrKernelBuffer::for_user_buffer(reinterpret_cast<u8*>(submission.buffer), submission.length);
+    if (!buffer.has_value())
+        return EFAULT;
+
+    bool use_current_offset = submission.offset == IORING_CURRENT_OFFSET;
+    if (!use_current_offset && !description.file().is_seekable())
+        return ESPIPE;
+
+    if (submission.opcode == IORingOpcode::Read) {
+        if (!description.is_readable())
+            return EBADF;
+        if (!description.can_read()) {
+            if (!description.is_blocking())
+                return EAGAIN;
+            auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
+            if (Thread::current()->block<Thread::ReadBlocker>({}, description, unblock_flags).was_interrupted())
+                return EINTR;
+        }
+        if (use_current_offset)
+            return description.read(buffer.value(), submission.length);
+        return description.read(buffer.value(), submission.offset, submission.length);
+    }
+
+    if (!description.is_writable())
+        return EBADF;
+    if (!description.can_write()) {
+        if (!description.is_blocking())
+            return EAGAIN;
+        auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
+        if (Thread::current()->block<Thread::WriteBlocker>({}, description, unblock_flags).was_interrupted())
+            return EINTR;
+    }
+    if (use_current_offset)
+        return description.write(buffer.value(), submission.length);
+    return description.write(submission.offset, buffer.value(), submission.length);
+}
+
+KResult IORing::do_fsync(Operation& operation)
+{
+    auto* inode = operation.description->inode();
+    if (!inode)
+        return EINVAL;
+    inode->flush_metadata();
+    inode->fs().flush_writes();
+    return KSuccess;
+}
+
+i64 IORing::complete_inline(IORingSubmission const& submission)
+{
+    // Path resolution needs the submitter's credentials, veil and descriptor table, so these run in the submitting thread.
+    if (!m_process || Process::current() != m_process.ptr())
+        return -EPERM;
+    if (submission.opcode == IORingOpcode::Open) {
+        auto fd_or_error = do_open(submission);
+        return fd_or_error.is_error() ? fd_or_error.error() : fd_or_error.value();
+    }
+    return do_stat(submission).error();
+}
+
+KResultOr<NonnullRefPtr<Custody>> IORing::base_custody_for(int dirfd)
+{
+    if (dirfd == AT_FDCWD)
+        return m_process->current_directory();
+
+    auto base_description = m_process->fds().file_description(dirfd);
+    if (!base_description)
+        return EBADF;
+    if (!base_description->is_directory())
+        return ENOTDIR;
+    if (!base_description->custody())
+        return EINVAL;
+    return NonnullRefPtr<Custody>(*base_description->custody());
+}
+
+KResultOr<int> IORing::do_open(IORingSubmission const& submission)
+{
+    int options = submission.options;
+    if (options & O_NOFOLLOW_NOERROR)
+        return EINVAL;
+    if (options & O_UNLINK_INTERNAL)
+        return EINVAL;
+
+    auto path = m_process->get_syscall_path_argument(reinterpret_cast<char const*>(submission.path), submission.path_length);
+    if (path.is_error())
+        return path.error();
+
+    auto base_or_error = base_custody_for(submission.fd);
+    if (base_or_error.is_error())
+        return base_or_error.error();
+
+    auto fd_or_error = m_process->fds().allocate();
+    if (fd_or_error.is_error())
+        return fd_or_error.error();
+    auto new_fd = fd_or_error.release_value();
+
+    auto description_or_error = VirtualFileSystem::the().open(path.value()->view(), options, submission.mode & ~m_process->umask(), *base_or_error.value());
+    if (description_or_error.is_error())
+        return description_or_error.error();
+
+    auto description = description_or_error.release_value();
+    if (description->inode() && description->inode()->socket())
+        return ENXIO;
+
+    u32 fd_flags = (options & O_CLOEXEC) ? FD_CLOEXEC : 0;
+    m_process->fds()[new_fd.fd].set(move(description), fd_flags);
+    return new_fd.fd;
+}
+
+KResult IORing::do_stat(IORingSubmission const& submission)
+{
+    auto path = m_process->get_syscall_path_argument(reinterpret_cast<char const*>(submission.path), submission.path_length);
+    if (path.is_error())
+        return path.error();
+
+    auto base_or_error = base_custody_for(submission.fd);
+    if (base_or_error.is_error())
+        return base_or_error.error();
+
+    auto metadata_or_error = VirtualFileSystem::the().lookup_metadata(path.value()->view(), *base_or_error.value(), submission.options);
+    if (metadata_or_error.is_error())
+        return metadata_or_error.error();
+
+    stat statbuf;
+    auto result = metadata_or_error.value().stat(statbuf);
+    if (result.is_error())
+        return result;
+    if (!copy_to_user(reinterpret_cast<stat*>(submission.buffer), &statbuf))
+        return EFAULT;
+    return KSuccess;
+}
+
+}
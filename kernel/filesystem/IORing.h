@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/IntrusiveList.h>
+#include <base/NonnullOwnPtr.h>
+#include <kernel/api/IORing.h>
+#include <kernel/filesystem/File.h>
+#include <kernel/Forward.h>
+#include <kernel/memory/AnonymousVMObject.h>
+#include <kernel/memory/Region.h>
+
+namespace Kernel {
+
+class IORing final : public File {
+public:
+    static KResultOr<NonnullRefPtr<IORing>> create(Process&, u32 entries);
+    virtual ~IORing() override;
+
+    KResultOr<u32> submit(u32 count);
+    KResult wait_for_completions(FileDescription&, u32 count);
+
+    u32 mapping_size() const { return m_mapping_size; }
+
+    virtual KResult close() override;
+    virtual bool can_read(const FileDescription&, size_t) const override;
+    virtual bool can_write(const FileDescription&, size_t) const override { return false; }
+    virtual KResultOr<size_t> read(FileDescription&, u64, UserOrKernelBuffer&, size_t) override { return ENOTSUP; }
+    virtual KResultOr<size_t> write(FileDescription&, u64, const UserOrKernelBuffer&, size_t) override { return ENOTSUP; }
+    virtual KResultOr<Memory::Region*> mmap(Process&, FileDescription&, Memory::VirtualRange const&, u64 offset, int prot, bool shared) override;
+
+    virtual String absolute_path(const FileDescription&) const override { return ":io-ring:"; }
+    virtual StringView class_name() const override { return "IORing"; }
+    virtual bool is_io_ring() const override { return true; }
+
+    struct Operation {
+        NonnullRefPtr<IORing> ring;
+        NonnullRefPtr<Process> process;
+        IORingSubmission submission;
+        RefPtr<FileDescription> description;
+        IntrusiveListNode<Operation> list_node;
+    };
+
+    void execute(Operation&);
+
+private:
+    IORing(Process&, NonnullRefPtr<Memory::AnonymousVMObject>, NonnullOwnPtr<Memory::Region>, u32 entries, u32 mapping_size);
+
+    IORingHeader& header() const { return *reinterpret_cast<IORingHeader*>(m_kernel_region->vaddr().as_ptr()); }
+    IORingSubmission* submissions() const { return reinterpret_cast<IORingSubmission*>(m_kernel_region->vaddr().offset(m_submissions_offset).as_ptr()); }
+    IORingCompletion* completions() const { return reinterpret_cast<IORingCompletion*>(m_kernel_region->vaddr().offset(m_completions_offset).as_ptr()); }
+
+    u32 completions_available() const;
+    void post_completion(u64 user_data, i64 result);
+    i64 complete_inline(IORingSubmission const&);
+
+    KResultOr<size_t> do_read_or_write(Operation&);
+    KResult do_fsync(Operation&);
+    KResultOr<NonnullRefPtr<Custody>> base_custody_for(int dirfd);
+    KResultOr<int> do_open(IORingSubmission const&);
+    KResult do_stat(IORingSubmission const&);
+
+    RefPtr<Process> m_process;
+    NonnullRefPtr<Memory::AnonymousVMObject> m_vmobject;
+    NonnullOwnPtr<Memory::Region> m_kernel_region;
+
+    u32 m_entries { 0 };
+    u32 m_completion_entries { 0 };
+    u32 m_mapping_size { 0 };
+    u32 m_submissions_offset { 0 };
+    u32 m_completions_offset { 0 };
+
+    Mutex m_submission_lock;
+    u32 m_submission_head { 0 };
+
+    mutable SpinLock<u8> m_completion_lock;
+    u32 m_completion_tail { 0 };
+    u32 m_in_flight { 0 };
+    Atomic<u32> m_completion_threshold { 1 };
+};
+
+}
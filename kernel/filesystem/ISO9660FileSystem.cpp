@@ -16,6 +16,7 @@
 #include <base/StringHash.h>
 #include <base/StringView.h>
 #include <kernel/Debug.h>
+#include <kernel/filesystem/InodeCache.h>
 #include <kernel/Forward.h>
 #include <kernel/KBuffer.h>
 #include <kernel/KResult.h>
@@ -26,7 +27,8 @@ namespace Kernel {
 
 constexpr u32 first_data_area_block = 16;
 constexpr u32 logical_sector_size = 2048;
-constexpr u32 max_cached_directory_entries = 128;
+constexpr u32 max_cached_directory_entries = 512;
+constexpr u32 max_cached_lookups = 4096;
 
 struct DirectoryState {
     RefPtr<ISO9660FS::DirectoryEntry> entry;
@@ -395,17 +397,22 @@ KResultOr<NonnullRefPtr<ISO9660FS::DirectoryEntry>> ISO9660FS::directory_entry_f
     u32 extent_location = LittleEndian { record->extent_location.little };
     u32 data_length = LittleEndian { record->data_length.little };
 
+    MutexLocker locker(m_directory_entry_cache_lock);
+
     auto key = calculate_directory_entry_cache_key(*record);
     auto it = m_directory_entry_cache.find(key);
     if (it != m_directory_entry_cache.end()) {
         dbgln_if(ISO9660_DEBUG, "Cache hit for dirent @ {}", extent_location);
+        m_directory_entry_lru.remove(*it->value);
+        m_directory_entry_lru.append(*it->value);
         return it->value;
     }
     dbgln_if(ISO9660_DEBUG, "Cache miss for dirent @ {} :^(", extent_location);
 
     if (m_directory_entry_cache.size() == max_cached_directory_entries) {
-
-        m_directory_entry_cache.remove(m_directory_entry_cache.begin());
+        auto* least_recently_used = m_directory_entry_lru.take_first();
+        VERIFY(least_recently_used);
+        m_directory_entry_cache.remove(least_recently_used->extent);
     }
 
     if (!(data_length % logical_block_size() == 0)) {
@@ -429,6 +436,7 @@ KResultOr<NonnullRefPtr<ISO9660FS::DirectoryEntry>> ISO9660FS::directory_entry_f
         return maybe_entry.error();
     }
     m_directory_entry_cache.set(key, maybe_entry.value());
+    m_directory_entry_lru.append(*maybe_entry.value());
 
     dbgln_if(ISO9660_DEBUG, "Cached dirent @ {}", extent_location);
     return maybe_entry.release_value();
@@ -439,6 +447,51 @@ u32 ISO9660FS::calculate_directory_entry_cache_key(ISO::DirectoryRecordHeader co
     return LittleEndian { record.extent_location.little };
 }
 
+u32 ISO9660FS::calculate_lookup_cache_key(InodeIndex parent, StringView name)
+{
+    return pair_int_hash(parent.value(), string_hash(name.characters_without_null_termination(), name.length()));
+}
+
+Optional<ISO::DirectoryRecordHeader> ISO9660FS::cached_lookup(InodeIndex parent, StringView name)
+{
+    MutexLocker locker(m_lookup_cache_lock);
+    auto it = m_lookup_cache.find(calculate_lookup_cache_key(parent, name));
+    if (it == m_lookup_cache.end())
+        return {};
+
+    auto& cached = *it->value;
+    if (cached.parent != parent || cached.name->view() != name)
+        return {};
+
+    m_lookup_lru.remove(cached);
+    m_lookup_lru.append(cached);
+    return cached.record;
+}
+
+void ISO9660FS::cache_lookup(InodeIndex parent, StringView name, ISO::DirectoryRecordHeader const& record)
+{
+    auto name_kstring = KString::try_create(name);
+    if (!name_kstring)
+        return;
+    auto cached = adopt_own_if_nonnull(new (nothrow) CachedLookup { parent, name_kstring.release_nonnull(), record, {} });
+    if (!cached)
+        return;
+
+    MutexLocker locker(m_lookup_cache_lock);
+    auto key = calculate_lookup_cache_key(parent, name);
+    if (auto it = m_lookup_cache.find(key); it != m_lookup_cache.end()) {
+        m_lookup_lru.remove(*it->value);
+        m_lookup_cache.remove(it);
+    } else if (m_lookup_cache.size() == max_cached_lookups) {
+        auto* least_recently_used = m_lookup_lru.take_first();
+        VERIFY(least_recently_used);
+        m_lookup_cache.remove(calculate_lookup_cache_key(least_recently_used->parent, least_recently_used->name->view()));
+    }
+
+    m_lookup_lru.append(*cached);
+    m_lookup_cache.set(key, cached.release_nonnull());
+}
+
 KResultOr<size_t> ISO9660Inode::read_bytes(off_t offset, size_t size, UserOrKernelBuffer& buffer, FileDescription*) const
 {
     MutexLocker inode_locker(m_inode_lock);
@@ -446,39 +499,56 @@ KResultOr<size_t> ISO9660Inode::read_bytes(off_t offset, size_t size, UserOrKern
     auto& file_system = const_cast<ISO9660FS&>(static_cast<ISO9660FS const&>(fs()));
     u32 data_length = LittleEndian { m_record.data_length.little };
     u32 extent_location = LittleEndian { m_record.extent_location.little };
+    size_t block_size = file_system.logical_block_size();
 
     if (static_cast<u64>(offset) >= data_length)
         return 0;
 
-    auto block = KBuffer::try_create_with_size(file_system.m_logical_block_size);
-    if (!block) {
-        return ENOMEM;
-    }
-    auto block_buffer = UserOrKernelBuffer::for_kernel_buffer(block->data());
-
     size_t total_bytes = min(size, data_length - offset);
     size_t nread = 0;
-    size_t blocks_already_read = offset / file_system.m_logical_block_size;
-    size_t initial_offset = offset % file_system.m_logical_block_size;
 
-    auto current_block_index = BlockBasedFileSystem::BlockIndex { extent_location + blocks_already_read };
     while (nread != total_bytes) {
-        size_t bytes_to_read = min(total_bytes - nread, file_system.logical_block_size() - initial_offset);
+        u64 position = offset + nread;
+        size_t remaining = total_bytes - nread;
         auto buffer_offset = buffer.offset(nread);
-        dbgln_if(ISO9660_VERY_DEBUG, "ISO9660Inode::read_bytes: Reading {} bytes into buffer offset {}/{}, logical block index: {}", bytes_to_read, nread, total_bytes, current_block_index.value());
 
-        if (bool result = file_system.raw_read(current_block_index, block_buffer); !result) {
-            return EIO;
+        if (m_readahead_buffer && position >= m_readahead_offset && position < m_readahead_offset + m_readahead_size) {
+            size_t bytes_to_copy = min(remaining, static_cast<size_t>(m_readahead_offset + m_readahead_size - position));
+            if (!buffer_offset.write(m_readahead_buffer->data() + (position - m_readahead_offset), bytes_to_copy))
+                return EFAULT;
+            nread += bytes_to_copy;
+            continue;
         }
 
-        bool result = buffer_offset.write(block->data() + initial_offset, bytes_to_read);
-        if (!result) {
-            return EFAULT;
+        // The file is a single contiguous extent, so whole blocks go straight
+        // from the device into the caller's buffer in one transfer.
+        if (position % block_size == 0 && remaining >= readahead_window) {
+            size_t block_count = min(remaining / block_size, max_blocks_per_transfer);
+            dbgln_if(ISO9660_VERY_DEBUG, "ISO9660Inode::read_bytes: Reading {} blocks directly into buffer offset {}/{}", block_count, nread, total_bytes);
+            if (!file_system.raw_read_blocks(BlockBasedFileSystem::BlockIndex { extent_location + position / block_size }, block_count, buffer_offset))
+                return EIO;
+            nread += block_count * block_size;
+            continue;
+        }
+
+        if (!m_readahead_buffer) {
+            m_readahead_buffer = KBuffer::try_create_with_size(readahead_window, Memory::Region::Access::ReadWrite, "ISO9660FS: Readahead buffer");
+            if (!m_readahead_buffer)
+                return ENOMEM;
         }
 
-        nread += bytes_to_read;
-        initial_offset = 0;
-        current_block_index = BlockBasedFileSystem::BlockIndex { current_block_index.value() + 1 };
+        u64 window_start = position - (position % block_size);
+        size_t extent_size = (data_length + block_size - 1) / block_size * block_size;
+        size_t window_blocks = min(readahead_window, static_cast<size_t>(extent_size - window_start)) / block_size;
+        dbgln_if(ISO9660_VERY_DEBUG, "ISO9660Inode::read_bytes: Reading ahead {} blocks from logical block index {}", window_blocks, extent_location + window_start / block_size);
+
+        auto readahead_buffer = UserOrKernelBuffer::for_kernel_buffer(m_readahead_buffer->data());
+        if (!file_system.raw_read_blocks(BlockBasedFileSystem::BlockIndex { extent_location + window_start / block_size }, window_blocks, readahead_buffer)) {
+            m_readahead_size = 0;
+            return EIO;
+        }
+        m_readahead_offset = window_start;
+        m_readahead_size = min(window_blocks * block_size, static_cast<size_t>(data_length - window_start));
     }
 
     return nread;
@@ -520,6 +590,16 @@ RefPtr<Inode> ISO9660Inode::lookup(StringView name)
     RefPtr<Inode> inode;
     Array<u8, max_file_identifier_length> file_identifier_buffer;
 
+    auto& mutable_file_system = static_cast<ISO9660FS&>(fs());
+    if (auto cached_record = mutable_file_system.cached_lookup(index(), name); cached_record.has_value()) {
+        if (auto cached_inode = mutable_file_system.inode_cache().get(get_inode_index(cached_record.value(), name)))
+            return cached_inode;
+        auto maybe_inode = ISO9660Inode::try_create_from_directory_record(mutable_file_system, cached_record.value(), name);
+        if (maybe_inode.is_error())
+            return {};
+        return maybe_inode.release_value();
+    }
+
     auto traversal_result = file_system.visit_directory_record(m_record, [&](ISO::DirectoryRecordHeader const* record) {
         StringView filename = get_normalized_filename(*record, file_identifier_buffer);
 
@@ -530,6 +610,7 @@ RefPtr<Inode> ISO9660Inode::lookup(StringView name)
                 dbgln("Could not allocate inode for lookup!");
             } else {
                 inode = maybe_inode.release_value();
+                mutable_file_system.cache_lookup(index(), name, *record);
             }
             return RecursionDecision::Break;
         }
@@ -9,6 +9,7 @@
 // includes
 #include <base/EnumBits.h>
 #include <base/HashMap.h>
+#include <base/IntrusiveList.h>
 #include <base/NonnullRefPtr.h>
 #include <base/RecursionDecision.h>
 #include <base/StringView.h>
@@ -16,6 +17,7 @@
 #include <kernel/filesystem/BlockBasedFileSystem.h>
 #include <kernel/filesystem/Inode.h>
 #include <kernel/KBuffer.h>
+#include <kernel/KString.h>
 #include <kernel/KResult.h>
 
 namespace Kernel {
@@ -246,6 +248,9 @@ public:
 
         OwnPtr<KBuffer> blocks;
 
+        IntrusiveListNode<DirectoryEntry, RawPtr<DirectoryEntry>> lru_list_node;
+        using LRUList = IntrusiveList<DirectoryEntry, RawPtr<DirectoryEntry>, &DirectoryEntry::lru_list_node>;
+
         static KResultOr<NonnullRefPtr<DirectoryEntry>> try_create(u32 extent, u32 length, OwnPtr<KBuffer> blocks)
         {
             auto result = adopt_ref_if_nonnull(new (nothrow) DirectoryEntry(extent, length, move(blocks)));
@@ -269,6 +274,7 @@ public:
     virtual ~ISO9660FS() override;
     virtual bool initialize() override;
     virtual StringView class_name() const override { return "ISO9660FS"; }
+    virtual bool can_cache_link_targets() const override { return true; }
     virtual Inode& root_inode() override;
 
     virtual unsigned total_block_count() const override;
@@ -287,13 +293,33 @@ private:
 
     u32 calculate_directory_entry_cache_key(ISO::DirectoryRecordHeader const&);
 
+    struct CachedLookup {
+        InodeIndex parent;
+        NonnullOwnPtr<KString> name;
+        ISO::DirectoryRecordHeader record;
+
+        IntrusiveListNode<CachedLookup> lru_list_node;
+        using LRUList = IntrusiveList<CachedLookup, RawPtr<CachedLookup>, &CachedLookup::lru_list_node>;
+    };
+
+    static u32 calculate_lookup_cache_key(InodeIndex parent, StringView name);
+    Optional<ISO::DirectoryRecordHeader> cached_lookup(InodeIndex parent, StringView name);
+    void cache_lookup(InodeIndex parent, StringView name, ISO::DirectoryRecordHeader const&);
+
     KResult visit_directory_record(ISO::DirectoryRecordHeader const& record, Function<KResultOr<RecursionDecision>(ISO::DirectoryRecordHeader const*)> const& visitor) const;
 
     OwnPtr<ISO::PrimaryVolumeDescriptor> m_primary_volume;
     RefPtr<ISO9660Inode> m_root_inode;
 
     mutable u32 m_cached_inode_count { 0 };
+
+    Mutex m_directory_entry_cache_lock { "ISO9660FS directory entry cache" };
     HashMap<u32, NonnullRefPtr<DirectoryEntry>> m_directory_entry_cache;
+    DirectoryEntry::LRUList m_directory_entry_lru;
+
+    Mutex m_lookup_cache_lock { "ISO9660FS lookup cache" };
+    HashMap<u32, NonnullOwnPtr<CachedLookup>> m_lookup_cache;
+    CachedLookup::LRUList m_lookup_lru;
 };
 
 class ISO9660Inode final : public Inode {
@@ -332,8 +358,15 @@ private:
     void create_metadata();
     time_t parse_numerical_date_time(ISO::NumericalDateAndTime const&);
 
+    static constexpr size_t readahead_window = 128 * KiB;
+    static constexpr size_t max_blocks_per_transfer = 512;
+
     InodeMetadata m_metadata;
     ISO::DirectoryRecordHeader m_record;
+
+    mutable OwnPtr<KBuffer> m_readahead_buffer;
+    mutable u64 m_readahead_offset { 0 };
+    mutable size_t m_readahead_size { 0 };
 };
 
 }
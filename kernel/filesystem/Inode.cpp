@@ -6,13 +6,13 @@
 
 // includes
 #include <base/NonnullRefPtrVector.h>
-#include <base/Singleton.h>
 #include <base/StringBuilder.h>
 #include <base/StringView.h>
 #include <kernel/api/InodeWatcherEvent.h>
 #include <kernel/filesystem/Custody.h>
 #include <kernel/filesystem/FileDescription.h>
 #include <kernel/filesystem/Inode.h>
+#include <kernel/filesystem/InodeCache.h>
 #include <kernel/filesystem/InodeWatcher.h>
 #include <kernel/filesystem/VirtualFileSystem.h>
 #include <kernel/KBufferBuilder.h>
@@ -22,33 +22,6 @@
 
 namespace Kernel {
 
-static SpinLock s_all_inodes_lock;
-static Singleton<Inode::List> s_list;
-
-static Inode::List& all_with_lock()
-{
-    VERIFY(s_all_inodes_lock.is_locked());
-
-    return *s_list;
-}
-
-void Inode::sync()
-{
-    NonnullRefPtrVector<Inode, 32> inodes;
-    {
-        ScopedSpinLock all_inodes_lock(s_all_inodes_lock);
-        for (auto& inode : all_with_lock()) {
-            if (inode.is_metadata_dirty())
-                inodes.append(inode);
-        }
-    }
-
-    for (auto& inode : inodes) {
-        VERIFY(inode.is_metadata_dirty());
-        inode.flush_metadata();
-    }
-}
-
 KResultOr<NonnullOwnPtr<KBuffer>> Inode::read_entire(FileDescription* description) const
 {
     KBufferBuilder builder;
@@ -78,7 +51,15 @@ KResultOr<NonnullOwnPtr<KBuffer>> Inode::read_entire(FileDescription* descriptio
 }
 
 KResultOr<NonnullRefPtr<Custody>> Inode::resolve_as_link(Custody& base, RefPtr<Custody>* out_parent, int options, int symlink_recursion_level) const
-{    
+{
+    if (fs().can_cache_link_targets()) {
+        auto target_or_error = cached_link_target();
+        if (target_or_error.is_error())
+            return target_or_error.error();
+        auto target = target_or_error.release_value();
+        return VirtualFileSystem::the().resolve_path(target->path->view(), base, out_parent, options, symlink_recursion_level);
+    }
+
     auto contents_or = read_entire();
     if (contents_or.is_error())
         return contents_or.error();
@@ -88,18 +69,74 @@ KResultOr<NonnullRefPtr<Custody>> Inode::resolve_as_link(Custody& base, RefPtr<C
     return VirtualFileSystem::the().resolve_path(path, base, out_parent, options, symlink_recursion_level);
 }
 
+auto Inode::cached_link_target() const -> KResultOr<NonnullRefPtr<CachedLinkTarget>>
+{
+    u32 generation;
+    {
+        MutexLocker locker(m_inode_lock, Mutex::Mode::Shared);
+        if (m_cached_link_target)
+            return NonnullRefPtr<CachedLinkTarget>(*m_cached_link_target);
+        generation = m_link_target_generation;
+    }
+
+    auto contents_or = read_entire();
+    if (contents_or.is_error())
+        return contents_or.error();
+
+    auto& contents = contents_or.value();
+    auto path = KString::try_create(StringView(contents->data(), contents->size()));
+    if (!path)
+        return ENOMEM;
+    auto target = adopt_ref_if_nonnull(new (nothrow) CachedLinkTarget(path.release_nonnull()));
+    if (!target)
+        return ENOMEM;
+
+    MutexLocker locker(m_inode_lock);
+    if (m_link_target_generation == generation)
+        m_cached_link_target = target;
+    return target.release_nonnull();
+}
+
+void Inode::invalidate_cached_link_target()
+{
+    MutexLocker locker(m_inode_lock);
+    invalidate_cached_link_target_locked();
+}
+
+void Inode::invalidate_cached_link_target_locked()
+{
+    VERIFY(m_inode_lock.is_locked());
+    m_cached_link_target = nullptr;
+    m_link_target_generation++;
+}
+
+KResult Inode::traverse_as_directory_from(u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)> callback) const
+{
+    u64 position = 0;
+    bool stopped = false;
+    return traverse_as_directory([&](auto& entry) {
+        // Some traverse_as_directory() implementations keep going after the
+        // callback returns false, so latch the stop ourselves.
+        if (stopped)
+            return false;
+        if (position++ < cookie)
+            return true;
+        if (!callback({ entry.name, entry.inode, entry.file_type, position }))
+            stopped = true;
+        return !stopped;
+    });
+}
+
 Inode::Inode(FileSystem& fs, InodeIndex index)
     : m_file_system(fs)
     , m_index(index)
 {
-    ScopedSpinLock all_inodes_lock(s_all_inodes_lock);
-    all_with_lock().append(*this);
+    fs.inode_cache().add(*this);
 }
 
 Inode::~Inode()
 {
-    ScopedSpinLock all_inodes_lock(s_all_inodes_lock);
-    all_with_lock().remove(*this);
+    fs().inode_cache().remove(*this);
 
     for (auto& watcher : m_watchers) {
         watcher->unregister_by_inode({}, identifier());
@@ -203,6 +240,11 @@ void Inode::set_metadata_dirty(bool metadata_dirty)
         return;
 
     m_metadata_dirty = metadata_dirty;
+    if (m_metadata_dirty)
+        fs().inode_cache().mark_dirty(*this);
+    else
+        fs().inode_cache().mark_clean(*this);
+
     if (m_metadata_dirty) {
         
         for (auto& watcher : m_watchers) {
@@ -237,6 +279,7 @@ void Inode::did_remove_child(InodeIdentifier const&, String const& name)
 void Inode::did_modify_contents()
 {
     MutexLocker locker(m_inode_lock);
+    invalidate_cached_link_target_locked();
     for (auto& watcher : m_watchers) {
         watcher->notify_inode_event({}, identifier(), InodeWatcherEvent::Type::ContentModified);
     }
@@ -7,6 +7,7 @@
 #pragma once
 
 // includes
+#include <base/Atomic.h>
 #include <base/Function.h>
 #include <base/HashTable.h>
 #include <base/IntrusiveList.h>
@@ -19,6 +20,7 @@
 #include <kernel/filesystem/InodeMetadata.h>
 #include <kernel/Forward.h>
 #include <kernel/KResult.h>
+#include <kernel/KString.h>
 #include <kernel/locking/Mutex.h>
 
 namespace Kernel {
@@ -26,6 +28,7 @@ namespace Kernel {
 class Inode : public RefCounted<Inode> {
     friend class VirtualFileSystem;
     friend class FileSystem;
+    friend class InodeCache;
 
 public:
     virtual ~Inode();
@@ -53,6 +56,7 @@ public:
     virtual void did_seek(FileDescription&, off_t) { }
     virtual KResultOr<size_t> read_bytes(off_t, size_t, UserOrKernelBuffer& buffer, FileDescription*) const = 0;
     virtual KResult traverse_as_directory(Function<bool(FileSystem::DirectoryEntryView const&)>) const = 0;
+    virtual KResult traverse_as_directory_from(u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)>) const;
     virtual RefPtr<Inode> lookup(StringView name) = 0;
     virtual KResultOr<size_t> write_bytes(off_t, size_t, const UserOrKernelBuffer& data, FileDescription*) = 0;
     virtual KResultOr<NonnullRefPtr<Inode>> create_child(StringView name, mode_t, dev_t, uid_t, gid_t) = 0;
@@ -65,6 +69,9 @@ public:
 
     virtual KResultOr<int> get_block_address(int) { return ENOTSUP; }
 
+    virtual bool can_share_pages_with_mmap() const { return false; }
+    virtual KResultOr<NonnullRefPtr<Memory::VMObject>> try_create_mmap_vmobject() { return ENOTSUP; }
+
     LocalSocket* socket() { return m_socket.ptr(); }
     const LocalSocket* socket() const { return m_socket.ptr(); }
     bool bind_socket(LocalSocket&);
@@ -74,6 +81,8 @@ public:
 
     bool is_metadata_dirty() const { return m_metadata_dirty; }
 
+    bool is_mountpoint() const { return m_mount_count > 0; }
+
     virtual KResult set_atime(time_t);
     virtual KResult set_ctime(time_t);
     virtual KResult set_mtime(time_t);
@@ -87,8 +96,6 @@ public:
     void set_shared_vmobject(Memory::SharedInodeVMObject&);
     RefPtr<Memory::SharedInodeVMObject> shared_vmobject() const;
 
-    static void sync();
-
     bool has_watchers() const { return !m_watchers.is_empty(); }
 
     void register_watcher(Badge<InodeWatcher>, InodeWatcher&);
@@ -110,6 +117,8 @@ protected:
     void did_remove_child(InodeIdentifier const& child_id, String const& name);
     void did_modify_contents();
     void did_delete_self();
+    void invalidate_cached_link_target();
+    void invalidate_cached_link_target_locked();
 
     mutable Mutex m_inode_lock { "Inode" };
 
@@ -120,8 +129,23 @@ private:
     RefPtr<LocalSocket> m_socket;
     HashTable<InodeWatcher*> m_watchers;
     bool m_metadata_dirty { false };
+    Atomic<u32> m_mount_count { 0 };
     RefPtr<FIFO> m_fifo;
     IntrusiveListNode<Inode> m_inode_list_node;
+    IntrusiveListNode<Inode> m_dirty_list_node;
+
+    struct CachedLinkTarget : public RefCounted<CachedLinkTarget> {
+        explicit CachedLinkTarget(NonnullOwnPtr<KString> path)
+            : path(move(path))
+        {
+        }
+        NonnullOwnPtr<KString> path;
+    };
+
+    KResultOr<NonnullRefPtr<CachedLinkTarget>> cached_link_target() const;
+
+    mutable RefPtr<CachedLinkTarget> m_cached_link_target;
+    mutable u32 m_link_target_generation { 0 };
 
     struct Flock {
         short type;
@@ -135,6 +159,7 @@ private:
 
 public:
     using List = IntrusiveList<Inode, RawPtr<Inode>, &Inode::m_inode_list_node>;
+    using DirtyList = IntrusiveList<Inode, RawPtr<Inode>, &Inode::m_dirty_list_node>;
 };
 
 }
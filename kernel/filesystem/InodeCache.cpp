@@ -0,0 +1,89 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/filesystem/InodeCache.h>
+
+namespace Kernel {
+
+InodeCache::~InodeCache()
+{
+    for (auto& shard : m_shards)
+        VERIFY(shard.inodes.is_empty());
+    VERIFY(m_dirty_inodes.is_empty());
+}
+
+void InodeCache::add(Inode& inode)
+{
+    auto& shard = shard_for(inode.index());
+    ScopedSpinLock locker(shard.lock);
+    shard.inodes.append(inode);
+    if (shard.inodes_by_index.find(inode.index()) != shard.inodes_by_index.end())
+        shard.unindexed_count++;
+    else
+        shard.inodes_by_index.set(inode.index(), &inode);
+}
+
+void InodeCache::remove(Inode& inode)
+{
+    mark_clean(inode);
+
+    auto& shard = shard_for(inode.index());
+    ScopedSpinLock locker(shard.lock);
+    shard.inodes.remove(inode);
+
+    auto it = shard.inodes_by_index.find(inode.index());
+    if (it == shard.inodes_by_index.end() || it->value != &inode) {
+        VERIFY(shard.unindexed_count > 0);
+        shard.unindexed_count--;
+        return;
+    }
+    shard.inodes_by_index.remove(it);
+
+    if (shard.unindexed_count == 0)
+        return;
+    for (auto& other : shard.inodes) {
+        if (other.index() == inode.index()) {
+            shard.inodes_by_index.set(other.index(), &other);
+            shard.unindexed_count--;
+            break;
+        }
+    }
+}
+
+void InodeCache::mark_dirty(Inode& inode)
+{
+    ScopedSpinLock locker(m_dirty_lock);
+    if (!inode.m_dirty_list_node.is_in_list())
+        m_dirty_inodes.append(inode);
+}
+
+void InodeCache::mark_clean(Inode& inode)
+{
+    ScopedSpinLock locker(m_dirty_lock);
+    if (inode.m_dirty_list_node.is_in_list())
+        m_dirty_inodes.remove(inode);
+}
+
+bool InodeCache::has_dirty_inodes() const
+{
+    ScopedSpinLock locker(m_dirty_lock);
+    return !m_dirty_inodes.is_empty();
+}
+
+RefPtr<Inode> InodeCache::get(InodeIndex index) const
+{
+    auto& shard = shard_for(index);
+    ScopedSpinLock locker(shard.lock);
+    auto it = shard.inodes_by_index.find(index);
+    if (it == shard.inodes_by_index.end())
+        return nullptr;
+    if (!it->value->try_ref())
+        return nullptr;
+    return adopt_ref(*it->value);
+}
+
+}
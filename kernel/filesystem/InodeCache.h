@@ -0,0 +1,72 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Array.h>
+#include <base/HashMap.h>
+#include <base/Noncopyable.h>
+#include <kernel/filesystem/Inode.h>
+#include <kernel/locking/SpinLock.h>
+
+namespace Kernel {
+
+class InodeCache {
+    BASE_MAKE_NONCOPYABLE(InodeCache);
+    BASE_MAKE_NONMOVABLE(InodeCache);
+
+public:
+    InodeCache() = default;
+    ~InodeCache();
+
+    void add(Inode&);
+    void remove(Inode&);
+
+    RefPtr<Inode> get(InodeIndex) const;
+
+    void mark_dirty(Inode&);
+    void mark_clean(Inode&);
+    bool has_dirty_inodes() const;
+
+    template<typename Callback>
+    void for_each(Callback callback)
+    {
+        for (auto& shard : m_shards) {
+            ScopedSpinLock locker(shard.lock);
+            for (auto& inode : shard.inodes)
+                callback(inode);
+        }
+    }
+
+    template<typename Callback>
+    void for_each_dirty(Callback callback)
+    {
+        ScopedSpinLock locker(m_dirty_lock);
+        for (auto& inode : m_dirty_inodes)
+            callback(inode);
+    }
+
+private:
+    static constexpr size_t shard_count = 32;
+
+    struct Shard {
+        mutable SpinLock<u8> lock;
+        Inode::List inodes;
+        HashMap<InodeIndex, Inode*> inodes_by_index;
+        size_t unindexed_count { 0 };
+    };
+
+    Shard& shard_for(InodeIndex index) { return m_shards[Traits<InodeIndex>::hash(index) % shard_count]; }
+    Shard const& shard_for(InodeIndex index) const { return m_shards[Traits<InodeIndex>::hash(index) % shard_count]; }
+
+    Array<Shard, shard_count> m_shards;
+
+    mutable SpinLock<u8> m_dirty_lock;
+    Inode::DirtyList m_dirty_inodes;
+};
+
+}
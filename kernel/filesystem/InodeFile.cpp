@@ -97,11 +97,17 @@ KResult InodeFile::ioctl(FileDescription& description, unsigned request, Userspa
 KResultOr<Memory::Region*> InodeFile::mmap(Process& process, FileDescription& description, Memory::VirtualRange const& range, u64 offset, int prot, bool shared)
 {
 
-    RefPtr<Memory::InodeVMObject> vmobject;
-    if (shared)
+    RefPtr<Memory::VMObject> vmobject;
+    if (shared && inode().can_share_pages_with_mmap()) {
+        auto vmobject_or_error = inode().try_create_mmap_vmobject();
+        if (vmobject_or_error.is_error())
+            return vmobject_or_error.error();
+        vmobject = vmobject_or_error.release_value();
+    } else if (shared) {
         vmobject = Memory::SharedInodeVMObject::try_create_with_inode(inode());
-    else
+    } else {
         vmobject = Memory::PrivateInodeVMObject::try_create_with_inode(inode());
+    }
     if (!vmobject)
         return ENOMEM;
     return process.address_space().allocate_region_with_vmobject(range, vmobject.release_nonnull(), offset, description.absolute_path(), prot, shared);
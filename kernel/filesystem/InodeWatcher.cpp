@@ -8,6 +8,7 @@
 #include <base/Memory.h>
 #include <kernel/filesystem/Inode.h>
 #include <kernel/filesystem/InodeWatcher.h>
+#include <kernel/memory/MemoryManager.h>
 #include <kernel/Process.h>
 
 namespace Kernel {
@@ -15,9 +16,11 @@ namespace Kernel {
 KResultOr<NonnullRefPtr<InodeWatcher>> InodeWatcher::create()
 {
     auto watcher = adopt_ref_if_nonnull(new (nothrow) InodeWatcher);
-    if (watcher)
-        return watcher.release_nonnull();
-    return ENOMEM;
+    if (!watcher)
+        return ENOMEM;
+    if (auto result = watcher->allocate_ring(INODE_WATCHER_DEFAULT_QUEUE_SIZE); result.is_error())
+        return result;
+    return watcher.release_nonnull();
 }
 
 InodeWatcher::~InodeWatcher()
@@ -25,25 +28,155 @@ InodeWatcher::~InodeWatcher()
     (void)close();
 }
 
+KResult InodeWatcher::allocate_ring(u32 capacity)
+{
+    // The header gets a page of its own, so that the entries can be mapped read-only.
+    u32 entries_offset = PAGE_SIZE;
+    size_t mapping_size = entries_offset + Memory::page_round_up(capacity * sizeof(InodeWatcherRingEntry));
+
+    auto vmobject = Memory::AnonymousVMObject::try_create_with_size(mapping_size, AllocationStrategy::AllocateNow);
+    if (!vmobject)
+        return ENOMEM;
+    auto region = MM.allocate_kernel_region_with_vmobject(*vmobject, mapping_size, "InodeWatcher Ring", Memory::Region::Access::ReadWrite);
+    if (!region)
+        return ENOMEM;
+
+    auto& header = *reinterpret_cast<InodeWatcherRingHeader*>(region->vaddr().as_ptr());
+    header.capacity = capacity;
+    header.entries_offset = entries_offset;
+    header.mapping_size = mapping_size;
+    header.overflow_count = 0;
+
+    // Carry over the newest events the previous ring still holds, oldest first. When they don't
+    // all fit, the last slot is left for an overflow marker, as it is when the ring fills up.
+    u32 carried = 0;
+    u32 dropped = 0;
+    if (m_ring_region) {
+        u32 pending = pending_event_count();
+        if (pending >= capacity)
+            dropped = pending - (capacity - 1);
+        pending -= dropped;
+        u32 head = m_ring_tail - pending;
+        auto* entries = reinterpret_cast<InodeWatcherRingEntry*>(region->vaddr().offset(entries_offset).as_ptr());
+        for (; carried < pending; ++carried)
+            entries[carried] = ring_entry(head + carried);
+        header.overflow_count = ring_header().overflow_count;
+    }
+    header.head = 0;
+    header.claimed = 0;
+    header.tail = carried;
+
+    m_ring_vmobject = move(vmobject);
+    m_ring_region = move(region);
+    m_ring_capacity = capacity;
+    m_ring_entries_offset = entries_offset;
+    m_ring_tail = carried;
+    m_overflow_position.clear();
+    m_coalescable_positions.clear();
+
+    if (dropped) {
+        header.overflow_count += dropped;
+        auto& marker = ring_entry(m_ring_tail);
+        marker.watch_descriptor = -1;
+        marker.type = InodeWatcherEvent::Type::QueueOverflow;
+        marker.name_length = 0;
+        marker.name[0] = '\0';
+        m_overflow_position = m_ring_tail;
+        header.tail = ++m_ring_tail;
+    }
+    return KSuccess;
+}
+
+KResult InodeWatcher::set_queue_size(u32 capacity)
+{
+    if (capacity < 2 || capacity > INODE_WATCHER_MAX_QUEUE_SIZE || (capacity & (capacity - 1)) != 0)
+        return EINVAL;
+
+    MutexLocker locker(m_lock);
+    if (m_ring_mapped)
+        return EBUSY;
+    if (capacity == m_ring_capacity)
+        return KSuccess;
+    return allocate_ring(capacity);
+}
+
+KResultOr<Memory::Region*> InodeWatcher::mmap(Process& process, FileDescription&, Memory::VirtualRange const& range, u64 offset, int prot, bool shared)
+{
+    if (!shared)
+        return EINVAL;
+
+    // The header page and the entries are mapped separately. Only the header is writable,
+    // since the consumer has to advance head and claimed, but the entries stay the kernel's.
+    MutexLocker locker(m_lock);
+    if (offset == 0) {
+        if (range.size() != m_ring_entries_offset)
+            return EINVAL;
+    } else if (offset == m_ring_entries_offset) {
+        if (range.size() != m_ring_vmobject->size() - m_ring_entries_offset)
+            return EINVAL;
+        if (prot & PROT_WRITE)
+            return EACCES;
+    } else {
+        return EINVAL;
+    }
+    auto region_or_error = process.address_space().allocate_region_with_vmobject(range, *m_ring_vmobject, offset, {}, prot, shared);
+    if (region_or_error.is_error())
+        return region_or_error.error();
+    m_ring_mapped = true;
+    return region_or_error.value();
+}
+
+InodeWatcherRingEntry& InodeWatcher::ring_entry(u32 position) const
+{
+    auto* entries = reinterpret_cast<InodeWatcherRingEntry*>(m_ring_region->vaddr().offset(m_ring_entries_offset).as_ptr());
+    return entries[position & (m_ring_capacity - 1)];
+}
+
+u32 InodeWatcher::ring_head() const
+{
+    u32 head = Base::atomic_load(&ring_header().head, Base::MemoryOrder::memory_order_acquire);
+    // A mapped consumer owns head; never let it point outside the pending window.
+    if (m_ring_tail - head > m_ring_capacity)
+        return m_ring_tail - m_ring_capacity;
+    return head;
+}
+
+u32 InodeWatcher::first_unclaimed_position() const
+{
+    u32 head = ring_head();
+    u32 claimed = Base::atomic_load(&ring_header().claimed, Base::MemoryOrder::memory_order_acquire);
+    // Entries between head and claimed are still being copied out, so they are
+    // neither free nor open to coalescing.
+    if (claimed - head > m_ring_tail - head)
+        return head;
+    return claimed;
+}
+
+u32 InodeWatcher::pending_event_count() const
+{
+    return m_ring_tail - ring_head();
+}
+
 bool InodeWatcher::can_read(const FileDescription&, size_t) const
 {
     MutexLocker locker(m_lock);
-    return !m_queue.is_empty();
+    return pending_event_count() > 0;
 }
 
 KResultOr<size_t> InodeWatcher::read(FileDescription&, u64, UserOrKernelBuffer& buffer, size_t buffer_size)
 {
     MutexLocker locker(m_lock);
-    if (m_queue.is_empty())
-
+    if (pending_event_count() == 0)
         return EAGAIN;
 
-    auto event = m_queue.dequeue();
+    u32 head = ring_head();
+    // Work on a copy, so that nothing in the shared ring decides how much is copied below.
+    InodeWatcherRingEntry event = ring_entry(head);
+    event.name_length = min(event.name_length, static_cast<u32>(NAME_MAX));
+    event.name[event.name_length] = '\0';
 
-    size_t name_length = event.path.length() + 1;
-    size_t bytes_to_write = sizeof(InodeWatcherEvent);
-    if (!event.path.is_null())
-        bytes_to_write += name_length;
+    size_t name_length = event.name_length ? event.name_length + 1 : 0;
+    size_t bytes_to_write = sizeof(InodeWatcherEvent) + name_length;
 
     if (buffer_size < bytes_to_write)
         return EINVAL;
@@ -51,21 +184,26 @@ KResultOr<size_t> InodeWatcher::read(FileDescription&, u64, UserOrKernelBuffer&
     auto result = buffer.write_buffered<MAXIMUM_EVENT_SIZE>(bytes_to_write, [&](u8* data, size_t data_bytes) {
         size_t offset = 0;
 
-        memcpy(data + offset, &event.wd, sizeof(InodeWatcherEvent::watch_descriptor));
+        memcpy(data + offset, &event.watch_descriptor, sizeof(InodeWatcherEvent::watch_descriptor));
         offset += sizeof(InodeWatcherEvent::watch_descriptor);
         memcpy(data + offset, &event.type, sizeof(InodeWatcherEvent::type));
         offset += sizeof(InodeWatcherEvent::type);
 
-        if (!event.path.is_null()) {
+        if (name_length) {
             memcpy(data + offset, &name_length, sizeof(InodeWatcherEvent::name_length));
             offset += sizeof(InodeWatcherEvent::name_length);
-            memcpy(data + offset, event.path.characters(), name_length);
+            memcpy(data + offset, event.name, min(name_length, data_bytes - offset));
         } else {
             memset(data + offset, 0, sizeof(InodeWatcherEvent::name_length));
         }
 
         return data_bytes;
     });
+    if (!result.is_error()) {
+        if (first_unclaimed_position() == head)
+            Base::atomic_store(&ring_header().claimed, head + 1, Base::MemoryOrder::memory_order_release);
+        Base::atomic_store(&ring_header().head, head + 1, Base::MemoryOrder::memory_order_release);
+    }
     evaluate_block_conditions();
     return result;
 }
@@ -101,10 +239,71 @@ void InodeWatcher::notify_inode_event(Badge<Inode>, InodeIdentifier inode_id, In
     if (!(watcher.event_mask & static_cast<unsigned>(event_type)))
         return;
 
-    m_queue.enqueue({ watcher.wd, event_type, name });
+    if (try_coalesce(watcher.wd, event_type))
+        return;
+
+    enqueue(watcher.wd, event_type, name.view());
     evaluate_block_conditions();
 }
 
+static u64 coalescing_key(int wd, InodeWatcherEvent::Type event_type)
+{
+    return (static_cast<u64>(static_cast<u32>(wd)) << 32) | static_cast<u32>(event_type);
+}
+
+bool InodeWatcher::try_coalesce(int wd, InodeWatcherEvent::Type event_type)
+{
+    if (event_type != InodeWatcherEvent::Type::ContentModified && event_type != InodeWatcherEvent::Type::MetadataModified)
+        return false;
+
+    auto it = m_coalescable_positions.find(coalescing_key(wd, event_type));
+    if (it == m_coalescable_positions.end())
+        return false;
+
+    u32 position = it->value;
+    u32 first_unclaimed = first_unclaimed_position();
+    if (position - first_unclaimed >= m_ring_tail - first_unclaimed) {
+        m_coalescable_positions.remove(it);
+        return false;
+    }
+    auto& entry = ring_entry(position);
+    return entry.watch_descriptor == wd && entry.type == event_type;
+}
+
+void InodeWatcher::enqueue(int wd, InodeWatcherEvent::Type event_type, StringView name)
+{
+    auto& header = ring_header();
+    u32 head = ring_head();
+
+    if (m_overflow_position.has_value() && m_overflow_position.value() - head >= m_ring_tail - head)
+        m_overflow_position.clear();
+
+    // The last free slot is kept for the overflow marker, so a consumer always learns that it missed events.
+    if (m_ring_tail - head >= m_ring_capacity - 1) {
+        Base::atomic_fetch_add(&header.overflow_count, 1u, Base::MemoryOrder::memory_order_relaxed);
+        if (m_overflow_position.has_value() || m_ring_tail - head >= m_ring_capacity)
+            return;
+        wd = -1;
+        event_type = InodeWatcherEvent::Type::QueueOverflow;
+        name = {};
+        m_overflow_position = m_ring_tail;
+        m_coalescable_positions.clear();
+    }
+
+    auto& entry = ring_entry(m_ring_tail);
+    entry.watch_descriptor = wd;
+    entry.type = event_type;
+    entry.name_length = min(name.length(), static_cast<size_t>(NAME_MAX));
+    memcpy(entry.name, name.characters_without_null_termination(), entry.name_length);
+    entry.name[entry.name_length] = '\0';
+
+    if (event_type == InodeWatcherEvent::Type::ContentModified || event_type == InodeWatcherEvent::Type::MetadataModified)
+        m_coalescable_positions.set(coalescing_key(wd, event_type), m_ring_tail);
+
+    ++m_ring_tail;
+    Base::atomic_store(&header.tail, m_ring_tail, Base::MemoryOrder::memory_order_release);
+}
+
 KResultOr<int> InodeWatcher::register_inode(Inode& inode, unsigned event_mask)
 {
     MutexLocker locker(m_lock);
@@ -9,12 +9,13 @@
 // includes
 #include <base/Badge.h>
 #include <base/Checked.h>
-#include <base/CircularQueue.h>
 #include <base/HashMap.h>
 #include <base/NonnullOwnPtr.h>
 #include <kernel/api/InodeWatcherEvent.h>
 #include <kernel/FileSystem/File.h>
 #include <kernel/Forward.h>
+#include <kernel/memory/AnonymousVMObject.h>
+#include <kernel/memory/Region.h>
 
 namespace Kernel {
 
@@ -51,6 +52,7 @@ public:
     virtual bool can_write(const FileDescription&, size_t) const override { return true; }
     virtual KResultOr<size_t> write(FileDescription&, u64, const UserOrKernelBuffer&, size_t) override { return EIO; }
     virtual KResult close() override;
+    virtual KResultOr<Memory::Region*> mmap(Process&, FileDescription&, Memory::VirtualRange const&, u64 offset, int prot, bool shared) override;
 
     virtual String absolute_path(const FileDescription&) const override;
     virtual StringView class_name() const override { return "InodeWatcher"; };
@@ -62,17 +64,33 @@ public:
     KResult unregister_by_wd(int);
     void unregister_by_inode(Badge<Inode>, InodeIdentifier);
 
+    KResult set_queue_size(u32);
+
 private:
     explicit InodeWatcher() { }
 
+    KResult allocate_ring(u32 capacity);
+
+    InodeWatcherRingHeader& ring_header() const { return *reinterpret_cast<InodeWatcherRingHeader*>(m_ring_region->vaddr().as_ptr()); }
+    InodeWatcherRingEntry& ring_entry(u32 position) const;
+    u32 ring_head() const;
+    u32 first_unclaimed_position() const;
+    u32 pending_event_count() const;
+
+    void enqueue(int wd, InodeWatcherEvent::Type, StringView name);
+    bool try_coalesce(int wd, InodeWatcherEvent::Type);
+
     mutable Mutex m_lock;
 
-    struct Event {
-        int wd { 0 };
-        InodeWatcherEvent::Type type { InodeWatcherEvent::Type::Invalid };
-        String path;
-    };
-    CircularQueue<Event, 32> m_queue;
+    RefPtr<Memory::AnonymousVMObject> m_ring_vmobject;
+    OwnPtr<Memory::Region> m_ring_region;
+    u32 m_ring_capacity { 0 };
+    u32 m_ring_entries_offset { 0 };
+    u32 m_ring_tail { 0 };
+    bool m_ring_mapped { false };
+    Optional<u32> m_overflow_position;
+    HashMap<u64, u32> m_coalescable_positions;
+
     Checked<int> m_wd_counter { 1 };
 
 
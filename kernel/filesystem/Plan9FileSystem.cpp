@@ -5,18 +5,45 @@
 */
 
 // includes
+#include <base/NonnullOwnPtrVector.h>
+#include <base/ScopeGuard.h>
+#include <kernel/CommandLine.h>
 #include <kernel/filesystem/Plan9FileSystem.h>
 #include <kernel/Process.h>
+#include <kernel/time/TimeManagement.h>
 
 namespace Kernel {
 
-NonnullRefPtr<Plan9FS> Plan9FS::create(FileDescription& file_description)
+NonnullRefPtr<Plan9FS> Plan9FS::create(FileDescription& file_description, CacheMode cache_mode)
 {
-    return adopt_ref(*new Plan9FS(file_description));
+    return adopt_ref(*new Plan9FS(file_description, cache_mode));
 }
 
-Plan9FS::Plan9FS(FileDescription& file_description)
+Optional<Plan9FS::CacheMode> Plan9FS::parse_cache_mode(StringView name)
+{
+    if (name == "none"sv)
+        return CacheMode::None;
+    if (name == "loose"sv)
+        return CacheMode::Loose;
+    if (name == "fscache"sv)
+        return CacheMode::FSCache;
+    return {};
+}
+
+Plan9FS::CacheMode Plan9FS::default_cache_mode()
+{
+    auto name = kernel_command_line().lookup("plan9fs_cache"sv).value_or("none"sv);
+    auto cache_mode = parse_cache_mode(name);
+    if (!cache_mode.has_value()) {
+        dbgln("Plan9FS: Unknown cache mode '{}', caching disabled", name);
+        return CacheMode::None;
+    }
+    return cache_mode.value();
+}
+
+Plan9FS::Plan9FS(FileDescription& file_description, CacheMode cache_mode)
     : FileBackedFileSystem(file_description)
+    , m_cache_mode(cache_mode)
     , m_completion_blocker(*this)
 {
 }
@@ -164,7 +191,7 @@ public:
     u16 tag() const { return m_tag; }
 
     Message(Plan9FS&, Type);
-    Message(NonnullOwnPtr<KBuffer>&&);
+    Message(Plan9FS&, NonnullOwnPtr<KBuffer>&&);
     ~Message();
     Message& operator=(Message&&);
 
@@ -189,6 +216,9 @@ private:
         } m_built;
     };
 
+    void destroy_contents();
+
+    Plan9FS* m_receive_pool { nullptr };
     u16 m_tag { 0 };
     Type m_type { 0 };
     bool m_have_been_built { false };
@@ -226,7 +256,9 @@ bool Plan9FS::initialize()
         return false;
     }
 
-    m_root_inode = Plan9FSInode::create(*this, root_fid);
+    qid root_qid;
+    attach_message >> root_qid;
+    m_root_inode = Plan9FSInode::create(*this, root_fid, root_qid.type);
     return true;
 }
 
@@ -332,10 +364,12 @@ Plan9FS::Message::Message(Plan9FS& fs, Type type)
     *this << size_placeholder << (u8)type << m_tag;
 }
 
-Plan9FS::Message::Message(NonnullOwnPtr<KBuffer>&& buffer)
-    : m_built { move(buffer), Decoder({ buffer->data(), buffer->size() }) }
+Plan9FS::Message::Message(Plan9FS& fs, NonnullOwnPtr<KBuffer>&& buffer)
+    : m_built { move(buffer), Decoder({}) }
+    , m_receive_pool(&fs)
     , m_have_been_built(true)
 {
+    m_built.decoder = Decoder({ m_built.buffer->data(), m_built.buffer->size() });
     u32 size;
     u8 raw_type;
     *this >> size >> raw_type >> m_tag;
@@ -343,8 +377,15 @@ Plan9FS::Message::Message(NonnullOwnPtr<KBuffer>&& buffer)
 }
 
 Plan9FS::Message::~Message()
+{
+    destroy_contents();
+}
+
+void Plan9FS::Message::destroy_contents()
 {
     if (m_have_been_built) {
+        if (m_receive_pool)
+            m_receive_pool->return_receive_buffer(move(m_built.buffer));
         m_built.buffer.~NonnullOwnPtr<KBuffer>();
         m_built.decoder.~Decoder();
     } else {
@@ -354,16 +395,11 @@ Plan9FS::Message::~Message()
 
 Plan9FS::Message& Plan9FS::Message::operator=(Message&& message)
 {
+    destroy_contents();
+
     m_tag = message.m_tag;
     m_type = message.m_type;
-
-    if (m_have_been_built) {
-        m_built.buffer.~NonnullOwnPtr<KBuffer>();
-        m_built.decoder.~Decoder();
-    } else {
-        m_builder.~KBufferBuilder();
-    }
-
+    m_receive_pool = exchange(message.m_receive_pool, nullptr);
     m_have_been_built = message.m_have_been_built;
     if (m_have_been_built) {
         new (&m_built.buffer) NonnullOwnPtr<KBuffer>(move(message.m_built.buffer));
@@ -408,10 +444,10 @@ bool Plan9FS::Blocker::unblock(u16 tag)
         ScopedSpinLock lock(m_lock);
         if (m_did_unblock)
             return false;
-        m_did_unblock = true;
-
         if (m_completion->tag != tag)
             return false;
+        m_did_unblock = true;
+
         if (!m_completion->result.is_error())
             m_message = move(*m_completion->message);
     }
@@ -467,6 +503,17 @@ void Plan9FS::Plan9FSBlockCondition::try_unblock(Plan9FS::Blocker& blocker)
     }
 }
 
+u16 Plan9FS::allocate_tag()
+{
+    // Skip tags that are still waiting for a reply or for the Rflush that releases them.
+    MutexLocker locker(m_lock);
+    for (;;) {
+        u16 tag = m_next_tag++;
+        if (!m_completions.contains(tag))
+            return tag;
+    }
+}
+
 bool Plan9FS::is_complete(const ReceiveCompletion& completion)
 {
     MutexLocker locker(m_lock);
@@ -536,6 +583,40 @@ KResult Plan9FS::do_read(u8* data, size_t size)
     return KSuccess;
 }
 
+OwnPtr<KBuffer> Plan9FS::take_receive_buffer(size_t size)
+{
+    if (size <= m_max_message_size) {
+        ScopedSpinLock lock(m_receive_buffers_lock);
+        if (!m_receive_buffers.is_empty()) {
+            auto buffer = m_receive_buffers.take_last();
+            buffer->set_size(size);
+            return buffer;
+        }
+    }
+
+    auto buffer = KBuffer::try_create_with_size(max(size, m_max_message_size), Memory::Region::Access::ReadWrite);
+    if (!buffer)
+        return {};
+    buffer->set_size(size);
+    return buffer;
+}
+
+void Plan9FS::return_receive_buffer(NonnullOwnPtr<KBuffer> buffer)
+{
+    if (buffer->capacity() < m_max_message_size)
+        return;
+    ScopedSpinLock lock(m_receive_buffers_lock);
+    if (m_receive_buffers.size() < max_pooled_receive_buffers)
+        m_receive_buffers.unchecked_append(move(buffer));
+}
+
+void Plan9FS::detach_payload_destination(ReceiveCompletion& completion)
+{
+    MutexLocker locker(completion.payload_lock);
+    completion.payload_destination = nullptr;
+    completion.payload_capacity = 0;
+}
+
 KResult Plan9FS::read_and_dispatch_one_message()
 {
     struct [[gnu::packed]] Header {
@@ -547,30 +628,76 @@ KResult Plan9FS::read_and_dispatch_one_message()
     KResult result = do_read(reinterpret_cast<u8*>(&header), sizeof(header));
     if (result.is_error())
         return result;
+    if (header.size < sizeof(header))
+        return EIO;
+
+    RefPtr<ReceiveCompletion> completion;
+    {
+        MutexLocker locker(m_lock);
+        auto optional_completion = m_completions.get(header.tag);
+        if (optional_completion.has_value())
+            completion = optional_completion.value();
+    }
 
-    auto buffer = KBuffer::try_create_with_size(header.size, Memory::Region::Access::ReadWrite);
+    size_t message_size = header.size;
+    size_t prefix_size = sizeof(header);
+    u32 payload_count = 0;
+    bool received_payload_directly = false;
+
+    // An Rread for a caller that supplied a kernel destination has its payload
+    // read straight off the transport into that destination.
+    if (completion && header.type == (u8)Message::Type::Rread && header.size >= sizeof(header) + sizeof(payload_count)) {
+        result = do_read(reinterpret_cast<u8*>(&payload_count), sizeof(payload_count));
+        if (result.is_error())
+            return result;
+        prefix_size += sizeof(payload_count);
+
+        MutexLocker payload_locker(completion->payload_lock);
+        if (completion->payload_destination && payload_count <= completion->payload_capacity && prefix_size + payload_count == header.size) {
+            result = do_read(completion->payload_destination, payload_count);
+            if (result.is_error())
+                return result;
+            completion->payload_size = payload_count;
+            completion->received_payload_directly = true;
+            received_payload_directly = true;
+            message_size = prefix_size;
+        }
+    }
+
+    auto buffer = take_receive_buffer(message_size);
     if (!buffer)
         return ENOMEM;
     memcpy(buffer->data(), &header, sizeof(header));
-    result = do_read(buffer->data() + sizeof(header), header.size - sizeof(header));
-    if (result.is_error())
+    if (prefix_size > sizeof(header)) {
+        u32 stored_count = received_payload_directly ? 0 : payload_count;
+        memcpy(buffer->data() + sizeof(header), &stored_count, sizeof(stored_count));
+    }
+    result = do_read(buffer->data() + prefix_size, message_size - prefix_size);
+    if (result.is_error()) {
+        return_receive_buffer(buffer.release_nonnull());
         return result;
+    }
 
-    MutexLocker locker(m_lock);
+    if (!completion) {
+        dbgln("Received a 9p message of type {} with an unexpected tag {}, dropping", header.type, header.tag);
+        return_receive_buffer(buffer.release_nonnull());
+        return KSuccess;
+    }
 
-    auto optional_completion = m_completions.get(header.tag);
-    if (optional_completion.has_value()) {
-        auto completion = optional_completion.value();
+    MutexLocker locker(m_lock);
+    {
         ScopedSpinLock lock(completion->lock);
         completion->result = KSuccess;
-        completion->message = adopt_own_if_nonnull(new (nothrow) Message { buffer.release_nonnull() });
+        completion->message = adopt_own_if_nonnull(new (nothrow) Message { *this, buffer.release_nonnull() });
         completion->completed = true;
-
-        m_completions.remove(header.tag);
-        m_completion_blocker.unblock_completed(header.tag);
-    } else {
-        dbgln("Received a 9p message of type {} with an unexpected tag {}, dropping", header.type, header.tag);
     }
+    // A flushed request keeps its tag until the server answers the Tflush,
+    // even if its own reply makes it here first.
+    if (!completion->is_being_flushed)
+        m_completions.remove(header.tag);
+    if (completion->flushed_tag.has_value())
+        m_completions.remove(completion->flushed_tag.value());
+    m_completion_blocker.unblock_completed(header.tag);
 
     return KSuccess;
 }
@@ -582,12 +709,28 @@ KResult Plan9FS::post_message_and_explicitly_ignore_reply(Message& message)
 
 KResult Plan9FS::post_message_and_wait_for_a_reply(Message& message)
 {
-    auto request_type = message.type();
-    auto tag = message.tag();
-    auto completion = adopt_ref(*new ReceiveCompletion(tag));
+    auto completion_or_error = post_message_for_reply(message);
+    if (completion_or_error.is_error())
+        return completion_or_error.error();
+    return wait_for_reply(message, completion_or_error.release_value());
+}
+
+KResultOr<NonnullRefPtr<Plan9FS::ReceiveCompletion>> Plan9FS::post_message_for_reply(Message& message, u8* payload_destination, size_t payload_capacity)
+{
+    auto completion = adopt_ref_if_nonnull(new (nothrow) ReceiveCompletion(message.tag()));
+    if (!completion)
+        return ENOMEM;
+    completion->payload_destination = payload_destination;
+    completion->payload_capacity = payload_capacity;
     auto result = post_message(message, completion);
     if (result.is_error())
         return result;
+    return completion.release_nonnull();
+}
+
+KResult Plan9FS::wait_for_reply(Message& message, NonnullRefPtr<ReceiveCompletion> completion)
+{
+    auto request_type = message.type();
     if (Thread::current()->block<Plan9FS::Blocker>({}, *this, message, completion).was_interrupted())
         return EINTR;
 
@@ -618,6 +761,35 @@ KResult Plan9FS::post_message_and_wait_for_a_reply(Message& message)
     }
 }
 
+void Plan9FS::drain_reply(Message& message, NonnullRefPtr<ReceiveCompletion> completion)
+{
+    auto result = wait_for_reply(message, completion);
+    if (!result.is_error() || result.error() != EINTR)
+        return;
+
+    // We can't wait any longer, so ask the server to drop the request. The
+    // tag stays reserved until the Rflush arrives and the receive thread
+    // releases it, so it can't be handed to a new request too early.
+    Message flush_message { *this, Message::Type::Tflush };
+    flush_message << completion->tag;
+    auto flush_completion = adopt_ref_if_nonnull(new (nothrow) ReceiveCompletion(flush_message.tag()));
+    if (!flush_completion)
+        return;
+    flush_completion->flushed_tag = completion->tag;
+    {
+        MutexLocker locker(m_lock);
+        if (!m_completions.contains(completion->tag))
+            return;
+        completion->is_being_flushed = true;
+    }
+    auto flush_tag = flush_message.tag();
+    if (post_message(flush_message, move(flush_completion)).is_error()) {
+        MutexLocker locker(m_lock);
+        m_completions.remove(flush_tag);
+        m_completions.remove(completion->tag);
+    }
+}
+
 size_t Plan9FS::adjust_buffer_size(size_t size) const
 {
     size_t max_size = m_max_message_size - Message::max_header_size;
@@ -656,14 +828,15 @@ void Plan9FS::ensure_thread()
     }
 }
 
-Plan9FSInode::Plan9FSInode(Plan9FS& fs, u32 fid)
+Plan9FSInode::Plan9FSInode(Plan9FS& fs, u32 fid, u8 qid_type)
     : Inode(fs, fid)
+    , m_qid_type(qid_type)
 {
 }
 
-NonnullRefPtr<Plan9FSInode> Plan9FSInode::create(Plan9FS& fs, u32 fid)
+NonnullRefPtr<Plan9FSInode> Plan9FSInode::create(Plan9FS& fs, u32 fid, u8 qid_type)
 {
-    return adopt_ref(*new Plan9FSInode(fs, fid));
+    return adopt_ref(*new Plan9FSInode(fs, fid, qid_type));
 }
 
 Plan9FSInode::~Plan9FSInode()
@@ -709,40 +882,153 @@ KResult Plan9FSInode::ensure_open_for_mode(int mode)
     }
 }
 
+KResultOr<size_t> Plan9FSInode::read_remote(u64 offset, size_t size, Function<u8*(size_t, size_t)> direct_destination, Function<KResult(size_t, StringView)> callback) const
+{
+    size_t chunk_size = fs().adjust_buffer_size(size);
+    size_t nread = 0;
+
+    while (nread < size) {
+        NonnullOwnPtrVector<Plan9FS::Message, Plan9FS::max_requests_in_flight> messages;
+        Vector<NonnullRefPtr<Plan9FS::ReceiveCompletion>, Plan9FS::max_requests_in_flight> completions;
+        ScopeGuard detach_destinations = [&] {
+            for (auto& completion : completions)
+                Plan9FS::detach_payload_destination(completion);
+        };
+
+        // Replies for the rest of a batch we stop early on still have to be
+        // collected, or they would arrive for tags nobody is waiting on.
+        size_t next_pending = 0;
+        ScopeGuard drain_pending = [&] {
+            for (size_t i = next_pending; i < messages.size(); ++i)
+                fs().drain_reply(messages[i], completions[i]);
+        };
+
+        for (size_t position = nread; position < size && messages.size() < Plan9FS::max_requests_in_flight; position += chunk_size) {
+            size_t length = min(chunk_size, size - position);
+            auto message = adopt_own_if_nonnull(new (nothrow) Plan9FS::Message { fs(), Plan9FS::Message::Type::Tread });
+            if (!message)
+                return ENOMEM;
+            *message << fid() << (u64)(offset + position) << (u32)length;
+            auto completion_or_error = fs().post_message_for_reply(*message, direct_destination(position, length), length);
+            if (completion_or_error.is_error())
+                return completion_or_error.error();
+            messages.append(message.release_nonnull());
+            completions.append(completion_or_error.release_value());
+        }
+
+        for (size_t i = 0; i < messages.size(); ++i) {
+            size_t requested = min(chunk_size, size - nread);
+            next_pending = i + 1;
+            auto result = fs().wait_for_reply(messages[i], completions[i]);
+            if (result.is_error()) {
+                if (nread > 0)
+                    return nread;
+                return result;
+            }
+
+            size_t length;
+            if (completions[i]->received_payload_directly) {
+                length = min(completions[i]->payload_size, requested);
+            } else {
+                auto data = messages[i].read_data();
+                length = min(data.length(), requested);
+                result = callback(nread, data.substring_view(0, length));
+                if (result.is_error())
+                    return result;
+            }
+            nread += length;
+
+            if (length < requested)
+                return nread;
+        }
+    }
+    return nread;
+}
+
+void Plan9FSInode::invalidate_readahead()
+{
+    MutexLocker locker(m_readahead_lock);
+    m_readahead_buffer = nullptr;
+    m_readahead_size = 0;
+}
+
 KResultOr<size_t> Plan9FSInode::read_bytes(off_t offset, size_t size, UserOrKernelBuffer& buffer, FileDescription*) const
 {
     auto result = const_cast<Plan9FSInode&>(*this).ensure_open_for_mode(O_RDONLY);
     if (result.is_error())
         return result;
 
-    size = fs().adjust_buffer_size(size);
-
-    Plan9FS::Message message { fs(), Plan9FS::Message::Type::Treadlink };
-    StringView data;
-
-    bool readlink_succeded = false;
-    if (fs().m_remote_protocol_version >= Plan9FS::ProtocolVersion::v9P2000L && offset == 0) {
+    if ((m_qid_type & Plan9FS::qid_type_symlink) && fs().m_remote_protocol_version >= Plan9FS::ProtocolVersion::v9P2000L && offset == 0) {
+        Plan9FS::Message message { fs(), Plan9FS::Message::Type::Treadlink };
         message << fid();
         result = fs().post_message_and_wait_for_a_reply(message);
         if (result.is_success()) {
-            readlink_succeded = true;
+            StringView data;
             message >> data;
+            size_t nread = min(data.length(), size);
+            if (!buffer.write(data.characters_without_null_termination(), nread))
+                return EFAULT;
+            return nread;
         }
     }
 
-    if (!readlink_succeded) {
-        message = Plan9FS::Message { fs(), Plan9FS::Message::Type::Tread };
-        message << fid() << (u64)offset << (u32)size;
-        result = fs().post_message_and_wait_for_a_reply(message);
-        if (result.is_error())
-            return result.error();
-        data = message.read_data();
+    size_t nread = 0;
+    bool is_sequential;
+    {
+        MutexLocker locker(m_readahead_lock);
+        is_sequential = static_cast<u64>(offset) == m_last_read_end;
+        u64 readahead_end = m_readahead_offset + m_readahead_size;
+        if (m_readahead_buffer && static_cast<u64>(offset) >= m_readahead_offset && static_cast<u64>(offset) < readahead_end) {
+            nread = min(size, static_cast<size_t>(readahead_end - offset));
+            if (!buffer.write(m_readahead_buffer->data() + (offset - m_readahead_offset), nread))
+                return EFAULT;
+            m_last_read_end = offset + nread;
+            if (nread == size)
+                return nread;
+        }
     }
 
-    size_t nread = min(data.length(), size);
-    if (!buffer.write(data.characters_without_null_termination(), nread))
-        return EFAULT;
+    size_t demand = size - nread;
+    OwnPtr<KBuffer> prefetch_buffer;
+    if (is_sequential)
+        prefetch_buffer = KBuffer::try_create_with_size(readahead_window);
+    size_t prefetch = prefetch_buffer ? readahead_window : 0;
+
+    u64 remote_offset = offset + nread;
+    auto direct_destination = [&](size_t position, size_t length) -> u8* {
+        if (position >= demand)
+            return prefetch_buffer->data() + (position - demand);
+        if (position + length <= demand && buffer.is_kernel_buffer())
+            return static_cast<u8*>(buffer.user_or_kernel_ptr()) + nread + position;
+        return nullptr;
+    };
+    auto nread_remote_or_error = read_remote(remote_offset, demand + prefetch, move(direct_destination), [&](size_t position, StringView data) -> KResult {
+        if (position < demand) {
+            size_t to_caller = min(data.length(), demand - position);
+            if (!buffer.offset(nread + position).write(data.characters_without_null_termination(), to_caller))
+                return EFAULT;
+            data = data.substring_view(to_caller);
+            position += to_caller;
+        }
+        if (!data.is_empty())
+            memcpy(prefetch_buffer->data() + (position - demand), data.characters_without_null_termination(), data.length());
+        return KSuccess;
+    });
+    if (nread_remote_or_error.is_error()) {
+        if (nread > 0)
+            return nread;
+        return nread_remote_or_error.error();
+    }
+    size_t nread_remote = nread_remote_or_error.value();
 
+    MutexLocker locker(m_readahead_lock);
+    if (nread_remote > demand) {
+        m_readahead_buffer = move(prefetch_buffer);
+        m_readahead_offset = remote_offset + demand;
+        m_readahead_size = nread_remote - demand;
+    }
+    nread += min(nread_remote, demand);
+    m_last_read_end = offset + nread;
     return nread;
 }
 
@@ -752,25 +1038,83 @@ KResultOr<size_t> Plan9FSInode::write_bytes(off_t offset, size_t size, const Use
     if (result.is_error())
         return result.error();
 
-    size = fs().adjust_buffer_size(size);
+    invalidate_readahead();
+    invalidate_cached_metadata();
+
+    size_t chunk_size = fs().adjust_buffer_size(size);
+    size_t nwritten = 0;
+
+    while (nwritten < size) {
+        NonnullOwnPtrVector<Plan9FS::Message, Plan9FS::max_requests_in_flight> messages;
+        Vector<NonnullRefPtr<Plan9FS::ReceiveCompletion>, Plan9FS::max_requests_in_flight> completions;
+        size_t next_pending = 0;
+        ScopeGuard drain_pending = [&] {
+            for (size_t i = next_pending; i < messages.size(); ++i)
+                fs().drain_reply(messages[i], completions[i]);
+        };
+
+        for (size_t position = nwritten; position < size && messages.size() < Plan9FS::max_requests_in_flight; position += chunk_size) {
+            size_t length = min(chunk_size, size - position);
+            auto data_copy = data.offset(position).copy_into_string(length); // FIXME: this seems ugly
+            if (data_copy.is_null())
+                return EFAULT;
+
+            auto message = adopt_own_if_nonnull(new (nothrow) Plan9FS::Message { fs(), Plan9FS::Message::Type::Twrite });
+            if (!message)
+                return ENOMEM;
+            *message << fid() << (u64)(offset + position);
+            message->append_data(data_copy);
+            auto completion_or_error = fs().post_message_for_reply(*message);
+            if (completion_or_error.is_error())
+                return completion_or_error.error();
+            messages.append(message.release_nonnull());
+            completions.append(completion_or_error.release_value());
+        }
 
-    auto data_copy = data.copy_into_string(size); // FIXME: this seems ugly
-    if (data_copy.is_null())
-        return EFAULT;
+        for (size_t i = 0; i < messages.size(); ++i) {
+            size_t requested = min(chunk_size, size - nwritten);
+            next_pending = i + 1;
+            result = fs().wait_for_reply(messages[i], completions[i]);
+            if (result.is_error()) {
+                if (nwritten > 0)
+                    return nwritten;
+                return result.error();
+            }
 
-    Plan9FS::Message message { fs(), Plan9FS::Message::Type::Twrite };
-    message << fid() << (u64)offset;
-    message.append_data(data_copy);
-    result = fs().post_message_and_wait_for_a_reply(message);
-    if (result.is_error())
-        return result.error();
+            u32 count;
+            messages[i] >> count;
+            nwritten += count;
 
-    u32 nwritten;
-    message >> nwritten;
+            if (count < requested)
+                return nwritten;
+        }
+    }
     return nwritten;
 }
 
+bool Plan9FSInode::has_expired(Time cached_at) const
+{
+    return TimeManagement::the().monotonic_time() - cached_at >= Time::from_milliseconds(Plan9FS::cache_timeout_ms);
+}
+
 InodeMetadata Plan9FSInode::metadata() const
+{
+    if (fs().cache_mode() != Plan9FS::CacheMode::None) {
+        MutexLocker locker(m_cache_lock);
+        if (m_cached_metadata.has_value() && !has_expired(m_metadata_cached_at))
+            return m_cached_metadata.value();
+    }
+
+    auto metadata_or_error = fetch_metadata();
+    if (metadata_or_error.is_error()) {
+        InodeMetadata metadata;
+        metadata.inode = identifier();
+        return metadata;
+    }
+    return metadata_or_error.release_value();
+}
+
+KResultOr<InodeMetadata> Plan9FSInode::fetch_metadata() const
 {
     InodeMetadata metadata;
     metadata.inode = identifier();
@@ -778,10 +1122,8 @@ InodeMetadata Plan9FSInode::metadata() const
     Plan9FS::Message message { fs(), Plan9FS::Message::Type::Tgetattr };
     message << fid() << (u64)GetAttrMask::Basic;
     auto result = fs().post_message_and_wait_for_a_reply(message);
-    if (result.is_error()) {
-
-        return metadata;
-    }
+    if (result.is_error())
+        return result;
 
     u64 valid;
     Plan9FS::qid qid;
@@ -818,19 +1160,123 @@ InodeMetadata Plan9FSInode::metadata() const
         metadata.block_count = blocks;
     }
 
+    MutexLocker locker(m_cache_lock);
+    m_qid_version = qid.version;
+    if (fs().cache_mode() != Plan9FS::CacheMode::None) {
+        m_cached_metadata = metadata;
+        m_metadata_cached_at = TimeManagement::the().monotonic_time();
+    }
     return metadata;
 }
 
+void Plan9FSInode::invalidate_cached_metadata()
+{
+    MutexLocker locker(m_cache_lock);
+    m_cached_metadata.clear();
+}
+
+bool Plan9FSInode::directory_cache_is_valid() const
+{
+    auto cache_mode = fs().cache_mode();
+    if (cache_mode == Plan9FS::CacheMode::None)
+        return false;
+
+    u32 cached_version;
+    {
+        MutexLocker locker(m_cache_lock);
+        if (!m_has_directory_cache)
+            return false;
+        if (!has_expired(m_directory_cached_at))
+            return true;
+        cached_version = m_directory_cached_version;
+    }
+
+    // In fscache mode a single Tgetattr on the directory revalidates every
+    // cached walk and readdir entry at once, as long as its qid.version is unchanged.
+    if (cache_mode == Plan9FS::CacheMode::FSCache && !fetch_metadata().is_error()) {
+        MutexLocker locker(m_cache_lock);
+        if (m_has_directory_cache && m_qid_version == cached_version) {
+            m_directory_cached_at = TimeManagement::the().monotonic_time();
+            return true;
+        }
+    }
+
+    invalidate_directory_cache();
+    return false;
+}
+
+void Plan9FSInode::start_directory_cache() const
+{
+    {
+        MutexLocker locker(m_cache_lock);
+        if (m_has_directory_cache)
+            return;
+    }
+    if (fs().cache_mode() == Plan9FS::CacheMode::FSCache)
+        (void)fetch_metadata();
+
+    MutexLocker locker(m_cache_lock);
+    if (m_has_directory_cache)
+        return;
+    m_has_directory_cache = true;
+    m_directory_cached_at = TimeManagement::the().monotonic_time();
+    m_directory_cached_version = m_qid_version;
+}
+
+void Plan9FSInode::invalidate_directory_cache() const
+{
+    HashMap<String, NonnullRefPtr<Plan9FSInode>> lookups_to_drop;
+    {
+        MutexLocker locker(m_cache_lock);
+        m_has_directory_cache = false;
+        m_cached_directory_entries.clear();
+        lookups_to_drop = move(m_cached_lookups);
+    }
+}
+
 void Plan9FSInode::flush_metadata()
 {
 }
 
 KResult Plan9FSInode::traverse_as_directory(Function<bool(FileSystem::DirectoryEntryView const&)> callback) const
+{
+    return traverse_as_directory_from(0, move(callback));
+}
+
+KResult Plan9FSInode::traverse_as_directory_from(u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)> callback) const
 {
     KResult result = KSuccess;
 
+    if (directory_cache_is_valid()) {
+        MutexLocker locker(m_cache_lock);
+        if (m_cached_directory_entries.has_value()) {
+            auto& entries = m_cached_directory_entries.value();
+            size_t first_entry = 0;
+            if (cookie != 0) {
+                first_entry = entries.size() + 1;
+                for (size_t i = 0; i < entries.size(); ++i) {
+                    if (entries[i].next_cookie == cookie) {
+                        first_entry = i + 1;
+                        break;
+                    }
+                }
+            }
+            if (first_entry <= entries.size()) {
+                for (size_t i = first_entry; i < entries.size(); ++i) {
+                    if (!callback({ entries[i].name, { fsid(), fs().allocate_fid() }, 0, entries[i].next_cookie }))
+                        break;
+                }
+                return KSuccess;
+            }
+        }
+    }
 
     if (fs().m_remote_protocol_version >= Plan9FS::ProtocolVersion::v9P2000L) {
+        bool should_cache = cookie == 0 && fs().cache_mode() != Plan9FS::CacheMode::None;
+        if (should_cache)
+            start_directory_cache();
+        Vector<CachedDirectoryEntry> entries;
+
         auto clone_fid = fs().allocate_fid();
         {
             Plan9FS::Message clone_message { fs(), Plan9FS::Message::Type::Twalk };
@@ -850,10 +1296,11 @@ KResult Plan9FSInode::traverse_as_directory(Function<bool(FileSystem::DirectoryE
             }
         }
 
-        u64 offset = 0;
+        u64 offset = cookie;
         u32 count = fs().adjust_buffer_size(8 * MiB);
+        bool stop = false;
 
-        while (true) {
+        while (!stop) {
             Plan9FS::Message message { fs(), Plan9FS::Message::Type::Treaddir };
             message << clone_fid << offset << count;
             result = fs().post_message_and_wait_for_a_reply(message);
@@ -871,10 +1318,22 @@ KResult Plan9FSInode::traverse_as_directory(Function<bool(FileSystem::DirectoryE
                 u8 type;
                 StringView name;
                 decoder >> qid >> offset >> type >> name;
-                callback({ name, { fsid(), fs().allocate_fid() }, 0 });
+                if (should_cache)
+                    entries.append({ name, offset });
+                if (!callback({ name, { fsid(), fs().allocate_fid() }, 0, offset })) {
+                    should_cache = false;
+                    stop = true;
+                    break;
+                }
             }
         }
 
+        if (should_cache && result.is_success()) {
+            MutexLocker locker(m_cache_lock);
+            if (m_has_directory_cache)
+                m_cached_directory_entries = move(entries);
+        }
+
         Plan9FS::Message close_message { fs(), Plan9FS::Message::Type::Tclunk };
         close_message << clone_fid;
 
@@ -888,6 +1347,16 @@ KResult Plan9FSInode::traverse_as_directory(Function<bool(FileSystem::DirectoryE
 
 RefPtr<Inode> Plan9FSInode::lookup(StringView name)
 {
+    if (directory_cache_is_valid()) {
+        MutexLocker locker(m_cache_lock);
+        if (auto cached_inode = m_cached_lookups.get(name); cached_inode.has_value())
+            return cached_inode.value();
+    }
+
+    bool should_cache = fs().cache_mode() != Plan9FS::CacheMode::None;
+    if (should_cache)
+        start_directory_cache();
+
     u32 newfid = fs().allocate_fid();
     Plan9FS::Message message { fs(), Plan9FS::Message::Type::Twalk };
     message << fid() << newfid << (u16)1 << name;
@@ -896,7 +1365,20 @@ RefPtr<Inode> Plan9FSInode::lookup(StringView name)
     if (result.is_error())
         return nullptr;
 
-    return Plan9FSInode::create(fs(), newfid);
+    u16 nwqid;
+    message >> nwqid;
+    if (nwqid != 1)
+        return nullptr;
+    Plan9FS::qid qid;
+    message >> qid;
+
+    auto inode = Plan9FSInode::create(fs(), newfid, qid.type);
+    if (should_cache) {
+        MutexLocker locker(m_cache_lock);
+        if (m_has_directory_cache)
+            m_cached_lookups.set(name, inode);
+    }
+    return inode;
 }
 
 KResultOr<NonnullRefPtr<Inode>> Plan9FSInode::create_child(StringView, mode_t, dev_t, uid_t, gid_t)
@@ -926,6 +1408,9 @@ KResult Plan9FSInode::chown(uid_t, gid_t)
 
 KResult Plan9FSInode::truncate(u64 new_size)
 {
+    invalidate_readahead();
+    invalidate_cached_metadata();
+
     if (fs().m_remote_protocol_version >= Plan9FS::ProtocolVersion::v9P2000L) {
         Plan9FS::Message message { fs(), Plan9FS::Message::Type::Tsetattr };
         SetAttrMask valid = SetAttrMask::Size;
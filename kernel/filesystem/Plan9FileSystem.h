@@ -8,6 +8,9 @@
 
 // includes
 #include <base/Atomic.h>
+#include <base/HashMap.h>
+#include <base/Optional.h>
+#include <base/Time.h>
 #include <kernel/filesystem/FileBackedFileSystem.h>
 #include <kernel/filesystem/Inode.h>
 #include <kernel/KBufferBuilder.h>
@@ -20,8 +23,17 @@ class Plan9FS final : public FileBackedFileSystem {
     friend class Plan9FSInode;
 
 public:
+    enum class CacheMode {
+        None,
+        Loose,
+        FSCache,
+    };
+
     virtual ~Plan9FS() override;
-    static NonnullRefPtr<Plan9FS> create(FileDescription&);
+    static NonnullRefPtr<Plan9FS> create(FileDescription&, CacheMode = default_cache_mode());
+
+    static Optional<CacheMode> parse_cache_mode(StringView);
+    static CacheMode default_cache_mode();
 
     virtual bool initialize() override;
 
@@ -29,7 +41,7 @@ public:
 
     virtual Inode& root_inode() override;
 
-    u16 allocate_tag() { return m_next_tag++; }
+    u16 allocate_tag();
     u32 allocate_fid() { return m_next_fid++; }
 
     enum class ProtocolVersion {
@@ -44,10 +56,18 @@ public:
         u64 path;
     };
 
+    static constexpr u8 qid_type_symlink = 0x02;
+
+    static constexpr size_t max_requests_in_flight = 16;
+
+    static constexpr i64 cache_timeout_ms = 1000;
+
+    CacheMode cache_mode() const { return m_cache_mode; }
+
     class Message;
 
 private:
-    Plan9FS(FileDescription&);
+    Plan9FS(FileDescription&, CacheMode);
 
     class Blocker;
 
@@ -77,6 +97,16 @@ private:
         OwnPtr<Message> message;
         KResult result { KSuccess };
 
+        Mutex payload_lock { "Plan9FS payload" };
+        u8* payload_destination { nullptr };
+        size_t payload_capacity { 0 };
+        size_t payload_size { 0 };
+        bool received_payload_directly { false };
+
+        // A request whose waiter gave up is flushed; the Tflush names its tag.
+        bool is_being_flushed { false };
+        Optional<u16> flushed_tag;
+
         ReceiveCompletion(u16 tag);
         ~ReceiveCompletion();
     };
@@ -120,7 +150,13 @@ private:
     KResult post_message(Message&, RefPtr<ReceiveCompletion>);
     KResult do_read(u8* buffer, size_t);
     KResult read_and_dispatch_one_message();
+    OwnPtr<KBuffer> take_receive_buffer(size_t);
+    void return_receive_buffer(NonnullOwnPtr<KBuffer>);
+    static void detach_payload_destination(ReceiveCompletion&);
     KResult post_message_and_wait_for_a_reply(Message&);
+    KResultOr<NonnullRefPtr<ReceiveCompletion>> post_message_for_reply(Message&, u8* payload_destination = nullptr, size_t payload_capacity = 0);
+    KResult wait_for_reply(Message&, NonnullRefPtr<ReceiveCompletion>);
+    void drain_reply(Message&, NonnullRefPtr<ReceiveCompletion>);
     KResult post_message_and_explicitly_ignore_reply(Message&);
 
     ProtocolVersion parse_protocol_version(const StringView&) const;
@@ -134,7 +170,12 @@ private:
     Atomic<u32> m_next_fid { 1 };
 
     ProtocolVersion m_remote_protocol_version { ProtocolVersion::v9P2000 };
-    size_t m_max_message_size { 4 * KiB };
+    size_t m_max_message_size { 64 * KiB };
+    CacheMode m_cache_mode { CacheMode::None };
+
+    static constexpr size_t max_pooled_receive_buffers = max_requests_in_flight;
+    SpinLock<u8> m_receive_buffers_lock;
+    Vector<NonnullOwnPtr<KBuffer>, max_pooled_receive_buffers> m_receive_buffers;
 
     Mutex m_send_lock { "Plan9FS send" };
     Plan9FSBlockCondition m_completion_blocker;
@@ -159,6 +200,7 @@ public:
     virtual KResultOr<size_t> read_bytes(off_t, size_t, UserOrKernelBuffer& buffer, FileDescription*) const override;
     virtual KResultOr<size_t> write_bytes(off_t, size_t, const UserOrKernelBuffer& data, FileDescription*) override;
     virtual KResult traverse_as_directory(Function<bool(FileSystem::DirectoryEntryView const&)>) const override;
+    virtual KResult traverse_as_directory_from(u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)>) const override;
     virtual RefPtr<Inode> lookup(StringView name) override;
     virtual KResultOr<NonnullRefPtr<Inode>> create_child(StringView name, mode_t, dev_t, uid_t, gid_t) override;
     virtual KResult add_child(Inode&, const StringView& name, mode_t) override;
@@ -168,8 +210,25 @@ public:
     virtual KResult truncate(u64) override;
 
 private:
-    Plan9FSInode(Plan9FS&, u32 fid);
-    static NonnullRefPtr<Plan9FSInode> create(Plan9FS&, u32 fid);
+    Plan9FSInode(Plan9FS&, u32 fid, u8 qid_type);
+    static NonnullRefPtr<Plan9FSInode> create(Plan9FS&, u32 fid, u8 qid_type);
+
+    static constexpr size_t readahead_window = 128 * KiB;
+
+    KResultOr<size_t> read_remote(u64 offset, size_t size, Function<u8*(size_t, size_t)> direct_destination, Function<KResult(size_t, StringView)>) const;
+    void invalidate_readahead();
+
+    struct CachedDirectoryEntry {
+        String name;
+        u64 next_cookie { 0 };
+    };
+
+    KResultOr<InodeMetadata> fetch_metadata() const;
+    bool has_expired(Time cached_at) const;
+    bool directory_cache_is_valid() const;
+    void start_directory_cache() const;
+    void invalidate_cached_metadata();
+    void invalidate_directory_cache() const;
 
     enum class GetAttrMask : u64 {
         Mode = 0x1,
@@ -204,7 +263,24 @@ private:
         MTimeSet = 0x100
     };
 
+    u8 m_qid_type { 0 };
     int m_open_mode { 0 };
+
+    mutable Mutex m_readahead_lock { "Plan9FSInode readahead" };
+    mutable OwnPtr<KBuffer> m_readahead_buffer;
+    mutable u64 m_readahead_offset { 0 };
+    mutable size_t m_readahead_size { 0 };
+    mutable u64 m_last_read_end { 0 };
+
+    mutable Mutex m_cache_lock { "Plan9FSInode cache" };
+    mutable u32 m_qid_version { 0 };
+    mutable Optional<InodeMetadata> m_cached_metadata;
+    mutable Time m_metadata_cached_at;
+    mutable bool m_has_directory_cache { false };
+    mutable Time m_directory_cached_at;
+    mutable u32 m_directory_cached_version { 0 };
+    mutable Optional<Vector<CachedDirectoryEntry>> m_cached_directory_entries;
+    mutable HashMap<String, NonnullRefPtr<Plan9FSInode>> m_cached_lookups;
     KResult ensure_open_for_mode(int mode);
 
     Plan9FS& fs() { return reinterpret_cast<Plan9FS&>(Inode::fs()); }
@@ -7,7 +7,9 @@
 // includes
 #include <base/Singleton.h>
 #include <base/StringView.h>
+#include <kernel/devices/SysFSBlockDevices.h>
 #include <kernel/filesystem/SysFS.h>
+#include <kernel/interrupts/SysFSInterrupts.h>
 #include <kernel/Sections.h>
 
 namespace Kernel {
@@ -60,6 +62,8 @@ SysFSRootDirectory::SysFSRootDirectory()
     auto buses_directory = SysFSBusDirectory::must_create(*this);
     m_components.append(buses_directory);
     m_buses_directory = buses_directory;
+    m_components.append(SysFSBlockDevicesDirectory::must_create(*this));
+    m_components.append(SysFSInterruptsDirectory::must_create(*this));
 }
 
 NonnullRefPtr<SysFS> SysFS::create()
@@ -164,6 +168,12 @@ KResult SysFSInode::truncate(u64)
     return EPERM;
 }
 
+void SysFSInode::did_seek(FileDescription& description, off_t new_offset)
+{
+    if (new_offset == 0)
+        description.data() = nullptr;
+}
+
 NonnullRefPtr<SysFSDirectoryInode> SysFSDirectoryInode::create(SysFS const& sysfs, SysFSComponent const& component)
 {
     return adopt_ref(*new (nothrow) SysFSDirectoryInode(sysfs, component));
@@ -96,6 +96,7 @@ protected:
     virtual KResult chmod(mode_t) override;
     virtual KResult chown(uid_t, gid_t) override;
     virtual KResult truncate(u64) override;
+    virtual void did_seek(FileDescription&, off_t) override;
 
     NonnullRefPtr<SysFSComponent> m_associated_component;
 };
@@ -27,6 +27,166 @@ SysFSComponent::SysFSComponent(StringView name)
 {
 }
 
+RefPtr<SysFSContentSnapshot> SysFSContentSnapshot::create()
+{
+    return adopt_ref_if_nonnull(new (nothrow) SysFSContentSnapshot);
+}
+
+KResult SysFSContentSnapshot::append(ReadonlyBytes bytes)
+{
+    while (!bytes.is_empty()) {
+        size_t offset_in_chunk = m_size % chunk_size;
+        if (offset_in_chunk == 0) {
+            auto chunk = KBuffer::try_create_with_size(chunk_size, Memory::Region::Access::ReadWrite, "SysFS content snapshot");
+            if (!chunk)
+                return ENOMEM;
+            if (!m_chunks.try_append(chunk.release_nonnull()))
+                return ENOMEM;
+        }
+        size_t nbytes = min(bytes.size(), chunk_size - offset_in_chunk);
+        memcpy(m_chunks.last()->data() + offset_in_chunk, bytes.data(), nbytes);
+        m_size += nbytes;
+        bytes = bytes.slice(nbytes);
+    }
+    return KSuccess;
+}
+
+KResultOr<size_t> SysFSContentSnapshot::read(off_t offset, size_t count, UserOrKernelBuffer& buffer) const
+{
+    if (static_cast<u64>(offset) >= m_size)
+        return 0;
+    count = min(count, m_size - offset);
+
+    size_t nread = 0;
+    while (nread < count) {
+        size_t position = offset + nread;
+        size_t offset_in_chunk = position % chunk_size;
+        size_t nbytes = min(count - nread, chunk_size - offset_in_chunk);
+        if (!buffer.offset(nread).write(m_chunks[position / chunk_size]->data() + offset_in_chunk, nbytes))
+            return EFAULT;
+        nread += nbytes;
+    }
+    return nread;
+}
+
+KResult SysFSContentWriter::append(ReadonlyBytes bytes)
+{
+    u64 start = m_generated;
+    m_generated += bytes.size();
+
+    if (m_snapshot)
+        return m_snapshot->append(bytes);
+    if (!m_window)
+        return KSuccess;
+
+    u64 window_end = m_offset + m_count;
+    if (m_generated <= m_offset || start >= window_end)
+        return KSuccess;
+
+    u64 copy_start = max(start, m_offset);
+    u64 copy_end = min(static_cast<u64>(m_generated), window_end);
+    if (!m_window->offset(copy_start - m_offset).write(bytes.data() + (copy_start - start), copy_end - copy_start))
+        return EFAULT;
+    return KSuccess;
+}
+
+size_t SysFSContentWriter::window_nread() const
+{
+    if (m_generated <= m_offset)
+        return 0;
+    return min(static_cast<u64>(m_count), m_generated - m_offset);
+}
+
+SysFSGeneratedComponent::SysFSGeneratedComponent(StringView name)
+    : SysFSComponent(name)
+{
+}
+
+KResultOr<NonnullRefPtr<SysFSContentSnapshot>> SysFSGeneratedComponent::take_snapshot() const
+{
+    auto snapshot = SysFSContentSnapshot::create();
+    if (!snapshot)
+        return ENOMEM;
+    auto writer = SysFSContentWriter::into_snapshot(*snapshot);
+    auto result = generate(writer);
+    if (result.is_error())
+        return result;
+    return snapshot.release_nonnull();
+}
+
+KResultOr<size_t> SysFSGeneratedComponent::read_bytes(off_t offset, size_t count, UserOrKernelBuffer& buffer, FileDescription* description) const
+{
+    // A read from the start begins a new pass over the content, so only reads
+    // further in are served from the snapshot taken earlier.
+    if (description && description->data() && offset != 0)
+        return static_cast<SnapshotData&>(*description->data()).snapshot->read(offset, count, buffer);
+
+    // Without an open description there is no later read to stay consistent
+    // with, and immutable content renders the same every time, so both can be
+    // generated straight into the reader's buffer.
+    if (content_is_immutable() || !description) {
+        auto writer = SysFSContentWriter::into_window(offset, count, buffer);
+        auto result = generate(writer);
+        if (result.is_error())
+            return result;
+        return writer.window_nread();
+    }
+
+    // Everything else is snapshotted on the first read, whatever its offset,
+    // and again on every read from offset 0.
+    auto snapshot_or_error = take_snapshot();
+    if (snapshot_or_error.is_error())
+        return snapshot_or_error.error();
+    auto snapshot = snapshot_or_error.release_value();
+
+    if (description->data()) {
+        static_cast<SnapshotData&>(*description->data()).snapshot = snapshot;
+        return snapshot->read(offset, count, buffer);
+    }
+    auto data = adopt_own_if_nonnull(new (nothrow) SnapshotData(snapshot));
+    if (!data)
+        return ENOMEM;
+    description->data() = move(data);
+    return snapshot->read(offset, count, buffer);
+}
+
+size_t SysFSGeneratedComponent::size() const
+{
+    auto writer = SysFSContentWriter::counting();
+    if (generate(writer).is_error())
+        return 0;
+    return writer.generated();
+}
+
+SysFSAttribute::SysFSAttribute(StringView name)
+    : SysFSGeneratedComponent(name)
+{
+}
+
+KResultOr<size_t> SysFSAttribute::write_bytes(off_t, size_t count, UserOrKernelBuffer const& buffer, FileDescription*)
+{
+    if (!is_writable())
+        return EROFS;
+    if (count > max_written_value_length)
+        return EINVAL;
+
+    auto value = buffer.copy_into_string(count);
+    if (value.is_null())
+        return EFAULT;
+    if (auto result = write_value(value.view().trim_whitespace()); result.is_error())
+        return result;
+    return count;
+}
+
+Optional<bool> SysFSAttribute::parse_boolean(StringView value)
+{
+    if (value == "0"sv)
+        return false;
+    if (value == "1"sv)
+        return true;
+    return {};
+}
+
 KResult SysFSDirectory::traverse_as_directory(unsigned fsid, Function<bool(FileSystem::DirectoryEntryView const&)> callback) const
 {
     MutexLocker locker(SysFSComponentRegistry::the().get_lock());
@@ -62,6 +222,64 @@ SysFSDirectory::SysFSDirectory(StringView name, SysFSDirectory const& parent_dir
 {
 }
 
+SysFSDynamicDirectory::SysFSDynamicDirectory(StringView name, SysFSDirectory const& parent_directory)
+    : SysFSDirectory(name, parent_directory)
+{
+}
+
+void SysFSDynamicDirectory::refresh_children() const
+{
+    VERIFY(m_lock.is_locked());
+    m_next_children.clear();
+    update_children();
+    m_children = move(m_next_children);
+}
+
+RefPtr<SysFSComponent> SysFSDynamicDirectory::previous_child(StringView name) const
+{
+    VERIFY(m_lock.is_locked());
+    auto it = m_children.find(name);
+    if (it == m_children.end())
+        return {};
+    return it->value;
+}
+
+void SysFSDynamicDirectory::add_child(NonnullRefPtr<SysFSComponent> child) const
+{
+    VERIFY(m_lock.is_locked());
+    m_next_children.set(child->name(), move(child));
+}
+
+KResult SysFSDynamicDirectory::traverse_as_directory(unsigned fsid, Function<bool(FileSystem::DirectoryEntryView const&)> callback) const
+{
+    MutexLocker locker(m_lock);
+    refresh_children();
+
+    VERIFY(m_parent_directory);
+    if (!callback({ ".", { fsid, component_index() }, 0 }))
+        return KSuccess;
+    if (!callback({ "..", { fsid, m_parent_directory->component_index() }, 0 }))
+        return KSuccess;
+    for (auto& component : m_components) {
+        if (!callback({ component.name(), { fsid, component.component_index() }, 0 }))
+            return KSuccess;
+    }
+    for (auto& it : m_children) {
+        if (!callback({ it.value->name(), { fsid, it.value->component_index() }, 0 }))
+            break;
+    }
+    return KSuccess;
+}
+
+RefPtr<SysFSComponent> SysFSDynamicDirectory::lookup(StringView name)
+{
+    if (auto component = SysFSDirectory::lookup(name))
+        return component;
+    MutexLocker locker(m_lock);
+    refresh_children();
+    return previous_child(name);
+}
+
 NonnullRefPtr<Inode> SysFSDirectory::to_inode(SysFS const& sysfs_instance) const
 {
     return SysFSDirectoryInode::create(sysfs_instance, *this);
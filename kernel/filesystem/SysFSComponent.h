@@ -8,14 +8,19 @@
 
 // includes
 #include <base/Function.h>
+#include <base/HashMap.h>
+#include <base/Optional.h>
 #include <base/RefCounted.h>
 #include <base/RefPtr.h>
 #include <base/StringView.h>
 #include <base/Types.h>
 #include <kernel/filesystem/File.h>
+#include <kernel/filesystem/FileDescription.h>
 #include <kernel/filesystem/FileSystem.h>
 #include <kernel/Forward.h>
+#include <kernel/KBuffer.h>
 #include <kernel/KResult.h>
+#include <kernel/locking/Mutex.h>
 
 namespace Kernel {
 
@@ -42,6 +47,92 @@ private:
     InodeIndex m_component_index {};
 };
 
+class SysFSContentSnapshot : public RefCounted<SysFSContentSnapshot> {
+public:
+    static constexpr size_t chunk_size = 4 * PAGE_SIZE;
+
+    static RefPtr<SysFSContentSnapshot> create();
+
+    KResult append(ReadonlyBytes);
+    KResultOr<size_t> read(off_t, size_t, UserOrKernelBuffer&) const;
+    size_t size() const { return m_size; }
+
+private:
+    SysFSContentSnapshot() = default;
+
+    Vector<NonnullOwnPtr<KBuffer>> m_chunks;
+    size_t m_size { 0 };
+};
+
+class SysFSContentWriter {
+public:
+    static SysFSContentWriter into_window(off_t offset, size_t count, UserOrKernelBuffer& buffer) { return { offset, count, &buffer, nullptr }; }
+    static SysFSContentWriter into_snapshot(SysFSContentSnapshot& snapshot) { return { 0, 0, nullptr, &snapshot }; }
+    static SysFSContentWriter counting() { return { 0, 0, nullptr, nullptr }; }
+
+    KResult append(ReadonlyBytes);
+    KResult append(StringView string) { return append(string.bytes()); }
+
+    size_t generated() const { return m_generated; }
+    size_t window_nread() const;
+
+private:
+    SysFSContentWriter(off_t offset, size_t count, UserOrKernelBuffer* window, SysFSContentSnapshot* snapshot)
+        : m_offset(offset)
+        , m_count(count)
+        , m_window(window)
+        , m_snapshot(snapshot)
+    {
+    }
+
+    u64 m_offset { 0 };
+    size_t m_count { 0 };
+    UserOrKernelBuffer* m_window { nullptr };
+    SysFSContentSnapshot* m_snapshot { nullptr };
+    u64 m_generated { 0 };
+};
+
+class SysFSGeneratedComponent : public SysFSComponent {
+public:
+    virtual KResultOr<size_t> read_bytes(off_t, size_t, UserOrKernelBuffer&, FileDescription*) const override;
+    virtual size_t size() const override;
+
+protected:
+    explicit SysFSGeneratedComponent(StringView name);
+
+    virtual KResult generate(SysFSContentWriter&) const = 0;
+    virtual bool content_is_immutable() const { return false; }
+
+private:
+    class SnapshotData final : public FileDescriptionData {
+    public:
+        explicit SnapshotData(NonnullRefPtr<SysFSContentSnapshot> snapshot)
+            : snapshot(move(snapshot))
+        {
+        }
+        NonnullRefPtr<SysFSContentSnapshot> snapshot;
+    };
+
+    KResultOr<NonnullRefPtr<SysFSContentSnapshot>> take_snapshot() const;
+};
+
+// A generated attribute that may also accept a single short value written to it.
+class SysFSAttribute : public SysFSGeneratedComponent {
+public:
+    virtual KResultOr<size_t> write_bytes(off_t, size_t, UserOrKernelBuffer const&, FileDescription*) override final;
+
+protected:
+    static constexpr size_t max_written_value_length = 32;
+
+    explicit SysFSAttribute(StringView name);
+
+    virtual bool is_writable() const { return false; }
+    // Receives the written value with surrounding whitespace trimmed.
+    virtual KResult write_value(StringView) { return EROFS; }
+
+    static Optional<bool> parse_boolean(StringView);
+};
+
 class SysFSDirectory : public SysFSComponent {
 public:
     virtual KResult traverse_as_directory(unsigned, Function<bool(FileSystem::DirectoryEntryView const&)>) const override;
@@ -56,4 +147,31 @@ protected:
     RefPtr<SysFSDirectory> m_parent_directory;
 };
 
+// A directory whose children mirror kernel objects that come and go. The
+// children are refreshed on every traversal and lookup; entries in
+// m_components are listed ahead of them and never change.
+class SysFSDynamicDirectory : public SysFSDirectory {
+public:
+    virtual KResult traverse_as_directory(unsigned, Function<bool(FileSystem::DirectoryEntryView const&)>) const override;
+    virtual RefPtr<SysFSComponent> lookup(StringView name) override;
+
+protected:
+    SysFSDynamicDirectory(StringView name, SysFSDirectory const& parent_directory);
+
+    // Called with the directory lock held. Implementations call add_child() for
+    // every object that currently exists, reusing previous_child() when it still
+    // refers to the same object.
+    virtual void update_children() const = 0;
+
+    RefPtr<SysFSComponent> previous_child(StringView name) const;
+    void add_child(NonnullRefPtr<SysFSComponent>) const;
+
+private:
+    void refresh_children() const;
+
+    mutable Mutex m_lock;
+    mutable HashMap<String, NonnullRefPtr<SysFSComponent>> m_children;
+    mutable HashMap<String, NonnullRefPtr<SysFSComponent>> m_next_children;
+};
+
 }
@@ -5,7 +5,11 @@
 */
 
 // includes
+#include <kernel/filesystem/InodeCache.h>
 #include <kernel/filesystem/TmpFS.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/memory/ScopedQuickMap.h>
+#include <kernel/memory/SharedInodeVMObject.h>
 #include <kernel/Process.h>
 #include <libc/limits.h>
 
@@ -36,23 +40,6 @@ Inode& TmpFS::root_inode()
     return *m_root_inode;
 }
 
-void TmpFS::register_inode(TmpFSInode& inode)
-{
-    MutexLocker locker(m_lock);
-    VERIFY(inode.identifier().fsid() == fsid());
-
-    auto index = inode.identifier().index();
-    m_inodes.set(index, inode);
-}
-
-void TmpFS::unregister_inode(InodeIdentifier identifier)
-{
-    MutexLocker locker(m_lock);
-    VERIFY(identifier.fsid() == fsid());
-
-    m_inodes.remove(identifier.index());
-}
-
 unsigned TmpFS::next_inode_index()
 {
     MutexLocker locker(m_lock);
@@ -60,15 +47,10 @@ unsigned TmpFS::next_inode_index()
     return m_next_inode_index++;
 }
 
-RefPtr<Inode> TmpFS::get_inode(InodeIdentifier identifier) const
+RefPtr<Inode> TmpFS::get_inode(InodeIdentifier identifier)
 {
-    MutexLocker locker(m_lock, Mutex::Mode::Shared);
     VERIFY(identifier.fsid() == fsid());
-
-    auto it = m_inodes.find(identifier.index());
-    if (it == m_inodes.end())
-        return nullptr;
-    return it->value;
+    return inode_cache().get(identifier.index());
 }
 
 TmpFSInode::TmpFSInode(TmpFS& fs, InodeMetadata metadata, InodeIdentifier parent)
@@ -81,14 +63,14 @@ TmpFSInode::TmpFSInode(TmpFS& fs, InodeMetadata metadata, InodeIdentifier parent
 
 TmpFSInode::~TmpFSInode()
 {
+    m_children.clear();
+    for (auto& it : m_children_by_name)
+        delete it.value;
 }
 
 RefPtr<TmpFSInode> TmpFSInode::create(TmpFS& fs, InodeMetadata metadata, InodeIdentifier parent)
 {
-    auto inode = adopt_ref_if_nonnull(new (nothrow) TmpFSInode(fs, metadata, parent));
-    if (inode)
-        fs.register_inode(*inode);
-    return inode;
+    return adopt_ref_if_nonnull(new (nothrow) TmpFSInode(fs, metadata, parent));
 }
 
 RefPtr<TmpFSInode> TmpFSInode::create_root(TmpFS& fs)
@@ -110,39 +92,114 @@ InodeMetadata TmpFSInode::metadata() const
 }
 
 KResult TmpFSInode::traverse_as_directory(Function<bool(FileSystem::DirectoryEntryView const&)> callback) const
+{
+    return traverse_as_directory_from(0, move(callback));
+}
+
+KResult TmpFSInode::traverse_as_directory_from(u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)> callback) const
 {
     MutexLocker locker(m_inode_lock, Mutex::Mode::Shared);
 
     if (!is_directory())
         return ENOTDIR;
 
-    callback({ ".", identifier(), 0 });
-    callback({ "..", m_parent, 0 });
+    if (cookie == 0 && !callback({ ".", identifier(), 0, 1 }))
+        return KSuccess;
+    if (cookie <= 1 && !callback({ "..", m_parent, 0, first_child_cookie }))
+        return KSuccess;
+
+    auto it = m_children.begin();
+    if (cookie > first_child_cookie) {
+        auto* resume_point = m_children.find_largest_not_above(cookie);
+        if (resume_point) {
+            it = m_children.begin_from(resume_point->cookie);
+            if (resume_point->cookie < cookie)
+                ++it;
+        }
+    }
 
-    for (auto& child : m_children) {
-        callback({ child.name->view(), child.inode->identifier(), 0 });
+    for (; !it.is_end(); ++it) {
+        if (!callback({ it->name->view(), it->inode->identifier(), 0, it->cookie + 1 }))
+            break;
     }
     return KSuccess;
 }
 
+RefPtr<Memory::PhysicalPage> TmpFSInode::page_at(size_t page_index) const
+{
+    size_t chunk_index = page_index / pages_per_chunk;
+    if (chunk_index >= m_page_chunks.size() || !m_page_chunks[chunk_index])
+        return nullptr;
+    return m_page_chunks[chunk_index]->pages[page_index % pages_per_chunk];
+}
+
+KResultOr<NonnullRefPtr<Memory::PhysicalPage>> TmpFSInode::ensure_page(size_t page_index)
+{
+    size_t chunk_index = page_index / pages_per_chunk;
+    if (chunk_index >= m_page_chunks.size()) {
+        if (!m_page_chunks.try_resize(chunk_index + 1))
+            return ENOMEM;
+    }
+
+    auto& chunk = m_page_chunks[chunk_index];
+    if (!chunk) {
+        chunk = adopt_own_if_nonnull(new (nothrow) PageChunk);
+        if (!chunk)
+            return ENOMEM;
+    }
+
+    auto& slot = chunk->pages[page_index % pages_per_chunk];
+    if (!slot) {
+        slot = MM.allocate_user_physical_page(Memory::MemoryManager::ShouldZeroFill::Yes);
+        if (!slot)
+            return ENOMEM;
+    }
+    return *slot;
+}
+
+void TmpFSInode::release_pages_from(size_t page_index)
+{
+    size_t first_chunk_to_drop = (page_index + pages_per_chunk - 1) / pages_per_chunk;
+    if (first_chunk_to_drop < m_page_chunks.size())
+        m_page_chunks.shrink(first_chunk_to_drop);
+
+    size_t chunk_index = page_index / pages_per_chunk;
+    if (chunk_index >= m_page_chunks.size() || !m_page_chunks[chunk_index])
+        return;
+    for (size_t i = page_index % pages_per_chunk; i < pages_per_chunk; ++i)
+        m_page_chunks[chunk_index]->pages[i] = nullptr;
+}
+
 KResultOr<size_t> TmpFSInode::read_bytes(off_t offset, size_t size, UserOrKernelBuffer& buffer, FileDescription*) const
 {
     MutexLocker locker(m_inode_lock, Mutex::Mode::Shared);
     VERIFY(!is_directory());
     VERIFY(offset >= 0);
 
-    if (!m_content)
-        return 0;
-
     if (offset >= m_metadata.size)
         return 0;
 
     if (static_cast<off_t>(size) > m_metadata.size - offset)
         size = m_metadata.size - offset;
 
-    if (!buffer.write(m_content->data() + offset, size))
-        return EFAULT;
-    return size;
+    size_t nread = 0;
+    while (nread < size) {
+        u64 position = offset + nread;
+        size_t offset_in_page = position % PAGE_SIZE;
+        size_t num_bytes_to_copy = min(PAGE_SIZE - offset_in_page, size - nread);
+        auto buffer_offset = buffer.offset(nread);
+
+        auto page = page_at(position / PAGE_SIZE);
+        if (!page) {
+            if (!buffer_offset.memset(0, num_bytes_to_copy))
+                return EFAULT;
+        } else {
+            if (!Memory::copy_from_page(*page, offset_in_page, buffer_offset, num_bytes_to_copy))
+                return EFAULT;
+        }
+        nread += num_bytes_to_copy;
+    }
+    return nread;
 }
 
 KResultOr<size_t> TmpFSInode::write_bytes(off_t offset, size_t size, const UserOrKernelBuffer& buffer, FileDescription*)
@@ -155,39 +212,83 @@ KResultOr<size_t> TmpFSInode::write_bytes(off_t offset, size_t size, const UserO
     if (result.is_error())
         return result;
 
-    off_t old_size = m_metadata.size;
-    off_t new_size = m_metadata.size;
-    if (static_cast<off_t>(offset + size) > new_size)
-        new_size = offset + size;
-
-    if (static_cast<u64>(new_size) > (NumericLimits<size_t>::max() / 2)) 
-        return ENOMEM;                                                   
-
-    if (new_size > old_size) {
-        if (m_content && static_cast<off_t>(m_content->capacity()) >= new_size) {
-            m_content->set_size(new_size);
-        } else {
+    if (Checked<off_t>::addition_would_overflow(offset, size))
+        return EOVERFLOW;
+
+    size_t nwritten = 0;
+    while (nwritten < size) {
+        u64 position = offset + nwritten;
+        size_t offset_in_page = position % PAGE_SIZE;
+        size_t num_bytes_to_copy = min(PAGE_SIZE - offset_in_page, size - nwritten);
+
+        auto page_or_error = ensure_page(position / PAGE_SIZE);
+        if (page_or_error.is_error())
+            return page_or_error.error();
+        if (!Memory::copy_to_page(page_or_error.value(), offset_in_page, buffer.offset(nwritten), num_bytes_to_copy))
+            return EFAULT;
+        nwritten += num_bytes_to_copy;
+    }
 
-            auto tmp = KBuffer::try_create_with_size(new_size * 2);
-            if (!tmp)
-                return ENOMEM;
-            tmp->set_size(new_size);
-            if (m_content)
-                memcpy(tmp->data(), m_content->data(), old_size);
-            m_content = move(tmp);
-        }
+    off_t new_size = offset + size;
+    if (new_size > m_metadata.size) {
         m_metadata.size = new_size;
         set_metadata_dirty(true);
         set_metadata_dirty(false);
+        result = sync_shared_vmobject();
+        if (result.is_error())
+            return result;
     }
 
-    if (!buffer.read(m_content->data() + offset, size)) 
-        return EFAULT;
-
     did_modify_contents();
     return size;
 }
 
+KResultOr<NonnullRefPtr<Memory::VMObject>> TmpFSInode::try_create_mmap_vmobject()
+{
+    VERIFY(!is_directory());
+    auto vmobject = Memory::SharedInodeVMObject::try_create_with_inode(*this);
+    if (!vmobject)
+        return ENOMEM;
+
+    MutexLocker locker(m_inode_lock);
+    if (auto result = sync_shared_vmobject(); result.is_error())
+        return result;
+    return vmobject.release_nonnull();
+}
+
+KResult TmpFSInode::sync_shared_vmobject()
+{
+    VERIFY(m_inode_lock.is_locked());
+    auto vmobject = shared_vmobject();
+    if (!vmobject)
+        return KSuccess;
+
+    // Shared mappings use the file's own pages. Every page inside the file is backed,
+    // so a fault never fills in a private copy, and pages past the end are dropped.
+    size_t file_page_count = Memory::page_round_up(m_metadata.size) / PAGE_SIZE;
+    auto pages = vmobject->physical_pages();
+    bool changed = false;
+    for (size_t i = 0; i < pages.size(); ++i) {
+        RefPtr<Memory::PhysicalPage> page;
+        if (i < file_page_count) {
+            auto page_or_error = ensure_page(i);
+            if (page_or_error.is_error())
+                return page_or_error.error();
+            page = page_or_error.release_value();
+        }
+        if (pages[i] != page) {
+            pages[i] = move(page);
+            changed = true;
+        }
+    }
+    if (changed) {
+        vmobject->for_each_region([](auto& region) {
+            region.remap();
+        });
+    }
+    return KSuccess;
+}
+
 RefPtr<Inode> TmpFSInode::lookup(StringView name)
 {
     MutexLocker locker(m_inode_lock, Mutex::Mode::Shared);
@@ -206,11 +307,10 @@ RefPtr<Inode> TmpFSInode::lookup(StringView name)
 
 TmpFSInode::Child* TmpFSInode::find_child_by_name(StringView name)
 {
-    for (auto& child : m_children) {
-        if (child.name->view() == name)
-            return &child;
-    }
-    return nullptr;
+    auto it = m_children_by_name.find(name);
+    if (it == m_children_by_name.end())
+        return nullptr;
+    return it->value;
 }
 
 void TmpFSInode::notify_watchers()
@@ -281,12 +381,13 @@ KResult TmpFSInode::add_child(Inode& child, StringView const& name, mode_t)
     if (!name_kstring)
         return ENOMEM;
 
-    auto* child_entry = new (nothrow) Child { name_kstring.release_nonnull(), static_cast<TmpFSInode&>(child) };
+    MutexLocker locker(m_inode_lock);
+    auto* child_entry = new (nothrow) Child { name_kstring.release_nonnull(), static_cast<TmpFSInode&>(child), m_next_child_cookie++ };
     if (!child_entry)
         return ENOMEM;
 
-    MutexLocker locker(m_inode_lock);
-    m_children.append(*child_entry);
+    m_children.insert(*child_entry);
+    m_children_by_name.set(child_entry->name->view(), child_entry);
     did_add_child(child.identifier(), name);
     return KSuccess;
 }
@@ -305,8 +406,10 @@ KResult TmpFSInode::remove_child(StringView const& name)
 
     auto child_id = child->inode->identifier();
     child->inode->did_delete_self();
-    m_children.remove(*child);
+    m_children.remove(child->cookie);
+    m_children_by_name.remove(child->name->view());
     did_remove_child(child_id, name);
+    delete child;
     return KSuccess;
 }
 
@@ -315,29 +418,21 @@ KResult TmpFSInode::truncate(u64 size)
     MutexLocker locker(m_inode_lock);
     VERIFY(!is_directory());
 
-    if (size == 0)
-        m_content.clear();
-    else if (!m_content) {
-        m_content = KBuffer::try_create_with_size(size);
-        if (!m_content)
-            return ENOMEM;
-    } else if (static_cast<size_t>(size) < m_content->capacity()) {
-        size_t prev_size = m_metadata.size;
-        m_content->set_size(size);
-        if (prev_size < static_cast<size_t>(size))
-            memset(m_content->data() + prev_size, 0, size - prev_size);
-    } else {
-        size_t prev_size = m_metadata.size;
-        auto tmp = KBuffer::try_create_with_size(size);
-        if (!tmp)
-            return ENOMEM;
-        memcpy(tmp->data(), m_content->data(), prev_size);
-        m_content = move(tmp);
+    if (size < static_cast<u64>(m_metadata.size)) {
+        release_pages_from(Memory::page_round_up(size) / PAGE_SIZE);
+        if (auto tail = size % PAGE_SIZE) {
+            if (auto page = page_at(size / PAGE_SIZE)) {
+                Memory::ScopedQuickMap mapping(*page);
+                memset(mapping.data() + tail, 0, PAGE_SIZE - tail);
+            }
+        }
     }
 
     m_metadata.size = size;
+    invalidate_cached_link_target_locked();
+    auto result = sync_shared_vmobject();
     notify_watchers();
-    return KSuccess;
+    return result;
 }
 
 KResult TmpFSInode::set_atime(time_t time)
@@ -368,9 +463,4 @@ KResult TmpFSInode::set_mtime(time_t t)
     return KSuccess;
 }
 
-void TmpFSInode::one_ref_left()
-{
-    fs().unregister_inode(identifier());
-}
-
 }
@@ -7,9 +7,12 @@
 #pragma once
 
 // includes
+#include <base/Array.h>
+#include <base/HashMap.h>
+#include <base/IntrusiveRedBlackTree.h>
 #include <kernel/filesystem/FileSystem.h>
 #include <kernel/filesystem/Inode.h>
-#include <kernel/KBuffer.h>
+#include <kernel/memory/PhysicalPage.h>
 
 namespace Kernel {
 
@@ -26,6 +29,7 @@ public:
     virtual StringView class_name() const override { return "TmpFS"sv; }
 
     virtual bool supports_watchers() const override { return true; }
+    virtual bool can_cache_link_targets() const override { return true; }
 
     virtual Inode& root_inode() override;
 
@@ -34,10 +38,7 @@ private:
 
     RefPtr<TmpFSInode> m_root_inode;
 
-    HashMap<InodeIndex, NonnullRefPtr<TmpFSInode>> m_inodes;
-    RefPtr<Inode> get_inode(InodeIdentifier identifier) const;
-    void register_inode(TmpFSInode&);
-    void unregister_inode(InodeIdentifier);
+    RefPtr<Inode> get_inode(InodeIdentifier identifier);
 
     unsigned m_next_inode_index { 1 };
     unsigned next_inode_index();
@@ -55,6 +56,7 @@ public:
     virtual KResultOr<size_t> read_bytes(off_t, size_t, UserOrKernelBuffer& buffer, FileDescription*) const override;
     virtual InodeMetadata metadata() const override;
     virtual KResult traverse_as_directory(Function<bool(FileSystem::DirectoryEntryView const&)>) const override;
+    virtual KResult traverse_as_directory_from(u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)>) const override;
     virtual RefPtr<Inode> lookup(StringView name) override;
     virtual void flush_metadata() override;
     virtual KResultOr<size_t> write_bytes(off_t, size_t, const UserOrKernelBuffer& buffer, FileDescription*) override;
@@ -67,7 +69,8 @@ public:
     virtual KResult set_atime(time_t) override;
     virtual KResult set_ctime(time_t) override;
     virtual KResult set_mtime(time_t) override;
-    virtual void one_ref_left() override;
+    virtual bool can_share_pages_with_mmap() const override { return true; }
+    virtual KResultOr<NonnullRefPtr<Memory::VMObject>> try_create_mmap_vmobject() override;
 
 private:
     TmpFSInode(TmpFS& fs, InodeMetadata metadata, InodeIdentifier parent);
@@ -76,20 +79,44 @@ private:
     void notify_watchers();
 
     struct Child {
+        Child(NonnullOwnPtr<KString> name, NonnullRefPtr<TmpFSInode> inode, u64 cookie)
+            : name(move(name))
+            , inode(move(inode))
+            , cookie(cookie)
+            , tree_node(cookie)
+        {
+        }
+
         NonnullOwnPtr<KString> name;
         NonnullRefPtr<TmpFSInode> inode;
-        IntrusiveListNode<Child> list_node {};
-        using List = IntrusiveList<Child, RawPtr<Child>, &Child::list_node>;
+        u64 cookie { 0 };
+        IntrusiveRedBlackTreeNode<u64> tree_node;
+        using Tree = IntrusiveRedBlackTree<u64, Child, &Child::tree_node>;
     };
 
     Child* find_child_by_name(StringView);
 
+    static constexpr size_t pages_per_chunk = 512;
+
+    struct PageChunk {
+        Array<RefPtr<Memory::PhysicalPage>, pages_per_chunk> pages;
+    };
+
+    RefPtr<Memory::PhysicalPage> page_at(size_t page_index) const;
+    KResultOr<NonnullRefPtr<Memory::PhysicalPage>> ensure_page(size_t page_index);
+    void release_pages_from(size_t page_index);
+    KResult sync_shared_vmobject();
+
+    static constexpr u64 first_child_cookie = 2;
+
     InodeMetadata m_metadata;
     InodeIdentifier m_parent;
 
-    OwnPtr<KBuffer> m_content;
+    Vector<OwnPtr<PageChunk>> m_page_chunks;
 
-    Child::List m_children;
+    Child::Tree m_children;
+    HashMap<StringView, Child*> m_children_by_name;
+    u64 m_next_child_cookie { first_child_cookie };
 };
 
 }
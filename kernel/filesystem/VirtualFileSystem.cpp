@@ -61,8 +61,10 @@ KResult VirtualFileSystem::mount(FileSystem& fs, Custody& mount_point, int flags
         inode.identifier(),
         flags);
 
-    Mount mount { fs, &mount_point, flags };
-    m_mounts.append(move(mount));
+    auto mount = adopt_own_if_nonnull(new (nothrow) Mount { fs, &mount_point, flags });
+    if (!mount)
+        return ENOMEM;
+    add_mount(mount.release_nonnull());
     return KSuccess;
 }
 
@@ -72,8 +74,10 @@ KResult VirtualFileSystem::bind_mount(Custody& source, Custody& mount_point, int
 
     dbgln("VirtualFileSystem: Bind-mounting {} at {}", source.try_create_absolute_path(), mount_point.try_create_absolute_path());
 
-    Mount mount { source.inode(), mount_point, flags };
-    m_mounts.append(move(mount));
+    auto mount = adopt_own_if_nonnull(new (nothrow) Mount { source.inode(), mount_point, flags });
+    if (!mount)
+        return ENOMEM;
+    add_mount(mount.release_nonnull());
     return KSuccess;
 }
 
@@ -104,7 +108,7 @@ KResult VirtualFileSystem::unmount(Inode& guest_inode)
                 return result;
             }
             dbgln("VirtualFileSystem: found fs {} at mount index {}! Unmounting...", mount.guest_fs().fsid(), i);
-            m_mounts.unstable_take(i);
+            remove_mount(i);
             return KSuccess;
         }
     }
@@ -120,7 +124,9 @@ bool VirtualFileSystem::mount_root(FileSystem& fs)
         return false;
     }
 
-    Mount mount { fs, nullptr, root_mount_flags };
+    auto mount = adopt_own_if_nonnull(new (nothrow) Mount { fs, nullptr, root_mount_flags });
+    if (!mount)
+        return false;
 
     auto& root_inode = fs.root_inode();
     if (!root_inode.is_directory()) {
@@ -131,7 +137,7 @@ bool VirtualFileSystem::mount_root(FileSystem& fs)
     m_root_inode = root_inode;
     dmesgln("VirtualFileSystem: mounted root from {} ({})", fs.class_name(), static_cast<FileBackedFileSystem&>(fs).file_description().absolute_path());
 
-    m_mounts.append(move(mount));
+    add_mount(mount.release_nonnull());
 
     auto custody_or_error = Custody::try_create(nullptr, "", *m_root_inode, root_mount_flags);
     if (custody_or_error.is_error())
@@ -140,22 +146,59 @@ bool VirtualFileSystem::mount_root(FileSystem& fs)
     return true;
 }
 
-auto VirtualFileSystem::find_mount_for_host(InodeIdentifier id) -> Mount*
+void VirtualFileSystem::add_mount(NonnullOwnPtr<Mount> mount)
 {
-    for (auto& mount : m_mounts) {
-        if (mount.host() && mount.host()->identifier() == id)
-            return &mount;
+    ScopedSpinLock lock(m_mount_table_lock);
+
+    if (auto* host = mount->host()) {
+        host->m_mount_count++;
+        if (m_mounts_by_host.find(host->identifier()) == m_mounts_by_host.end())
+            m_mounts_by_host.set(host->identifier(), mount.ptr());
     }
-    return nullptr;
+    if (m_mounts_by_guest.find(mount->guest().identifier()) == m_mounts_by_guest.end())
+        m_mounts_by_guest.set(mount->guest().identifier(), mount.ptr());
+    m_mounts.append(move(mount));
 }
 
-auto VirtualFileSystem::find_mount_for_guest(InodeIdentifier id) -> Mount*
+void VirtualFileSystem::remove_mount(size_t index)
 {
-    for (auto& mount : m_mounts) {
-        if (mount.guest().identifier() == id)
-            return &mount;
+    ScopedSpinLock lock(m_mount_table_lock);
+
+    auto mount = m_mounts.unstable_take(index);
+
+    auto rehash = [this](auto& table, InodeIdentifier id, Mount* removed, auto matches) {
+        auto it = table.find(id);
+        if (it == table.end() || it->value != removed)
+            return;
+        table.remove(it);
+        for (auto& other : m_mounts) {
+            if (matches(other)) {
+                table.set(id, &other);
+                return;
+            }
+        }
+    };
+
+    if (auto* host = mount->host()) {
+        VERIFY(host->m_mount_count > 0);
+        host->m_mount_count--;
+        auto host_id = host->identifier();
+        rehash(m_mounts_by_host, host_id, mount.ptr(), [&](Mount& other) { return other.host() && other.host()->identifier() == host_id; });
     }
-    return nullptr;
+    auto guest_id = mount->guest().identifier();
+    rehash(m_mounts_by_guest, guest_id, mount.ptr(), [&](Mount& other) { return other.guest().identifier() == guest_id; });
+}
+
+auto VirtualFileSystem::find_mount_for_host(InodeIdentifier id) -> Mount*
+{
+    ScopedSpinLock lock(m_mount_table_lock);
+    return m_mounts_by_host.get(id).value_or(nullptr);
+}
+
+auto VirtualFileSystem::find_mount_for_guest(InodeIdentifier id) -> Mount*
+{
+    ScopedSpinLock lock(m_mount_table_lock);
+    return m_mounts_by_guest.get(id).value_or(nullptr);
 }
 
 bool VirtualFileSystem::is_vfs_root(InodeIdentifier inode) const
@@ -163,9 +206,9 @@ bool VirtualFileSystem::is_vfs_root(InodeIdentifier inode) const
     return inode == root_inode_id();
 }
 
-KResult VirtualFileSystem::traverse_directory_inode(Inode& dir_inode, Function<bool(FileSystem::DirectoryEntryView const&)> callback)
+KResult VirtualFileSystem::traverse_directory_inode(Inode& dir_inode, u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)> callback)
 {
-    return dir_inode.traverse_as_directory([&](auto& entry) {
+    return dir_inode.traverse_as_directory_from(cookie, [&](auto& entry) {
         InodeIdentifier resolved_inode;
         if (auto mount = find_mount_for_host(entry.inode))
             resolved_inode = mount->guest().identifier();
@@ -179,8 +222,7 @@ KResult VirtualFileSystem::traverse_directory_inode(Inode& dir_inode, Function<b
             VERIFY(mount->host());
             resolved_inode = mount->host()->identifier();
         }
-        callback({ entry.name, resolved_inode, entry.file_type });
-        return true;
+        return callback({ entry.name, resolved_inode, entry.file_type, entry.next_cookie });
     });
 }
 
@@ -958,9 +1000,11 @@ KResultOr<NonnullRefPtr<Custody>> VirtualFileSystem::resolve_path_without_veil(S
 
         int mount_flags_for_child = parent.mount_flags();
 
-        if (auto mount = find_mount_for_host(child_inode->identifier())) {
-            child_inode = mount->guest();
-            mount_flags_for_child = mount->flags();
+        if (child_inode->is_mountpoint()) {
+            if (auto mount = find_mount_for_host(child_inode->identifier())) {
+                child_inode = mount->guest();
+                mount_flags_for_child = mount->flags();
+            }
         }
 
         auto new_custody_or_error = Custody::try_create(&parent, part, *child_inode, mount_flags_for_child);
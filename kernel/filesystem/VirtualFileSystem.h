@@ -21,6 +21,7 @@
 #include <kernel/filesystem/UnveilNode.h>
 #include <kernel/Forward.h>
 #include <kernel/KResult.h>
+#include <kernel/locking/SpinLock.h>
 
 namespace Kernel {
 
@@ -82,15 +83,22 @@ private:
 
     bool is_vfs_root(InodeIdentifier) const;
 
-    KResult traverse_directory_inode(Inode&, Function<bool(FileSystem::DirectoryEntryView const&)>);
+    KResult traverse_directory_inode(Inode&, u64 cookie, Function<bool(FileSystem::DirectoryEntryView const&)>);
 
     Mount* find_mount_for_host(InodeIdentifier);
     Mount* find_mount_for_guest(InodeIdentifier);
 
+    void add_mount(NonnullOwnPtr<Mount>);
+    void remove_mount(size_t index);
+
     Mutex m_lock { "VFSLock" };
 
     RefPtr<Inode> m_root_inode;
-    Vector<Mount, 16> m_mounts;
+    NonnullOwnPtrVector<Mount, 16> m_mounts;
+
+    SpinLock<u8> m_mount_table_lock;
+    HashMap<InodeIdentifier, Mount*> m_mounts_by_host;
+    HashMap<InodeIdentifier, Mount*> m_mounts_by_guest;
     RefPtr<Custody> m_root_custody;
 };
 
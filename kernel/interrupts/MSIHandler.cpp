@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/arch/x86/CPU.h>
+#include <kernel/arch/x86/Processor.h>
+#include <kernel/arch/x86/ProcessorInfo.h>
+#include <kernel/bus/pci/MessageSignalledInterrupts.h>
+#include <kernel/interrupts/APIC.h>
+#include <kernel/interrupts/MSIHandler.h>
+
+namespace Kernel {
+
+static constexpr u32 msi_address_base = 0xfee00000;
+static constexpr u32 msi_address_destination_shift = 12;
+
+SpinLock<u8> MSIHandler::s_lock;
+Array<MSIHandler*, MSIHandler::interrupt_number_count> MSIHandler::s_handlers;
+
+static u32 online_processor_mask()
+{
+    u32 count = Processor::count();
+    return count >= 32 ? 0xffffffff : (1u << count) - 1;
+}
+
+static u32 apic_id_of_processor(u32 cpu)
+{
+    u32 apic_id = 0;
+    Processor::for_each([&](Processor& processor) {
+        if (processor.get_id() == cpu)
+            apic_id = processor.info().apic_id();
+    });
+    return apic_id;
+}
+
+OwnPtr<MSIHandler> MSIHandler::try_create(PCI::MessageSignalledInterrupts& owner, size_t index, String purpose)
+{
+    OwnPtr<MSIHandler> handler;
+    {
+        ScopedSpinLock lock(s_lock);
+        for (u8 i = 0; i < interrupt_number_count; ++i) {
+            if (s_handlers[i])
+                continue;
+            handler = adopt_own_if_nonnull(new (nothrow) MSIHandler(first_interrupt_number + i, owner, index, move(purpose)));
+            if (handler)
+                s_handlers[i] = handler.ptr();
+            break;
+        }
+    }
+    if (!handler)
+        return {};
+    handler->register_interrupt_handler();
+    return handler;
+}
+
+MSIHandler::MSIHandler(u8 interrupt_number, PCI::MessageSignalledInterrupts& owner, size_t index, String purpose)
+    : GenericInterruptHandler(interrupt_number, true)
+    , m_owner(owner)
+    , m_index(index)
+    , m_purpose(move(purpose))
+    , m_target_processor(index % Processor::count())
+{
+}
+
+MSIHandler::~MSIHandler()
+{
+    {
+        ScopedSpinLock lock(s_lock);
+        VERIFY(s_handlers[interrupt_number() - first_interrupt_number] == this);
+        s_handlers[interrupt_number() - first_interrupt_number] = nullptr;
+    }
+    unregister_interrupt_handler();
+}
+
+// Physical destination mode, so the destination field holds the target's APIC ID.
+u64 MSIHandler::message_address() const
+{
+    return msi_address_base | apic_id_of_processor(m_target_processor) << msi_address_destination_shift;
+}
+
+// Fixed delivery, edge triggered.
+u32 MSIHandler::message_data() const
+{
+    return interrupt_number() + IRQ_VECTOR_BASE;
+}
+
+KResult MSIHandler::set_target_processor(u32 cpu)
+{
+    if (cpu >= Processor::count() || cpu >= 32 || !(m_affinity_mask & (1u << cpu)))
+        return EINVAL;
+    if (cpu == m_target_processor)
+        return KSuccess;
+    m_target_processor = cpu;
+    m_owner.write_message(*this);
+    return KSuccess;
+}
+
+// The vector moves over to the first allowed processor unless it already targets one of them.
+KResult MSIHandler::set_affinity_mask(u32 mask)
+{
+    if (!(mask & online_processor_mask()))
+        return EINVAL;
+    m_affinity_mask = mask;
+    if (mask & (1u << m_target_processor))
+        return KSuccess;
+    return set_target_processor(__builtin_ctz(mask & online_processor_mask()));
+}
+
+bool MSIHandler::handle_interrupt(const RegisterState&)
+{
+    if (!m_handler)
+        return false;
+    m_handler();
+    return true;
+}
+
+bool MSIHandler::eoi()
+{
+    APIC::the().eoi();
+    return true;
+}
+
+}
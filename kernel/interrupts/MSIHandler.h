@@ -0,0 +1,91 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Array.h>
+#include <base/Function.h>
+#include <base/OwnPtr.h>
+#include <base/String.h>
+#include <base/Types.h>
+#include <kernel/bus/pci/Definitions.h>
+#include <kernel/interrupts/GenericInterruptHandler.h>
+#include <kernel/KResult.h>
+#include <kernel/locking/SpinLock.h>
+
+namespace Kernel {
+
+// A vector owned by a single device, delivered straight to the local APIC of one processor by a
+// message signalled interrupt. Its interrupt number comes from a range no IOAPIC pin is mapped to.
+class MSIHandler final : public GenericInterruptHandler {
+public:
+    static constexpr u8 first_interrupt_number = 0x40;
+    static constexpr u8 interrupt_number_count = 0x60;
+
+    static OwnPtr<MSIHandler> try_create(PCI::MessageSignalledInterrupts&, size_t index, String purpose);
+    virtual ~MSIHandler() override;
+
+    size_t index() const { return m_index; }
+    u32 target_processor() const { return m_target_processor; }
+    u64 message_address() const;
+    u32 message_data() const;
+
+    void set_handler(Function<void()> handler) { m_handler = move(handler); }
+    KResult set_target_processor(u32);
+
+    u32 affinity_mask() const { return m_affinity_mask; }
+    KResult set_affinity_mask(u32);
+
+    // Vectors are only ever touched from outside their owner with the vector table locked,
+    // so that they can't be freed while they are being looked at or retargeted.
+    template<typename Callback>
+    static KResult with_interrupt_number(u8 interrupt_number, Callback callback)
+    {
+        if (interrupt_number < first_interrupt_number || interrupt_number >= first_interrupt_number + interrupt_number_count)
+            return ENOTSUP;
+        ScopedSpinLock lock(s_lock);
+        auto* handler = s_handlers[interrupt_number - first_interrupt_number];
+        if (!handler)
+            return ENOTSUP;
+        return callback(*handler);
+    }
+
+    template<typename Callback>
+    static void for_each(Callback callback)
+    {
+        ScopedSpinLock lock(s_lock);
+        for (auto* handler : s_handlers) {
+            if (handler)
+                callback(*handler);
+        }
+    }
+
+    // ^GenericInterruptHandler
+    virtual bool handle_interrupt(const RegisterState&) override;
+    virtual bool eoi() override;
+    virtual HandlerType type() const override { return HandlerType::IRQHandler; }
+    virtual StringView purpose() const override { return m_purpose; }
+    virtual StringView controller() const override { return "MSI"; }
+    virtual size_t sharing_devices_count() const override { return 0; }
+    virtual bool is_shared_handler() const override { return false; }
+    virtual bool is_sharing_with_others() const override { return false; }
+
+private:
+    MSIHandler(u8 interrupt_number, PCI::MessageSignalledInterrupts&, size_t index, String purpose);
+
+    static SpinLock<u8> s_lock;
+    static Array<MSIHandler*, interrupt_number_count> s_handlers;
+
+    PCI::MessageSignalledInterrupts& m_owner;
+    size_t m_index { 0 };
+    String m_purpose;
+    u32 m_target_processor { 0 };
+    u32 m_affinity_mask { 0xffffffff };
+    Function<void()> m_handler;
+};
+
+}
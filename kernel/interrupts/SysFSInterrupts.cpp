@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/JsonObjectSerializer.h>
+#include <base/StringUtils.h>
+#include <kernel/arch/x86/CPU.h>
+#include <kernel/arch/x86/Interrupts.h>
+#include <kernel/interrupts/MSIHandler.h>
+#include <kernel/interrupts/SysFSInterrupts.h>
+#include <kernel/KBufferBuilder.h>
+#include <kernel/tasks/InterruptBalancerTask.h>
+
+namespace Kernel {
+
+static StringView attribute_name(SysFSInterruptAttribute::Type type)
+{
+    switch (type) {
+    case SysFSInterruptAttribute::Type::Affinity:
+        return "affinity"sv;
+    case SysFSInterruptAttribute::Type::Counts:
+        return "counts"sv;
+    case SysFSInterruptAttribute::Type::Balance:
+        return "balance"sv;
+    }
+    VERIFY_NOT_REACHED();
+}
+
+static bool has_handler(u8 interrupt_number)
+{
+    return get_interrupt_handler(interrupt_number).type() != HandlerType::UnhandledInterruptHandler;
+}
+
+static bool is_steerable(u8 interrupt_number)
+{
+    return !MSIHandler::with_interrupt_number(interrupt_number, [](MSIHandler&) -> KResult { return KSuccess; }).is_error();
+}
+
+NonnullRefPtr<SysFSInterruptAttribute> SysFSInterruptAttribute::create(u8 interrupt_number, Type type)
+{
+    return adopt_ref(*new (nothrow) SysFSInterruptAttribute(attribute_name(type), interrupt_number, type));
+}
+
+SysFSInterruptAttribute::SysFSInterruptAttribute(StringView name, u8 interrupt_number, Type type)
+    : SysFSAttribute(name)
+    , m_interrupt_number(interrupt_number)
+    , m_type(type)
+{
+}
+
+KResult SysFSInterruptAttribute::generate(SysFSContentWriter& writer) const
+{
+    if (m_type == Type::Balance)
+        return writer.append(InterruptBalancerTask::is_enabled() ? "1\n"sv : "0\n"sv);
+    if (!has_handler(m_interrupt_number))
+        return ENODEV;
+
+    if (m_type == Type::Affinity) {
+        u32 affinity_mask = 0;
+        u32 target_processor = 0;
+        auto result = MSIHandler::with_interrupt_number(m_interrupt_number, [&](MSIHandler& handler) -> KResult {
+            affinity_mask = handler.affinity_mask();
+            target_processor = handler.target_processor();
+            return KSuccess;
+        });
+        if (result.is_error())
+            return result;
+        return writer.append(String::formatted("{:08x} (processor {})\n", affinity_mask, target_processor).view());
+    }
+
+    auto& handler = get_interrupt_handler(m_interrupt_number);
+    KBufferBuilder builder;
+    JsonObjectSerializer<KBufferBuilder> object { builder };
+    object.add("purpose", handler.purpose());
+    object.add("controller", handler.controller());
+    object.add("total", handler.get_invoking_count());
+    auto per_processor = object.add_array("per_processor");
+    for (u32 cpu = 0; cpu < min(Processor::count(), max_processors_with_interrupt_counts); ++cpu)
+        per_processor.add(get_interrupt_count_on_processor(m_interrupt_number, cpu));
+    per_processor.finish();
+    object.finish();
+    auto data = builder.build();
+    if (!data)
+        return ENOMEM;
+    return writer.append(data->bytes());
+}
+
+KResult SysFSInterruptAttribute::write_value(StringView value)
+{
+    if (m_type == Type::Balance) {
+        auto enabled = parse_boolean(value);
+        if (!enabled.has_value())
+            return EINVAL;
+        InterruptBalancerTask::set_enabled(enabled.value());
+        return KSuccess;
+    }
+
+    // The affinity mask is written in hex, one bit per processor.
+    if (value.starts_with("0x"sv))
+        value = value.substring_view(2);
+    auto mask = Base::StringUtils::convert_to_uint_from_hex<u32>(value);
+    if (!mask.has_value())
+        return EINVAL;
+    return MSIHandler::with_interrupt_number(m_interrupt_number, [&](MSIHandler& handler) {
+        return handler.set_affinity_mask(mask.value());
+    });
+}
+
+NonnullRefPtr<SysFSInterruptDirectory> SysFSInterruptDirectory::create(SysFSDirectory const& parent_directory, u8 interrupt_number, bool is_steerable)
+{
+    return adopt_ref(*new (nothrow) SysFSInterruptDirectory(parent_directory, interrupt_number, is_steerable));
+}
+
+// Only message signalled vectors can be moved between processors; pins keep their IOAPIC routing.
+SysFSInterruptDirectory::SysFSInterruptDirectory(SysFSDirectory const& parent_directory, u8 interrupt_number, bool is_steerable)
+    : SysFSDirectory(String::number(interrupt_number), parent_directory)
+    , m_steerable(is_steerable)
+{
+    m_components.append(SysFSInterruptAttribute::create(interrupt_number, SysFSInterruptAttribute::Type::Counts));
+    if (is_steerable)
+        m_components.append(SysFSInterruptAttribute::create(interrupt_number, SysFSInterruptAttribute::Type::Affinity));
+}
+
+NonnullRefPtr<SysFSInterruptsDirectory> SysFSInterruptsDirectory::must_create(SysFSDirectory const& parent_directory)
+{
+    return adopt_ref(*new (nothrow) SysFSInterruptsDirectory(parent_directory));
+}
+
+SysFSInterruptsDirectory::SysFSInterruptsDirectory(SysFSDirectory const& parent_directory)
+    : SysFSDynamicDirectory("interrupts"sv, parent_directory)
+{
+    m_components.append(SysFSInterruptAttribute::create(0, SysFSInterruptAttribute::Type::Balance));
+}
+
+void SysFSInterruptsDirectory::update_children() const
+{
+    for (size_t i = 0; i < GENERIC_INTERRUPT_HANDLERS_COUNT; ++i) {
+        u8 interrupt_number = i;
+        if (!has_handler(interrupt_number))
+            continue;
+        bool steerable = is_steerable(interrupt_number);
+        auto existing = previous_child(String::number(interrupt_number));
+        if (existing && static_cast<SysFSInterruptDirectory&>(*existing).is_steerable() == steerable)
+            add_child(existing.release_nonnull());
+        else
+            add_child(SysFSInterruptDirectory::create(*this, interrupt_number, steerable));
+    }
+}
+
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <kernel/filesystem/SysFSComponent.h>
+
+namespace Kernel {
+
+class SysFSInterruptAttribute final : public SysFSAttribute {
+public:
+    enum class Type {
+        Affinity,
+        Counts,
+        Balance,
+    };
+
+    static NonnullRefPtr<SysFSInterruptAttribute> create(u8 interrupt_number, Type);
+
+private:
+    SysFSInterruptAttribute(StringView name, u8 interrupt_number, Type);
+
+    virtual KResult generate(SysFSContentWriter&) const override;
+    virtual bool is_writable() const override { return m_type != Type::Counts; }
+    virtual KResult write_value(StringView) override;
+
+    u8 m_interrupt_number { 0 };
+    Type m_type;
+};
+
+class SysFSInterruptDirectory final : public SysFSDirectory {
+public:
+    static NonnullRefPtr<SysFSInterruptDirectory> create(SysFSDirectory const& parent_directory, u8 interrupt_number, bool is_steerable);
+
+    bool is_steerable() const { return m_steerable; }
+
+private:
+    SysFSInterruptDirectory(SysFSDirectory const& parent_directory, u8 interrupt_number, bool is_steerable);
+
+    bool m_steerable { false };
+};
+
+// /sys/interrupts holds a directory for every interrupt number with a handler, plus the
+// switch for the interrupt balancer.
+class SysFSInterruptsDirectory final : public SysFSDynamicDirectory {
+public:
+    static NonnullRefPtr<SysFSInterruptsDirectory> must_create(SysFSDirectory const& parent_directory);
+
+private:
+    explicit SysFSInterruptsDirectory(SysFSDirectory const& parent_directory);
+
+    virtual void update_children() const override;
+};
+
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Noncopyable.h>
+#include <kernel/arch/x86/InterruptDisabler.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/memory/PhysicalPage.h>
+#include <kernel/UserOrKernelBuffer.h>
+
+namespace Kernel::Memory {
+
+// Maps a physical page through this CPU's quickmap slot for the lifetime of the
+// object. Interrupts stay disabled while the mapping is live, so nothing done
+// through it may fault; userspace buffers go through copy_{from,to}_page().
+class ScopedQuickMap {
+    BASE_MAKE_NONCOPYABLE(ScopedQuickMap);
+    BASE_MAKE_NONMOVABLE(ScopedQuickMap);
+
+public:
+    explicit ScopedQuickMap(PhysicalPage& page)
+        : m_data(MM.quickmap_page(page))
+    {
+    }
+
+    ~ScopedQuickMap() { MM.unquickmap_page(); }
+
+    u8* data() { return m_data; }
+
+private:
+    InterruptDisabler m_disabler;
+    u8* m_data { nullptr };
+};
+
+static constexpr size_t quickmap_bounce_bytes = 1024;
+
+inline bool copy_from_page(PhysicalPage& page, size_t offset_in_page, UserOrKernelBuffer& buffer, size_t size)
+{
+    VERIFY(offset_in_page + size <= PAGE_SIZE);
+    auto result = buffer.write_buffered<quickmap_bounce_bytes>(size, [&](u8* data, size_t data_bytes) {
+        ScopedQuickMap mapping(page);
+        memcpy(data, mapping.data() + offset_in_page, data_bytes);
+        offset_in_page += data_bytes;
+        return data_bytes;
+    });
+    return !result.is_error();
+}
+
+inline bool copy_to_page(PhysicalPage& page, size_t offset_in_page, UserOrKernelBuffer const& buffer, size_t size)
+{
+    VERIFY(offset_in_page + size <= PAGE_SIZE);
+    auto result = buffer.read_buffered<quickmap_bounce_bytes>(size, [&](u8 const* data, size_t data_bytes) {
+        ScopedQuickMap mapping(page);
+        memcpy(mapping.data() + offset_in_page, data, data_bytes);
+        offset_in_page += data_bytes;
+        return data_bytes;
+    });
+    return !result.is_error();
+}
+
+}
@@ -0,0 +1,29 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/filesystem/InodeWatcher.h>
+#include <kernel/Process.h>
+
+namespace Kernel {
+
+KResultOr<FlatPtr> Process::sys$inode_watcher_set_queue_size(int fd, u32 queue_size)
+{
+    VERIFY_PROCESS_BIG_LOCK_ACQUIRED(this);
+    REQUIRE_PROMISE(rpath);
+    auto description = fds().file_description(fd);
+    if (!description)
+        return EBADF;
+    auto* inode_watcher = description->inode_watcher();
+    if (!inode_watcher)
+        return EBADF;
+    if (auto result = inode_watcher->set_queue_size(queue_size); result.is_error())
+        return result.error();
+    return 0;
+}
+
+}
@@ -0,0 +1,82 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/filesystem/IORing.h>
+#include <kernel/Process.h>
+
+namespace Kernel {
+
+KResultOr<FlatPtr> Process::sys$io_ring_setup(Userspace<const Syscall::SC_io_ring_setup_params*> user_params)
+{
+    VERIFY_PROCESS_BIG_LOCK_ACQUIRED(this);
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_io_ring_setup_params params;
+    if (!copy_from_user(&params, user_params))
+        return EFAULT;
+    if (params.flags & ~O_CLOEXEC)
+        return EINVAL;
+
+    auto fd_or_error = m_fds.allocate();
+    if (fd_or_error.is_error())
+        return fd_or_error.error();
+    auto ring_fd = fd_or_error.release_value();
+
+    auto ring_or_error = IORing::create(*this, params.entries);
+    if (ring_or_error.is_error())
+        return ring_or_error.error();
+    auto ring = ring_or_error.release_value();
+
+    size_t mapping_size = ring->mapping_size();
+    if (params.mapping_size && !copy_to_user(params.mapping_size, &mapping_size))
+        return EFAULT;
+
+    auto description_or_error = FileDescription::create(*ring);
+    if (description_or_error.is_error())
+        return description_or_error.error();
+
+    auto description = description_or_error.release_value();
+    description->set_readable(true);
+
+    unsigned fd_flags = 0;
+    if (params.flags & O_CLOEXEC)
+        fd_flags |= FD_CLOEXEC;
+
+    m_fds[ring_fd.fd].set(move(description), fd_flags);
+    return ring_fd.fd;
+}
+
+KResultOr<FlatPtr> Process::sys$io_ring_enter(int fd, u32 to_submit, u32 min_complete)
+{
+    VERIFY_PROCESS_BIG_LOCK_ACQUIRED(this);
+    REQUIRE_PROMISE(stdio);
+    auto description = fds().file_description(fd);
+    if (!description)
+        return EBADF;
+    auto* ring = description->io_ring();
+    if (!ring)
+        return EBADF;
+
+    u32 submitted = 0;
+    if (to_submit > 0) {
+        auto submitted_or_error = ring->submit(to_submit);
+        if (submitted_or_error.is_error())
+            return submitted_or_error.error();
+        submitted = submitted_or_error.value();
+    }
+
+    if (min_complete > 0) {
+        if (auto result = ring->wait_for_completions(*description, min_complete); result.is_error()) {
+            if (submitted > 0)
+                return submitted;
+            return result.error();
+        }
+    }
+    return submitted;
+}
+
+}
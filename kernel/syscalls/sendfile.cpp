@@ -0,0 +1,144 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/Process.h>
+
+namespace Kernel {
+
+static KResultOr<Optional<u64>> copy_offset_from_user(off_t* user_offset)
+{
+    if (!user_offset)
+        return Optional<u64> {};
+    off_t offset;
+    if (!copy_from_user(&offset, user_offset))
+        return EFAULT;
+    if (offset < 0)
+        return EINVAL;
+    return Optional<u64> { offset };
+}
+
+static KResult copy_offset_to_user(off_t* user_offset, Optional<u64> const& offset, size_t ntransferred)
+{
+    if (!user_offset)
+        return KSuccess;
+    off_t new_offset = offset.value() + ntransferred;
+    if (!copy_to_user(user_offset, &new_offset))
+        return EFAULT;
+    return KSuccess;
+}
+
+enum class OverlapPolicy {
+    Allow,
+    Reject,
+};
+
+static KResultOr<FlatPtr> transfer_between_descriptions(FileDescription& source, off_t* user_source_offset, FileDescription& destination, off_t* user_destination_offset, size_t count, OverlapPolicy overlap_policy = OverlapPolicy::Allow)
+{
+    auto source_offset_or_error = copy_offset_from_user(user_source_offset);
+    if (source_offset_or_error.is_error())
+        return source_offset_or_error.error();
+    auto destination_offset_or_error = copy_offset_from_user(user_destination_offset);
+    if (destination_offset_or_error.is_error())
+        return destination_offset_or_error.error();
+
+    auto source_offset = source_offset_or_error.release_value();
+    auto destination_offset = destination_offset_or_error.release_value();
+
+    // The data moves through a bounce buffer in chunks, so a range that overlaps
+    // itself would read back what an earlier chunk already wrote.
+    if (overlap_policy == OverlapPolicy::Reject && source.inode() && source.inode() == destination.inode()) {
+        u64 source_start = source_offset.value_or(source.offset());
+        u64 destination_start = destination_offset.value_or(destination.offset());
+        u64 distance = source_start > destination_start ? source_start - destination_start : destination_start - source_start;
+        if (distance < count)
+            return EINVAL;
+    }
+
+    auto ntransferred_or_error = source.transfer_to(destination, count, source_offset, destination_offset);
+    if (ntransferred_or_error.is_error())
+        return ntransferred_or_error.error();
+    auto ntransferred = ntransferred_or_error.value();
+
+    if (auto result = copy_offset_to_user(user_source_offset, source_offset, ntransferred); result.is_error())
+        return result;
+    if (auto result = copy_offset_to_user(user_destination_offset, destination_offset, ntransferred); result.is_error())
+        return result;
+    return ntransferred;
+}
+
+KResultOr<FlatPtr> Process::sys$sendfile(Userspace<const Syscall::SC_sendfile_params*> user_params)
+{
+    VERIFY_PROCESS_BIG_LOCK_ACQUIRED(this);
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_sendfile_params params;
+    if (!copy_from_user(&params, user_params))
+        return EFAULT;
+
+    auto in_description = fds().file_description(params.in_fd);
+    if (!in_description)
+        return EBADF;
+    auto out_description = fds().file_description(params.out_fd);
+    if (!out_description)
+        return EBADF;
+    if (!in_description->file().is_seekable())
+        return EINVAL;
+
+    return transfer_between_descriptions(*in_description, params.offset, *out_description, nullptr, params.count);
+}
+
+KResultOr<FlatPtr> Process::sys$copy_file_range(Userspace<const Syscall::SC_copy_file_range_params*> user_params)
+{
+    VERIFY_PROCESS_BIG_LOCK_ACQUIRED(this);
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_copy_file_range_params params;
+    if (!copy_from_user(&params, user_params))
+        return EFAULT;
+    if (params.flags != 0)
+        return EINVAL;
+
+    auto in_description = fds().file_description(params.fd_in);
+    if (!in_description)
+        return EBADF;
+    auto out_description = fds().file_description(params.fd_out);
+    if (!out_description)
+        return EBADF;
+    if (!in_description->file().is_inode() || !out_description->file().is_inode())
+        return EINVAL;
+    if (!in_description->metadata().is_regular_file() || !out_description->metadata().is_regular_file())
+        return EINVAL;
+    if (out_description->should_append())
+        return EBADF;
+
+    return transfer_between_descriptions(*in_description, params.off_in, *out_description, params.off_out, params.length, OverlapPolicy::Reject);
+}
+
+KResultOr<FlatPtr> Process::sys$splice(Userspace<const Syscall::SC_splice_params*> user_params)
+{
+    VERIFY_PROCESS_BIG_LOCK_ACQUIRED(this);
+    REQUIRE_PROMISE(stdio);
+    Syscall::SC_splice_params params;
+    if (!copy_from_user(&params, user_params))
+        return EFAULT;
+    if (params.flags != 0)
+        return EINVAL;
+
+    auto in_description = fds().file_description(params.fd_in);
+    if (!in_description)
+        return EBADF;
+    auto out_description = fds().file_description(params.fd_out);
+    if (!out_description)
+        return EBADF;
+    if (!in_description->is_fifo() && !out_description->is_fifo())
+        return EINVAL;
+    if ((in_description->is_fifo() && params.off_in) || (out_description->is_fifo() && params.off_out))
+        return ESPIPE;
+
+    return transfer_between_descriptions(*in_description, params.off_in, *out_description, params.off_out, params.length);
+}
+
+}
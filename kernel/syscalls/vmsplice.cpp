@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Checked.h>
+#include <kernel/filesystem/FIFO.h>
+#include <kernel/filesystem/FileDescription.h>
+#include <kernel/Process.h>
+
+namespace Kernel {
+
+KResultOr<FlatPtr> Process::sys$vmsplice(int fd, Userspace<const struct iovec*> iov, int iov_count, unsigned flags)
+{
+    VERIFY_PROCESS_BIG_LOCK_ACQUIRED(this);
+    REQUIRE_PROMISE(stdio);
+    if (iov_count < 0)
+        return EINVAL;
+    if (flags != 0)
+        return EINVAL;
+
+    auto description = fds().file_description(fd);
+    if (!description)
+        return EBADF;
+    auto* fifo = description->fifo();
+    if (!fifo || !description->is_writable())
+        return EBADF;
+
+    Vector<iovec, 32> vecs;
+    if (!vecs.try_resize(iov_count))
+        return ENOMEM;
+    if (!copy_n_from_user(vecs.data(), iov, iov_count))
+        return EFAULT;
+
+    Checked<size_t> total_length = 0;
+    for (auto& vec : vecs) {
+        total_length += vec.iov_len;
+        if (total_length.has_overflow())
+            return EINVAL;
+    }
+
+    size_t nspliced = 0;
+    for (auto& vec : vecs) {
+        size_t nspliced_from_vec = 0;
+        while (nspliced_from_vec < vec.iov_len) {
+            if (!description->can_write()) {
+                if (nspliced)
+                    return nspliced;
+                if (!description->is_blocking())
+                    return EAGAIN;
+                auto unblock_flags = Thread::FileBlocker::BlockFlags::None;
+                if (Thread::current()->block<Thread::WriteBlocker>({}, *description, unblock_flags).was_interrupted())
+                    return EINTR;
+            }
+            auto vaddr = VirtualAddress(vec.iov_base).offset(nspliced_from_vec);
+            auto result = fifo->splice_user_pages(*this, vaddr, vec.iov_len - nspliced_from_vec);
+            if (result.is_error()) {
+                if (result.error() == -EAGAIN && description->is_blocking())
+                    continue;
+                if (nspliced)
+                    return nspliced;
+                return result.error();
+            }
+            nspliced_from_vec += result.value();
+            nspliced += result.value();
+        }
+    }
+    return nspliced;
+}
+
+}
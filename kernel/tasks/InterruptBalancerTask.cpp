@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Atomic.h>
+#include <base/QuickSort.h>
+#include <base/Vector.h>
+#include <kernel/arch/x86/CPU.h>
+#include <kernel/arch/x86/Interrupts.h>
+#include <kernel/CommandLine.h>
+#include <kernel/interrupts/MSIHandler.h>
+#include <kernel/Process.h>
+#include <kernel/Sections.h>
+#include <kernel/tasks/InterruptBalancerTask.h>
+#include <kernel/time/TimeManagement.h>
+
+namespace Kernel {
+
+static constexpr i64 balance_interval_seconds = 2;
+// Below this many interrupts per pass on the busiest processor there is nothing worth moving.
+static constexpr u64 min_busiest_load = 1000;
+
+static Atomic<bool> s_enabled;
+
+struct MovableInterrupt {
+    u8 interrupt_number { 0 };
+    u64 load { 0 };
+};
+
+bool InterruptBalancerTask::is_enabled()
+{
+    return s_enabled.load(Base::MemoryOrder::memory_order_relaxed);
+}
+
+void InterruptBalancerTask::set_enabled(bool enabled)
+{
+    s_enabled.store(enabled, Base::MemoryOrder::memory_order_relaxed);
+}
+
+static void balance(Vector<u64>& previous_counts)
+{
+    u32 processor_count = min(Processor::count(), max_processors_with_interrupt_counts);
+
+    // Interrupts every processor took since the last pass, per interrupt number. These are
+    // sampled even while balancing is off, so that the first pass after switching it on is sane.
+    Vector<u64> loads;
+    loads.resize(processor_count * GENERIC_INTERRUPT_HANDLERS_COUNT);
+    previous_counts.resize(loads.size());
+    Vector<u64, max_processors_with_interrupt_counts> processor_loads;
+    processor_loads.resize(processor_count);
+    for (u32 cpu = 0; cpu < processor_count; ++cpu) {
+        for (size_t interrupt_number = 0; interrupt_number < GENERIC_INTERRUPT_HANDLERS_COUNT; ++interrupt_number) {
+            size_t slot = cpu * GENERIC_INTERRUPT_HANDLERS_COUNT + interrupt_number;
+            u64 count = get_interrupt_count_on_processor(interrupt_number, cpu);
+            loads[slot] = count - previous_counts[slot];
+            previous_counts[slot] = count;
+            processor_loads[cpu] += loads[slot];
+        }
+    }
+    if (!InterruptBalancerTask::is_enabled() || processor_count < 2)
+        return;
+
+    u64 busiest_load = 0;
+    u64 total_load = 0;
+    for (auto load : processor_loads) {
+        busiest_load = max(busiest_load, load);
+        total_load += load;
+    }
+    // Leave things alone while the busiest processor stays within a quarter of the average.
+    if (busiest_load < min_busiest_load || busiest_load * 4 * processor_count <= total_load * 5)
+        return;
+
+    Vector<MovableInterrupt, MSIHandler::interrupt_number_count> movable;
+    MSIHandler::for_each([&](MSIHandler& handler) {
+        movable.append({ handler.interrupt_number(), 0 });
+    });
+
+    // Start from what can't be moved, then hand out the busiest vectors first, each to the least
+    // loaded processor it may go to. Ties keep a vector where it is.
+    auto& assigned_loads = processor_loads;
+    for (auto& interrupt : movable) {
+        for (u32 cpu = 0; cpu < processor_count; ++cpu) {
+            u64 load = loads[cpu * GENERIC_INTERRUPT_HANDLERS_COUNT + interrupt.interrupt_number];
+            interrupt.load += load;
+            assigned_loads[cpu] -= load;
+        }
+    }
+    quick_sort(movable, [](auto& a, auto& b) { return a.load > b.load; });
+
+    for (auto& interrupt : movable) {
+        auto result = MSIHandler::with_interrupt_number(interrupt.interrupt_number, [&](MSIHandler& handler) -> KResult {
+            u32 target = handler.target_processor();
+            if (target >= processor_count)
+                return KSuccess;
+            for (u32 cpu = 0; cpu < processor_count; ++cpu) {
+                if ((handler.affinity_mask() & (1u << cpu)) && assigned_loads[cpu] < assigned_loads[target])
+                    target = cpu;
+            }
+            assigned_loads[target] += interrupt.load;
+            return handler.set_target_processor(target);
+        });
+        // The vector may have been freed since it was listed.
+        if (result.is_error() && result.error() != -ENOTSUP)
+            dbgln("InterruptBalancerTask: Failed to move interrupt {}: {}", interrupt.interrupt_number, result.error());
+    }
+}
+
+UNMAP_AFTER_INIT void InterruptBalancerTask::spawn()
+{
+    set_enabled(kernel_command_line().lookup("irqbalance"sv).value_or("off"sv) == "on"sv);
+    RefPtr<Thread> balancer_thread;
+    Process::create_kernel_process(balancer_thread, "InterruptBalancerTask", [] {
+        Vector<u64> previous_counts;
+        for (;;) {
+            balance(previous_counts);
+            (void)Thread::current()->sleep(Time::from_seconds(balance_interval_seconds));
+        }
+    });
+}
+
+}
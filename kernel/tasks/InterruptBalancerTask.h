@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+namespace Kernel {
+
+// Periodically moves busy MSI vectors over to the processors that took the fewest interrupts,
+// within each vector's affinity mask. Off unless irqbalance=on is passed or it is switched on
+// through /sys/interrupts/balance.
+class InterruptBalancerTask {
+public:
+    static void spawn();
+
+    static bool is_enabled();
+    static void set_enabled(bool);
+};
+
+}
@@ -0,0 +1,393 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+// includes
+#include <base/Singleton.h>
+#include <kernel/bus/pci/IDs.h>
+#include <kernel/memory/MemoryManager.h>
+#include <kernel/Sections.h>
+#include <kernel/virtio/VirtIOBlock.h>
+#include <kernel/WorkQueue.h>
+
+#define DEVICE_CAPACITY 0x0
+#define DEVICE_SEG_MAX 0xc
+#define DEVICE_NUM_QUEUES 0x22
+
+#define VIRTIO_MSI_NO_VECTOR 0xffff
+
+namespace Kernel {
+
+static Singleton<Vector<NonnullRefPtr<VirtIOBlock>>> s_devices;
+
+UNMAP_AFTER_INIT void VirtIOBlock::detect()
+{
+    unsigned index = 0;
+    PCI::enumerate([&](const PCI::Address& address, PCI::ID id) {
+        if (address.is_null())
+            return;
+        if (id.vendor_id != PCI::VendorID::VirtIO || id.device_id != PCI::DeviceID::VirtIOBlock)
+            return;
+        auto device = adopt_ref_if_nonnull(new (nothrow) VirtIOBlock(address, index++));
+        if (!device)
+            return;
+        dmesgln("VirtIOBlock: Found {} @ {}, {} sectors, {} request queue(s), {} interrupt vector(s)", device->device_name(), address, device->max_addressable_block(), device->m_request_queues.size(), device->m_interrupts ? device->m_interrupts->count() : 0);
+        s_devices->append(device.release_nonnull());
+    });
+}
+
+UNMAP_AFTER_INIT VirtIOBlock::VirtIOBlock(PCI::Address address, unsigned index)
+    : VirtIODevice(address, "VirtIOBlock")
+    , DiskDevice(3, allocate_minor_number(), sector_size)
+    , m_index(index)
+{
+    static_assert(requests_per_queue * header_stride <= PAGE_SIZE);
+    static_assert(sizeof(VirtIOBlockRequestHeader) < header_stride);
+
+    m_device_configuration = get_config(ConfigurationType::Device);
+    VERIFY(m_device_configuration);
+
+    bool success = negotiate_features([&](u64 supported_features) {
+        u64 negotiated = 0;
+        if (is_feature_set(supported_features, VIRTIO_BLK_F_SEG_MAX))
+            negotiated |= VIRTIO_BLK_F_SEG_MAX;
+        if (is_feature_set(supported_features, VIRTIO_BLK_F_RO))
+            negotiated |= VIRTIO_BLK_F_RO;
+        if (is_feature_set(supported_features, VIRTIO_BLK_F_FLUSH))
+            negotiated |= VIRTIO_BLK_F_FLUSH;
+        if (is_feature_set(supported_features, VIRTIO_BLK_F_MQ))
+            negotiated |= VIRTIO_BLK_F_MQ;
+        return negotiated;
+    });
+    if (success) {
+        u16 queue_count = 1;
+        read_config_atomic([&]() {
+            m_capacity = config_read64(*m_device_configuration, DEVICE_CAPACITY);
+            if (is_feature_accepted(VIRTIO_BLK_F_SEG_MAX))
+                m_max_segments = clamp(config_read32(*m_device_configuration, DEVICE_SEG_MAX), 1u, (u32)max_segments_per_request);
+            if (is_feature_accepted(VIRTIO_BLK_F_MQ))
+                queue_count = config_read16(*m_device_configuration, DEVICE_NUM_QUEUES);
+        });
+        m_read_only = is_feature_accepted(VIRTIO_BLK_F_RO);
+        m_flush_supported = is_feature_accepted(VIRTIO_BLK_F_FLUSH);
+
+        // One request queue per processor is enough to keep submissions from contending.
+        queue_count = clamp(queue_count, (u16)1, (u16)Processor::count());
+        setup_interrupt_vectors(queue_count);
+        success = setup_queues(queue_count) && initialize_request_queues(queue_count);
+    }
+    VERIFY(success);
+    finish_init();
+}
+
+VirtIOBlock::~VirtIOBlock()
+{
+}
+
+UNMAP_AFTER_INIT bool VirtIOBlock::initialize_request_queues(u16 queue_count)
+{
+    for (u16 queue_index = 0; queue_index < queue_count; ++queue_index) {
+        RequestQueue request_queue;
+        request_queue.headers = MM.allocate_contiguous_kernel_region(PAGE_SIZE, "VirtIOBlock Request Headers", Memory::Region::Access::ReadWrite);
+        if (!request_queue.headers)
+            return false;
+        for (auto& slot : request_queue.slots) {
+            slot.data = MM.allocate_kernel_region(max_segments_per_request * PAGE_SIZE, "VirtIOBlock Request Data", Memory::Region::Access::ReadWrite, AllocationStrategy::AllocateNow);
+            if (!slot.data)
+                return false;
+        }
+        m_request_queues.append(move(request_queue));
+    }
+    return true;
+}
+
+// Every request queue gets a vector of its own, aimed at the processor that submits to it.
+// This has to happen before the queues are enabled.
+UNMAP_AFTER_INIT void VirtIOBlock::setup_interrupt_vectors(u16 queue_count)
+{
+    auto interrupts = PCI::MessageSignalledInterrupts::try_create(pci_address(), queue_count, "VirtIOBlock"sv);
+    // The virtio transport can only tie queues to MSI-X table entries.
+    if (!interrupts || !interrupts->is_extended())
+        return;
+    size_t vector_count = interrupts->count();
+    for (size_t vector = 0; vector < vector_count; ++vector) {
+        interrupts->handler(vector).set_handler([this, vector, vector_count]() {
+            for (size_t queue_index = vector; queue_index < m_request_queues.size(); queue_index += vector_count)
+                handle_queue_update(queue_index);
+        });
+    }
+    interrupts->enable();
+
+    auto& common_configuration = *get_config(ConfigurationType::Common);
+    config_write16(common_configuration, COMMON_CFG_MSIX_CONFIG, VIRTIO_MSI_NO_VECTOR);
+    for (u16 queue_index = 0; queue_index < queue_count; ++queue_index) {
+        u16 vector = queue_index % vector_count;
+        config_write16(common_configuration, COMMON_CFG_QUEUE_SELECT, queue_index);
+        config_write16(common_configuration, COMMON_CFG_QUEUE_MSIX_VECTOR, vector);
+        if (config_read16(common_configuration, COMMON_CFG_QUEUE_MSIX_VECTOR) != vector) {
+            dbgln("VirtIOBlock: Device refused MSI-X vector {} for queue {}, staying on its pin", vector, queue_index);
+            return;
+        }
+    }
+    m_interrupts = move(interrupts);
+}
+
+String VirtIOBlock::device_name() const
+{
+    return String::formatted("vd{:c}", 'a' + m_index);
+}
+
+bool VirtIOBlock::handle_device_config_change()
+{
+    // The host may resize the disk at runtime.
+    read_config_atomic([&]() {
+        m_capacity = config_read64(*m_device_configuration, DEVICE_CAPACITY);
+    });
+    dbgln_if(VIRTIO_DEBUG, "VirtIOBlock: Capacity changed to {} sectors", m_capacity);
+    return true;
+}
+
+VirtIOBlockRequestHeader& VirtIOBlock::header(u16 queue_index, size_t slot_index)
+{
+    auto* base = m_request_queues[queue_index].headers->vaddr().offset(slot_index * header_stride).as_ptr();
+    return *reinterpret_cast<VirtIOBlockRequestHeader*>(base);
+}
+
+u8& VirtIOBlock::status(u16 queue_index, size_t slot_index)
+{
+    return *m_request_queues[queue_index].headers->vaddr().offset(slot_index * header_stride + sizeof(VirtIOBlockRequestHeader)).as_ptr();
+}
+
+PhysicalAddress VirtIOBlock::header_address(u16 queue_index, size_t slot_index) const
+{
+    return m_request_queues[queue_index].headers->physical_page(0)->paddr().offset(slot_index * header_stride);
+}
+
+Optional<size_t> VirtIOBlock::claim_slot(u16 queue_index, AsyncBlockDeviceRequest& request)
+{
+    ScopedSpinLock lock(get_queue(queue_index).lock());
+    auto& request_queue = m_request_queues[queue_index];
+    for (size_t slot_index = 0; slot_index < requests_per_queue; ++slot_index) {
+        auto& slot = request_queue.slots[slot_index];
+        if (slot.request)
+            continue;
+        slot.request = request;
+        slot.next_block = request.block_index();
+        ++request_queue.busy_slots;
+        return slot_index;
+    }
+    return {};
+}
+
+void VirtIOBlock::start_request(AsyncBlockDeviceRequest& request)
+{
+    if (request.end_block_index() > m_capacity || (request.request_type() != AsyncBlockDeviceRequest::Read && m_read_only)) {
+        request.complete(AsyncDeviceRequest::Failure);
+        return;
+    }
+
+    u16 queue_count = m_request_queues.size();
+    u16 preferred_queue = Processor::id() % queue_count;
+    for (u16 i = 0; i < queue_count; ++i) {
+        u16 queue_index = (preferred_queue + i) % queue_count;
+        auto slot_index = claim_slot(queue_index, request);
+        if (!slot_index.has_value())
+            continue;
+        submit_transfer(queue_index, slot_index.value());
+        if (m_polling_enabled)
+            poll_queue(queue_index);
+        return;
+    }
+    // BlockDevice never has more than max_queue_depth() requests in flight, so a slot is always free.
+    VERIFY_NOT_REACHED();
+}
+
+void VirtIOBlock::submit_transfer(u16 queue_index, size_t slot_index)
+{
+    auto& slot = m_request_queues[queue_index].slots[slot_index];
+    auto& request = *slot.request;
+    bool is_read = request.request_type() == AsyncBlockDeviceRequest::Read;
+    bool is_flush = request.request_type() == AsyncBlockDeviceRequest::Flush;
+
+    // Requests larger than a slot are carried out in several transfers.
+    u64 blocks_per_transfer = m_max_segments * PAGE_SIZE / block_size();
+    u32 block_count = min(request.end_block_index() - slot.next_block, blocks_per_transfer);
+    size_t offset = (slot.next_block - request.block_index()) * block_size();
+    size_t size = block_count * block_size();
+
+    // The request's own pages are used as they are when they fit into the descriptors a request may take.
+    // A flush carries no data at all.
+    Vector<PhysicalRange, max_segments_per_request> direct_ranges;
+    slot.uses_bounce_buffer = !is_flush && !request.for_each_physical_range(offset, size, [&](PhysicalAddress address, size_t length) {
+        if (!direct_ranges.is_empty() && direct_ranges.last().end() == address) {
+            direct_ranges.last().length += length;
+            return true;
+        }
+        if (direct_ranges.size() == m_max_segments)
+            return false;
+        direct_ranges.append({ address, length });
+        return true;
+    });
+    if (slot.uses_bounce_buffer) {
+        if (!is_read && !request.read_data(offset, slot.data->vaddr().as_ptr(), size)) {
+            release_slot(queue_index, slot_index, AsyncDeviceRequest::MemoryFault);
+            return;
+        }
+        direct_ranges.clear();
+        for (size_t segment = 0; segment * PAGE_SIZE < size; ++segment)
+            direct_ranges.append({ slot.data->physical_page(segment)->paddr(), min(PAGE_SIZE, size - segment * PAGE_SIZE) });
+    }
+
+    slot.blocks_in_transfer = block_count;
+    auto& request_header = header(queue_index, slot_index);
+    request_header.type = is_flush ? VIRTIO_BLK_T_FLUSH : (is_read ? VIRTIO_BLK_T_IN : VIRTIO_BLK_T_OUT);
+    request_header.reserved = 0;
+    request_header.sector = is_flush ? 0 : slot.next_block * (block_size() / sector_size);
+    status(queue_index, slot_index) = 0xff;
+
+    // FIXME: Put the segments in a per-slot indirect table once VirtIOQueueChain can flag one
+    //        with VIRTQ_DESC_F_INDIRECT, and negotiate VIRTIO_RING_F_INDIRECT_DESC. Until then
+    //        every segment takes a descriptor of its own.
+    auto& queue = get_queue(queue_index);
+    ScopedSpinLock lock(queue.lock());
+    VirtIOQueueChain chain { queue };
+    auto data_buffer_type = is_read ? BufferType::DeviceWritable : BufferType::DeviceReadable;
+    bool success = chain.add_buffer_to_chain(header_address(queue_index, slot_index), sizeof(VirtIOBlockRequestHeader), BufferType::DeviceReadable);
+    for (size_t i = 0; success && i < direct_ranges.size(); ++i)
+        success = chain.add_buffer_to_chain(direct_ranges[i].address, direct_ranges[i].length, data_buffer_type);
+    if (success)
+        success = chain.add_buffer_to_chain(header_address(queue_index, slot_index).offset(sizeof(VirtIOBlockRequestHeader)), 1, BufferType::DeviceWritable);
+    if (!success) {
+        chain.release_buffer_slots_to_queue();
+        lock.unlock();
+        dbgln("VirtIOBlock: Out of descriptors for a {}-segment request", direct_ranges.size());
+        release_slot(queue_index, slot_index, AsyncDeviceRequest::Failure);
+        return;
+    }
+    supply_chain_and_notify(queue_index, chain);
+}
+
+void VirtIOBlock::finish_transfer(u16 queue_index, size_t slot_index)
+{
+    auto& slot = m_request_queues[queue_index].slots[slot_index];
+    auto& request = *slot.request;
+
+    if (auto transfer_status = status(queue_index, slot_index); transfer_status != VIRTIO_BLK_S_OK) {
+        dbgln("VirtIOBlock: Transfer at block {} failed with status {}", slot.next_block, transfer_status);
+        release_slot(queue_index, slot_index, AsyncDeviceRequest::Failure);
+        return;
+    }
+
+    if (slot.uses_bounce_buffer && request.request_type() == AsyncBlockDeviceRequest::Read) {
+        size_t offset = (slot.next_block - request.block_index()) * block_size();
+        if (!request.write_data(offset, slot.data->vaddr().as_ptr(), slot.blocks_in_transfer * block_size())) {
+            release_slot(queue_index, slot_index, AsyncDeviceRequest::MemoryFault);
+            return;
+        }
+    }
+
+    slot.next_block += slot.blocks_in_transfer;
+    if (slot.next_block < request.end_block_index()) {
+        submit_transfer(queue_index, slot_index);
+        return;
+    }
+    release_slot(queue_index, slot_index, AsyncDeviceRequest::Success);
+}
+
+void VirtIOBlock::release_slot(u16 queue_index, size_t slot_index, AsyncDeviceRequest::RequestResult result)
+{
+    RefPtr<AsyncBlockDeviceRequest> request;
+    {
+        ScopedSpinLock lock(get_queue(queue_index).lock());
+        auto& request_queue = m_request_queues[queue_index];
+        request = move(request_queue.slots[slot_index].request);
+        --request_queue.busy_slots;
+    }
+    request->complete(result);
+}
+
+void VirtIOBlock::reap_used_chains(u16 queue_index, Vector<size_t, requests_per_queue>& completed_slots)
+{
+    auto& queue = get_queue(queue_index);
+    VERIFY(queue.lock().is_locked());
+    auto headers_base = header_address(queue_index, 0);
+    while (queue.new_data_available()) {
+        size_t used;
+        auto chain = queue.pop_used_buffer_chain(used);
+        if (chain.is_empty())
+            break;
+        // The first buffer of every chain is the request header, which tells us the slot.
+        Optional<size_t> slot_index;
+        chain.for_each([&](PhysicalAddress address, size_t) {
+            if (!slot_index.has_value())
+                slot_index = (address.get() - headers_base.get()) / header_stride;
+        });
+        chain.release_buffer_slots_to_queue();
+        VERIFY(slot_index.has_value() && slot_index.value() < requests_per_queue);
+        completed_slots.append(slot_index.value());
+    }
+}
+
+void VirtIOBlock::complete_used_requests(u16 queue_index)
+{
+    Vector<size_t, requests_per_queue> completed_slots;
+    {
+        ScopedSpinLock lock(get_queue(queue_index).lock());
+        reap_used_chains(queue_index, completed_slots);
+    }
+    for (auto slot_index : completed_slots)
+        finish_transfer(queue_index, slot_index);
+}
+
+void VirtIOBlock::handle_queue_update(u16 queue_index)
+{
+    VERIFY(queue_index < m_request_queues.size());
+    // Copying data out to the requesters may fault in user pages, so leave interrupt context first.
+    g_io_work->queue([this, queue_index]() {
+        complete_used_requests(queue_index);
+    });
+}
+
+void VirtIOBlock::poll_queue(u16 queue_index)
+{
+    auto& queue = get_queue(queue_index);
+    auto& request_queue = m_request_queues[queue_index];
+    {
+        ScopedSpinLock lock(queue.lock());
+        // Whoever is already polling this queue will also reap what we just submitted.
+        if (request_queue.has_poller)
+            return;
+        request_queue.has_poller = true;
+        queue.disable_interrupts();
+    }
+
+    // Spin until the queue drains. Under sustained load the poller keeps reaping for everyone.
+    for (;;) {
+        Vector<size_t, requests_per_queue> completed_slots;
+        {
+            ScopedSpinLock lock(queue.lock());
+            reap_used_chains(queue_index, completed_slots);
+            if (completed_slots.is_empty() && request_queue.busy_slots == 0) {
+                request_queue.has_poller = false;
+                queue.enable_interrupts();
+                return;
+            }
+        }
+        if (completed_slots.is_empty()) {
+            Processor::wait_check();
+            continue;
+        }
+        for (auto slot_index : completed_slots)
+            finish_transfer(queue_index, slot_index);
+    }
+}
+
+KResult VirtIOBlock::set_polling_enabled(bool enabled)
+{
+    m_polling_enabled = enabled;
+    return KSuccess;
+}
+
+}
@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+*/
+
+#pragma once
+
+// includes
+#include <base/Atomic.h>
+#include <base/Vector.h>
+#include <kernel/bus/pci/MessageSignalledInterrupts.h>
+#include <kernel/devices/DiskDevice.h>
+#include <kernel/virtio/VirtIO.h>
+#include <kernel/virtio/VirtIOQueue.h>
+
+#define VIRTIO_BLK_F_SEG_MAX (1 << 2)
+#define VIRTIO_BLK_F_RO (1 << 5)
+#define VIRTIO_BLK_F_FLUSH (1 << 9)
+#define VIRTIO_BLK_F_MQ (1 << 12)
+
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_T_FLUSH 4
+
+#define VIRTIO_BLK_S_OK 0
+#define VIRTIO_BLK_S_IOERR 1
+#define VIRTIO_BLK_S_UNSUPP 2
+
+namespace Kernel {
+
+struct [[gnu::packed]] VirtIOBlockRequestHeader {
+    u32 type;
+    u32 reserved;
+    u64 sector;
+};
+
+class VirtIOBlock final
+    : public VirtIODevice
+    , public DiskDevice {
+public:
+    static void detect();
+
+    virtual ~VirtIOBlock() override;
+
+    // ^DiskDevice
+    virtual u64 max_addressable_block() const override { return m_capacity; }
+    virtual bool is_read_only() const override { return m_read_only; }
+
+    // ^BlockDevice
+    virtual void start_request(AsyncBlockDeviceRequest&) override;
+    virtual size_t max_queue_depth() const override { return m_request_queues.size() * requests_per_queue; }
+    virtual bool supports_polling() const override { return true; }
+    virtual bool supports_flush() const override { return m_flush_supported; }
+    virtual bool is_polling_enabled() const override { return m_polling_enabled; }
+    virtual KResult set_polling_enabled(bool) override;
+
+    // ^Device
+    virtual String device_name() const override;
+    virtual StringView class_name() const override { return "VirtIOBlock"; }
+
+private:
+    static constexpr size_t sector_size = 512;
+    static constexpr size_t max_segments_per_request = 16;
+    static constexpr size_t requests_per_queue = 8;
+    static constexpr size_t header_stride = 32;
+
+    struct RequestSlot {
+        RefPtr<AsyncBlockDeviceRequest> request;
+        u64 next_block { 0 };
+        u32 blocks_in_transfer { 0 };
+        bool uses_bounce_buffer { false };
+        // One page per segment; the pages need not be physically contiguous.
+        OwnPtr<Memory::Region> data;
+    };
+
+    struct PhysicalRange {
+        PhysicalAddress address;
+        size_t length { 0 };
+        PhysicalAddress end() const { return address.offset(length); }
+    };
+
+    struct RequestQueue {
+        RequestSlot slots[requests_per_queue];
+        OwnPtr<Memory::Region> headers;
+        size_t busy_slots { 0 };
+        bool has_poller { false };
+    };
+
+    VirtIOBlock(PCI::Address, unsigned index);
+
+    virtual bool handle_device_config_change() override;
+    virtual void handle_queue_update(u16 queue_index) override;
+
+    bool initialize_request_queues(u16 queue_count);
+    void setup_interrupt_vectors(u16 queue_count);
+    Optional<size_t> claim_slot(u16 queue_index, AsyncBlockDeviceRequest&);
+    void submit_transfer(u16 queue_index, size_t slot_index);
+    void finish_transfer(u16 queue_index, size_t slot_index);
+    void release_slot(u16 queue_index, size_t slot_index, AsyncDeviceRequest::RequestResult);
+    void reap_used_chains(u16 queue_index, Vector<size_t, requests_per_queue>& completed_slots);
+    void complete_used_requests(u16 queue_index);
+    void poll_queue(u16 queue_index);
+
+    VirtIOBlockRequestHeader& header(u16 queue_index, size_t slot_index);
+    u8& status(u16 queue_index, size_t slot_index);
+    PhysicalAddress header_address(u16 queue_index, size_t slot_index) const;
+
+    unsigned m_index { 0 };
+    Configuration const* m_device_configuration { nullptr };
+    u64 m_capacity { 0 };
+    bool m_read_only { false };
+    bool m_flush_supported { false };
+    size_t m_max_segments { max_segments_per_request };
+    Vector<RequestQueue> m_request_queues;
+    OwnPtr<PCI::MessageSignalledInterrupts> m_interrupts;
+    Atomic<bool> m_polling_enabled { false };
+};
+
+}
@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+// includes
+#include <base/String.h>
+#include <libcore/ArgsParser.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+struct JobResult {
+    u64 operations { 0 };
+    u64 errors { 0 };
+};
+
+static double seconds_since(timespec const& start)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1'000'000'000.0;
+}
+
+static JobResult run_job(int fd, u64 block_count, size_t block_size, int duration, bool write_mode)
+{
+    JobResult result;
+    auto* buffer = static_cast<u8*>(malloc(block_size));
+    if (!buffer)
+        return result;
+    memset(buffer, 0x5a, block_size);
+
+    timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (seconds_since(start) < duration) {
+        u64 block = ((u64)arc4random() << 32 | arc4random()) % block_count;
+        ssize_t nbytes = write_mode ? pwrite(fd, buffer, block_size, block * block_size) : pread(fd, buffer, block_size, block * block_size);
+        if (nbytes != (ssize_t)block_size)
+            ++result.errors;
+        else
+            ++result.operations;
+    }
+    free(buffer);
+    return result;
+}
+
+int main(int argc, char** argv)
+{
+    if (pledge("stdio rpath wpath proc", nullptr) < 0) {
+        perror("pledge");
+        return 1;
+    }
+
+    const char* path = nullptr;
+    int block_size = 4096;
+    int jobs = 4;
+    int duration = 5;
+    int size_in_mib = 0;
+    bool write_mode = false;
+
+    Core::ArgsParser args_parser;
+    args_parser.set_general_help("Measure random I/O operations per second on a block device.");
+    args_parser.add_option(block_size, "Size of each I/O in bytes (default 4096)", "block-size", 'b', "bytes");
+    args_parser.add_option(jobs, "Number of concurrent jobs (default 4)", "jobs", 'j', "count");
+    args_parser.add_option(duration, "Seconds to run for (default 5)", "time", 't', "seconds");
+    args_parser.add_option(size_in_mib, "Spread I/O over the first N MiB (default: the whole device)", "size", 's', "MiB");
+    args_parser.add_option(write_mode, "Write instead of read (destroys data!)", "write", 'w');
+    args_parser.add_positional_argument(path, "Block device to benchmark", "device");
+    args_parser.parse(argc, argv);
+
+    if (block_size <= 0 || jobs <= 0 || duration <= 0) {
+        warnln("blkbench: block size, jobs and time must be positive");
+        return 1;
+    }
+
+    int fd = open(path, write_mode ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        perror("open");
+        return 1;
+    }
+    off_t device_size = (off_t)size_in_mib * 1024 * 1024;
+    if (size_in_mib <= 0) {
+        struct stat st;
+        if (fstat(fd, &st) < 0) {
+            perror("fstat");
+            return 1;
+        }
+        device_size = st.st_size;
+    }
+    if (device_size < block_size) {
+        warnln("blkbench: Can't determine the size of {}, pass --size", path);
+        return 1;
+    }
+    u64 block_count = device_size / block_size;
+
+    int pipe_fds[2];
+    if (pipe(pipe_fds) < 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < jobs; ++i) {
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            close(pipe_fds[0]);
+            auto result = run_job(fd, block_count, block_size, duration, write_mode);
+            write(pipe_fds[1], &result, sizeof(result));
+            _exit(0);
+        }
+    }
+    close(pipe_fds[1]);
+
+    JobResult total;
+    for (int i = 0; i < jobs; ++i) {
+        JobResult result;
+        if (read(pipe_fds[0], &result, sizeof(result)) == sizeof(result)) {
+            total.operations += result.operations;
+            total.errors += result.errors;
+        }
+        wait(nullptr);
+    }
+    double elapsed = seconds_since(start);
+
+    double iops = total.operations / elapsed;
+    outln("{}: {} random {}s of {} bytes, {} jobs, {:.2} s", path, total.operations, write_mode ? "write" : "read", block_size, jobs, elapsed);
+    outln("{:.0} IOPS, {:.2} MiB/s, {} errors", iops, iops * block_size / (1024 * 1024), total.errors);
+    return total.errors ? 1 : 0;
+}
@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2021, Krisna Pranav
+ *
+ * SPDX-License-Identifier: BSD-2-Clause
+ */
+
+// includes
+#include <base/JsonObject.h>
+#include <base/QuickSort.h>
+#include <base/String.h>
+#include <base/Vector.h>
+#include <libcore/ArgsParser.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+struct BenchmarkResult {
+    StringView name;
+    u64 operations { 0 };
+    u64 bytes { 0 };
+    u64 errors { 0 };
+    double seconds { 0 };
+    Vector<u64> latencies_us;
+};
+
+static u64 now_us()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (u64)now.tv_sec * 1'000'000 + now.tv_nsec / 1000;
+}
+
+// SplitMix64, seeded from --seed so that offsets and lookup order repeat from run to run.
+static u64 s_random_state;
+
+static u64 random_u64()
+{
+    u64 z = (s_random_state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+static void report(BenchmarkResult& result, unsigned seed)
+{
+    JsonObject object;
+    object.set("benchmark", String(result.name));
+    object.set("seed", seed);
+    object.set("operations", result.operations);
+    object.set("errors", result.errors);
+    object.set("seconds", result.seconds);
+    object.set("operations_per_second", result.seconds > 0 ? result.operations / result.seconds : 0.0);
+    if (result.bytes) {
+        object.set("bytes", result.bytes);
+        object.set("mib_per_second", result.seconds > 0 ? result.bytes / result.seconds / (1024 * 1024) : 0.0);
+    }
+    if (!result.latencies_us.is_empty()) {
+        auto& latencies = result.latencies_us;
+        quick_sort(latencies);
+        u64 total = 0;
+        for (auto latency : latencies)
+            total += latency;
+        object.set("latency_average_us", total / latencies.size());
+        object.set("latency_p50_us", latencies[latencies.size() / 2]);
+        object.set("latency_p99_us", latencies[min(latencies.size() - 1, latencies.size() * 99 / 100)]);
+        object.set("latency_max_us", latencies.last());
+    }
+    outln("{}", object.to_string());
+}
+
+template<typename Callback>
+static BenchmarkResult measure(StringView name, Callback callback)
+{
+    BenchmarkResult result;
+    result.name = name;
+    u64 start = now_us();
+    callback(result);
+    result.seconds = (now_us() - start) / 1'000'000.0;
+    return result;
+}
+
+static String path_in(String const& directory, StringView prefix, size_t index)
+{
+    return String::formatted("{}/{}{}", directory, prefix, index);
+}
+
+static void sequential_write(String const& path, u64 file_size, size_t io_size, u8* buffer, BenchmarkResult& result)
+{
+    int fd = open(path.characters(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        ++result.errors;
+        return;
+    }
+    for (u64 offset = 0; offset < file_size; offset += io_size) {
+        if (write(fd, buffer, io_size) != (ssize_t)io_size) {
+            ++result.errors;
+            break;
+        }
+        ++result.operations;
+        result.bytes += io_size;
+    }
+    if (fsync(fd) < 0)
+        ++result.errors;
+    close(fd);
+}
+
+static void sequential_read(String const& path, size_t io_size, u8* buffer, BenchmarkResult& result)
+{
+    int fd = open(path.characters(), O_RDONLY);
+    if (fd < 0) {
+        ++result.errors;
+        return;
+    }
+    for (;;) {
+        ssize_t nread = read(fd, buffer, io_size);
+        if (nread < 0)
+            ++result.errors;
+        if (nread <= 0)
+            break;
+        ++result.operations;
+        result.bytes += nread;
+    }
+    close(fd);
+}
+
+static void random_io(String const& path, u64 file_size, size_t io_size, u8* buffer, size_t count, bool write_mode, BenchmarkResult& result)
+{
+    int fd = open(path.characters(), write_mode ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+        ++result.errors;
+        return;
+    }
+    u64 slots = max(file_size / io_size, (u64)1);
+    for (size_t i = 0; i < count; ++i) {
+        off_t offset = (random_u64() % slots) * io_size;
+        u64 start = now_us();
+        ssize_t nbytes = write_mode ? pwrite(fd, buffer, io_size, offset) : pread(fd, buffer, io_size, offset);
+        result.latencies_us.append(now_us() - start);
+        if (nbytes != (ssize_t)io_size) {
+            ++result.errors;
+            continue;
+        }
+        ++result.operations;
+        result.bytes += io_size;
+    }
+    if (write_mode && fsync(fd) < 0)
+        ++result.errors;
+    close(fd);
+}
+
+static void create_files(String const& directory, StringView prefix, size_t count, BenchmarkResult& result)
+{
+    for (size_t i = 0; i < count; ++i) {
+        auto path = path_in(directory, prefix, i);
+        u64 start = now_us();
+        int fd = open(path.characters(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd >= 0)
+            close(fd);
+        result.latencies_us.append(now_us() - start);
+        if (fd < 0)
+            ++result.errors;
+        else
+            ++result.operations;
+    }
+}
+
+static void stat_files(String const& directory, StringView prefix, size_t count, BenchmarkResult& result)
+{
+    for (size_t i = 0; i < count; ++i) {
+        auto path = path_in(directory, prefix, random_u64() % count);
+        struct stat st;
+        u64 start = now_us();
+        int rc = stat(path.characters(), &st);
+        result.latencies_us.append(now_us() - start);
+        if (rc < 0)
+            ++result.errors;
+        else
+            ++result.operations;
+    }
+}
+
+static void unlink_files(String const& directory, StringView prefix, size_t count, BenchmarkResult& result)
+{
+    for (size_t i = 0; i < count; ++i) {
+        auto path = path_in(directory, prefix, i);
+        u64 start = now_us();
+        int rc = unlink(path.characters());
+        result.latencies_us.append(now_us() - start);
+        if (rc < 0)
+            ++result.errors;
+        else
+            ++result.operations;
+    }
+}
+
+static void list_directory(String const& directory, BenchmarkResult& result)
+{
+    DIR* dir = opendir(directory.characters());
+    if (!dir) {
+        ++result.errors;
+        return;
+    }
+    while (readdir(dir))
+        ++result.operations;
+    closedir(dir);
+}
+
+static void fsync_appends(String const& path, size_t count, u8* buffer, size_t append_size, BenchmarkResult& result)
+{
+    int fd = open(path.characters(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (fd < 0) {
+        ++result.errors;
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        u64 start = now_us();
+        bool ok = write(fd, buffer, append_size) == (ssize_t)append_size && fsync(fd) == 0;
+        result.latencies_us.append(now_us() - start);
+        if (!ok) {
+            ++result.errors;
+            continue;
+        }
+        ++result.operations;
+        result.bytes += append_size;
+    }
+    close(fd);
+}
+
+int main(int argc, char** argv)
+{
+    if (pledge("stdio rpath wpath cpath", nullptr) < 0) {
+        perror("pledge");
+        return 1;
+    }
+
+    const char* directory_argument = nullptr;
+    int file_size_in_mib = 64;
+    int io_size = 4096;
+    int random_count = 10000;
+    int file_count = 2000;
+    int large_directory_count = 20000;
+    int fsync_count = 500;
+    unsigned seed = 1;
+    Vector<String> selected;
+
+    Core::ArgsParser args_parser;
+    args_parser.set_general_help("Run filesystem benchmarks in a scratch directory and print one JSON object per result.");
+    args_parser.add_option(file_size_in_mib, "Size of the sequential test file in MiB (default 64)", "file-size", 's', "MiB");
+    args_parser.add_option(io_size, "Size of each read or write in bytes (default 4096)", "io-size", 'b', "bytes");
+    args_parser.add_option(random_count, "Random I/Os per random benchmark (default 10000)", "random-count", 'r', "count");
+    args_parser.add_option(file_count, "Files per metadata benchmark (default 2000)", "files", 'n', "count");
+    args_parser.add_option(large_directory_count, "Entries in the large directory (default 20000)", "directory-size", 'd', "count");
+    args_parser.add_option(fsync_count, "Appends in the fsync benchmark (default 500)", "fsyncs", 'f', "count");
+    args_parser.add_option(seed, "Seed for random offsets and lookup order (default 1)", "seed", 'S', "seed");
+    args_parser.add_option(Core::ArgsParser::Option {
+        .requires_argument = true,
+        .help_string = "Only run the named benchmark group: sequential, random, metadata, directory or fsync (repeatable)",
+        .long_name = "only",
+        .short_name = 'o',
+        .value_name = "group",
+        .accept_value = [&](const char* group) {
+            selected.append(group);
+            return true;
+        },
+    });
+    args_parser.add_positional_argument(directory_argument, "Scratch directory on the filesystem under test", "directory");
+    args_parser.parse(argc, argv);
+
+    if (file_size_in_mib <= 0 || io_size <= 0 || random_count <= 0 || file_count <= 0 || large_directory_count <= 0 || fsync_count <= 0) {
+        warnln("fsbench: sizes and counts must be positive");
+        return 1;
+    }
+
+    auto should_run = [&](StringView group) {
+        return selected.is_empty() || selected.contains_slow(group);
+    };
+
+    s_random_state = seed;
+
+    String directory = directory_argument;
+    auto work_directory = String::formatted("{}/fsbench.{}", directory, getpid());
+    if (mkdir(work_directory.characters(), 0755) < 0) {
+        perror("mkdir");
+        return 1;
+    }
+
+    auto* buffer = static_cast<u8*>(malloc(io_size));
+    if (!buffer) {
+        warnln("fsbench: Out of memory");
+        return 1;
+    }
+    for (int i = 0; i < io_size; ++i)
+        buffer[i] = random_u64() & 0xff;
+
+    u64 file_size = (u64)file_size_in_mib * 1024 * 1024;
+    auto data_path = String::formatted("{}/data", work_directory);
+    u64 total_errors = 0;
+    auto run = [&](StringView name, auto callback) {
+        auto result = measure(name, callback);
+        total_errors += result.errors;
+        report(result, seed);
+    };
+
+    if (should_run("sequential"sv) || should_run("random"sv)) {
+        if (should_run("sequential"sv)) {
+            run("sequential_write"sv, [&](auto& result) { sequential_write(data_path, file_size, io_size, buffer, result); });
+            run("sequential_read"sv, [&](auto& result) { sequential_read(data_path, io_size, buffer, result); });
+        } else {
+            // The random benchmarks still need the data file, but its write isn't reported.
+            BenchmarkResult result;
+            sequential_write(data_path, file_size, io_size, buffer, result);
+            total_errors += result.errors;
+        }
+        if (should_run("random"sv)) {
+            run("random_read"sv, [&](auto& result) { random_io(data_path, file_size, io_size, buffer, random_count, false, result); });
+            run("random_write"sv, [&](auto& result) { random_io(data_path, file_size, io_size, buffer, random_count, true, result); });
+        }
+        unlink(data_path.characters());
+    }
+
+    if (should_run("metadata"sv)) {
+        run("create"sv, [&](auto& result) { create_files(work_directory, "f"sv, file_count, result); });
+        run("stat"sv, [&](auto& result) { stat_files(work_directory, "f"sv, file_count, result); });
+        run("unlink"sv, [&](auto& result) { unlink_files(work_directory, "f"sv, file_count, result); });
+    }
+
+    if (should_run("directory"sv)) {
+        auto large_directory = String::formatted("{}/large", work_directory);
+        if (mkdir(large_directory.characters(), 0755) < 0) {
+            perror("mkdir");
+            return 1;
+        }
+        run("large_directory_create"sv, [&](auto& result) { create_files(large_directory, "entry"sv, large_directory_count, result); });
+        run("large_directory_list"sv, [&](auto& result) { list_directory(large_directory, result); });
+        run("large_directory_lookup"sv, [&](auto& result) { stat_files(large_directory, "entry"sv, large_directory_count, result); });
+        run("large_directory_unlink"sv, [&](auto& result) { unlink_files(large_directory, "entry"sv, large_directory_count, result); });
+        rmdir(large_directory.characters());
+    }
+
+    if (should_run("fsync"sv)) {
+        auto log_path = String::formatted("{}/log", work_directory);
+        run("fsync_append"sv, [&](auto& result) { fsync_appends(log_path, fsync_count, buffer, min(io_size, 512), result); });
+        unlink(log_path.characters());
+    }
+
+    free(buffer);
+    rmdir(work_directory.characters());
+    return total_errors ? 1 : 0;
+}